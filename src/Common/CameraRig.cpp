@@ -0,0 +1,77 @@
+/**
+ * @file   CameraRig.cpp
+ * @brief  Batched pose conversion for several cameras rigidly mounted on one
+ * body.
+ */
+
+#include "CameraRig.hpp"
+
+#include <stdexcept>
+#include <string>
+
+CameraRig::CameraRig(const Transform3 &unityWorld_T_NEDworld)
+{
+    unity_T_NEDworld = NEDToUnity::matrix() * unityWorld_T_NEDworld.matrix();
+}
+
+void CameraRig::addCamera(int cam_index, const Transform3 &body_T_cam)
+{
+    Transform3 right;
+    right.matrix() = body_T_cam.matrix() * CameraToUnityCamera::matrix() *
+                     NEDToUnity::matrix().transpose();
+    body_T_unitycam.push_back(right);
+    cameraIndices.push_back(cam_index);
+}
+
+void CameraRig::convert(const Transform3 &world_T_body, TransformList &unityPoses) const
+{
+    Transform3 left;
+    left.matrix() = unity_T_NEDworld * world_T_body.matrix();
+
+    unityPoses.resize(body_T_unitycam.size());
+    for (size_t i = 0; i < body_T_unitycam.size(); i++)
+    {
+        // Both factors are affine, so this skips the bottom row.
+        unityPoses[i] = left * body_T_unitycam[i];
+    }
+}
+
+void CameraRig::setCameraPoses(unity_outgoing::StateMessage_t &state,
+                               const Transform3 &world_T_body) const
+{
+    for (int cam_index : cameraIndices)
+    {
+        if (cam_index < 0 || static_cast<size_t>(cam_index) >= state.cameras.size())
+        {
+            throw std::out_of_range("Camera rig refers to camera " + std::to_string(cam_index) +
+                                    " but the state has " +
+                                    std::to_string(state.cameras.size()) + " cameras");
+        }
+    }
+
+    Transform3 left;
+    left.matrix() = unity_T_NEDworld * world_T_body.matrix();
+
+    for (size_t i = 0; i < body_T_unitycam.size(); i++)
+    {
+        setCameraPose(state.cameras[cameraIndices[i]], left * body_T_unitycam[i]);
+    }
+}
+
+void CameraRig::setCameraPose(unity_outgoing::Camera_t &camera, const Transform3 &unity_pose)
+{
+    camera.position[0] = unity_pose.translation()[0];
+    camera.position[1] = unity_pose.translation()[1];
+    camera.position[2] = unity_pose.translation()[2];
+
+    // Poses are rigid, so the linear part already is the rotation. This
+    // avoids the SVD in Transform::rotation(). Normalizing the quaternion
+    // absorbs rounding errors in the input.
+    Quaternionx quat(unity_pose.linear());
+    quat.normalize();
+
+    camera.rotation[0] = quat.x();
+    camera.rotation[1] = quat.y();
+    camera.rotation[2] = quat.z();
+    camera.rotation[3] = quat.w();
+}
@@ -0,0 +1,63 @@
+#ifndef FLIGHTGOGGLESCAMERARIG_H
+#define FLIGHTGOGGLESCAMERARIG_H
+/**
+ * @file   CameraRig.hpp
+ * @brief  Batched pose conversion for several cameras rigidly mounted on one
+ * body.
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/StdVector>
+
+#include "jsonMessageSpec.hpp"
+#include "transforms.hpp"
+
+typedef std::vector<Transform3, Eigen::aligned_allocator<Transform3>> TransformList;
+
+/**
+ * @brief Converts one body pose into Unity poses for all cameras of a rig.
+ *
+ * Gives the same poses as calling convertCameraAndDronePoseToUnityCoordinates()
+ * for every camera, but that function's chain of 4x4 products is split in a
+ * part that only depends on the body pose and a part that only depends on the
+ * fixed extrinsics. The latter is computed once in addCamera(), so each
+ * camera costs a single affine product per update.
+ */
+class CameraRig
+{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    explicit CameraRig(const Transform3 &unityWorld_T_NEDworld = Transform3::Identity());
+
+    // Adds a camera mounted at body_T_cam (z forward, as for
+    // convertCameraAndDronePoseToUnityCoordinates()) whose pose goes to
+    // state.cameras[cam_index].
+    void addCamera(int cam_index, const Transform3 &body_T_cam);
+
+    size_t size() const { return cameraIndices.size(); }
+
+    // Writes the Unity pose of every camera, in the order they were added,
+    // for the NED body pose world_T_body.
+    void convert(const Transform3 &world_T_body, TransformList &unityPoses) const;
+
+    // Converts and stores the poses in state.cameras without allocating.
+    // Throws std::out_of_range if a camera index is not in state.cameras.
+    void setCameraPoses(unity_outgoing::StateMessage_t &state,
+                        const Transform3 &world_T_body) const;
+
+    // Stores a rigid Unity pose in camera's position and rotation.
+    static void setCameraPose(unity_outgoing::Camera_t &camera, const Transform3 &unity_pose);
+
+  private:
+    // Coordinate change to Unity, applied to the body pose.
+    Matrix4 unity_T_NEDworld;
+    // Per camera: the extrinsics, the switch to a x aligned camera and the
+    // coordinate change back from Unity.
+    TransformList body_T_unitycam;
+    std::vector<int> cameraIndices;
+};
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * @file   ClockOffsetEstimator.cpp
+ * @brief  Minimum round trip clock offset filter.
+ */
+
+#include "ClockOffsetEstimator.hpp"
+
+ClockOffsetEstimator::ClockOffsetEstimator(size_t windowSize)
+    : windowSize(windowSize > 0 ? windowSize : 1)
+{
+    window.reserve(this->windowSize);
+}
+
+void ClockOffsetEstimator::addSample(int64_t clientSend, int64_t rendererReceive,
+                                     int64_t rendererSend, int64_t clientReceive)
+{
+    Sample sample;
+    sample.roundTrip = (clientReceive - clientSend) - (rendererSend - rendererReceive);
+    if (sample.roundTrip < 0)
+    {
+        return;
+    }
+    // Halve the two terms separately so that large clock values cannot
+    // overflow the sum.
+    sample.offset = (rendererReceive - clientSend) / 2 + (rendererSend - clientReceive) / 2;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (window.size() < windowSize)
+    {
+        window.push_back(sample);
+    }
+    else
+    {
+        window[next] = sample;
+    }
+    next = (next + 1) % windowSize;
+}
+
+ClockOffsetEstimator::Estimate ClockOffsetEstimator::getEstimate() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Estimate estimate;
+    estimate.samples = window.size();
+    for (const Sample &sample : window)
+    {
+        if (!estimate.valid || sample.roundTrip < estimate.roundTrip)
+        {
+            estimate.valid = true;
+            estimate.offset = sample.offset;
+            estimate.roundTrip = sample.roundTrip;
+        }
+    }
+    return estimate;
+}
+
+void ClockOffsetEstimator::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    window.clear();
+    next = 0;
+}
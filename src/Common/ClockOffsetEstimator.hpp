@@ -0,0 +1,66 @@
+#ifndef FLIGHTGOGGLESCLOCKOFFSETESTIMATOR_H
+#define FLIGHTGOGGLESCLOCKOFFSETESTIMATOR_H
+/**
+ * @file   ClockOffsetEstimator.hpp
+ * @brief  Estimates the offset between the renderer's clock and the client's
+ * monotonic clock from ping round trips.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief NTP style offset estimate over a window of recent pings.
+ *
+ * Each ping yields four timestamps: client send (t0), renderer receive (t1),
+ * renderer send (t2) and client receive (t3). Assuming symmetric delays,
+ * offset = ((t1 - t0) + (t2 - t3)) / 2 with an error of at most half the
+ * network round trip (t3 - t0) - (t2 - t1). Queueing only ever adds delay,
+ * so the sample with the smallest round trip in the window is used.
+ */
+class ClockOffsetEstimator
+{
+  public:
+    struct Estimate
+    {
+        bool valid = false;
+        // Renderer clock minus client clock, in us.
+        int64_t offset = 0;
+        // Network round trip of the sample the offset came from. The offset is
+        // off by at most half of it.
+        int64_t roundTrip = 0;
+        // Samples in the window.
+        size_t samples = 0;
+    };
+
+    // Estimates from the last windowSize pings, so that drift between the
+    // clocks is followed.
+    explicit ClockOffsetEstimator(size_t windowSize = 16);
+
+    // Adds a ping. Client times are on the client's monotonic clock, renderer
+    // times on the renderer's clock. Samples with a negative round trip are
+    // ignored.
+    void addSample(int64_t clientSend, int64_t rendererReceive,
+                   int64_t rendererSend, int64_t clientReceive);
+
+    Estimate getEstimate() const;
+
+    void reset();
+
+  private:
+    struct Sample
+    {
+        int64_t offset;
+        int64_t roundTrip;
+    };
+
+    size_t windowSize;
+    mutable std::mutex mutex;
+    // Ring of the last windowSize samples.
+    std::vector<Sample> window;
+    size_t next = 0;
+};
+
+#endif
@@ -6,6 +6,9 @@
  */
 
 #include "FlightGogglesClient.hpp"
+#include "SharedBufferMat.hpp"
+
+#include <algorithm>
 
 ///////////////////////
 // Constructor
@@ -16,6 +19,24 @@ FlightGogglesClient::FlightGogglesClient()
     initializeConnections();
 }
 
+FlightGogglesClient::~FlightGogglesClient()
+{
+    stop();
+}
+
+void FlightGogglesClient::setDecodeThreadCount(size_t numThreads)
+{
+    // The calling thread also decodes, so it counts as one of the threads.
+    if (numThreads <= 1)
+    {
+        decodePool.reset();
+    }
+    else
+    {
+        decodePool.reset(new ThreadPool(numThreads - 1));
+    }
+}
+
 void FlightGogglesClient::initializeConnections()
 {
     std::cout << "Initializing ZMQ connections..." << std::endl;
@@ -28,31 +49,103 @@ void FlightGogglesClient::initializeConnections()
 }
 
 
+///////////////////////
+// State publication
+///////////////////////
+
+// Published copies kept for reuse. Requests in flight and frames hold on to
+// the copy they were made from, so a few are usually taken.
+static const size_t kMaxSpareStates = 8;
+
+void FlightGogglesClient::updateState(const std::function<void(unity_outgoing::StateMessage_t &)> &update)
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    update(state);
+
+    std::shared_ptr<unity_outgoing::StateMessage_t> next;
+    for (std::shared_ptr<unity_outgoing::StateMessage_t> &spare : spareStates)
+    {
+        // Only spareStates holds it, and as it is no longer published,
+        // nobody can take a new reference.
+        if (spare.use_count() == 1)
+        {
+            // Order the last reader's accesses before the copy below.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            next = spare;
+            *next = state;
+            break;
+        }
+    }
+    if (!next)
+    {
+        next = std::make_shared<unity_outgoing::StateMessage_t>(state);
+    }
+
+    // Readers holding the previous snapshot keep it alive until they are done.
+    std::shared_ptr<const unity_outgoing::StateMessage_t> previous =
+        std::atomic_exchange(&publishedState,
+                             std::shared_ptr<const unity_outgoing::StateMessage_t>(next));
+    if (!previous)
+    {
+        return;
+    }
+    // The published copy was made here, so it is not const underneath.
+    std::shared_ptr<unity_outgoing::StateMessage_t> retired =
+        std::const_pointer_cast<unity_outgoing::StateMessage_t>(previous);
+    auto known = std::find(spareStates.begin(), spareStates.end(), retired);
+    if (known == spareStates.end() && spareStates.size() < kMaxSpareStates)
+    {
+        spareStates.push_back(retired);
+    }
+}
+
+void FlightGogglesClient::publishState()
+{
+    updateState([](unity_outgoing::StateMessage_t &) {});
+}
+
+std::shared_ptr<const unity_outgoing::StateMessage_t> FlightGogglesClient::getStateSnapshot() const
+{
+    return std::atomic_load(&publishedState);
+}
+
 void FlightGogglesClient::setCameraPoseUsingROSCoordinates(Transform3 ros_pose, int cam_index) {
-  // To transforms
-  Transform3 NED_pose = convertROSToNEDCoordinates(ros_pose);
-  Transform3 unity_pose = convertNEDGlobalPoseToGlobalUnityCoordinates(NED_pose);
+  updateState([&](unity_outgoing::StateMessage_t &newState) {
+    setCameraPoseUsingROSCoordinates(newState, ros_pose, cam_index);
+  });
+}
 
-  // Extract position and rotation
-  std::vector<double> position = {
-    unity_pose.translation()[0],
-    unity_pose.translation()[1],
-    unity_pose.translation()[2],
-  };
+void FlightGogglesClient::setCameraPoseUsingROSCoordinates(unity_outgoing::StateMessage_t &state,
+                                                           Transform3 ros_pose, int cam_index) {
+  // To transforms. Same as going through NED, in a single axis swizzle.
+  Transform3 unity_pose = convertROSToUnityCoordinates(ros_pose);
 
-  Eigen::Matrix3d rotationMatrix = unity_pose.rotation();
-  Quaternionx quat(rotationMatrix);
+  // Set camera position and rotation in place, without allocating.
+  CameraRig::setCameraPose(state.cameras[cam_index], unity_pose);
+}
 
-  std::vector<double> rotation = {
-    quat.x(),
-    quat.y(),
-    quat.z(),
-    quat.w(),
-  };
+void FlightGogglesClient::setCameraPoseUsingROSCoordinates(unity_outgoing::StateMessage_t &state,
+                                                           const Vector3 &ros_position,
+                                                           const Quaternionx &ros_rotation,
+                                                           int cam_index) {
+  unity_outgoing::Camera_t &camera = state.cameras[cam_index];
+  Vector3 position = ENUToUnity::apply(ros_position);
+  camera.position[0] = position[0];
+  camera.position[1] = position[1];
+  camera.position[2] = position[2];
 
-  // Set camera position and rotation
-  state.cameras[cam_index].position = position;
-  state.cameras[cam_index].rotation = rotation;
+  Quaternionx quat = convertROSToUnityCoordinates(ros_rotation).normalized();
+  camera.rotation[0] = quat.x();
+  camera.rotation[1] = quat.y();
+  camera.rotation[2] = quat.z();
+  camera.rotation[3] = quat.w();
+}
+
+void FlightGogglesClient::setCameraPosesUsingRig(const CameraRig &rig,
+                                                 const Transform3 &world_T_body) {
+  updateState([&](unity_outgoing::StateMessage_t &newState) {
+    rig.setCameraPoses(newState, world_T_body);
+  });
 }
 
 
@@ -65,8 +158,20 @@ void FlightGogglesClient::setCameraPoseUsingROSCoordinates(Transform3 ros_pose,
  * If the pose is good, asks Unity to render another frame by sending a ZMQ
  * message.
 */
-bool FlightGogglesClient::requestRender()
+bool FlightGogglesClient::requestRender(bool throttleToMaxFramerate)
 {
+    // Serialize a consistent snapshot, even if pose writers are mid-update.
+    std::shared_ptr<const unity_outgoing::StateMessage_t> snapshot = getStateSnapshot();
+    if (!snapshot)
+    {
+        // Nothing published yet, so publish whatever was set up directly.
+        publishState();
+        snapshot = getStateSnapshot();
+    }
+    // Shadows the member on purpose, so that the rest of this function only
+    // sees the snapshot.
+    const unity_outgoing::StateMessage_t &state = *snapshot;
+
     // Make sure that we have a pose that is newer than the last rendered pose.
     if (!(state.utime > last_uploaded_utime))
     {
@@ -75,7 +180,8 @@ bool FlightGogglesClient::requestRender()
     }
 
     // Limit Unity framerate by throttling requests
-    if (state.utime < (last_uploaded_utime + (1e6)/state.maxFramerate)) {
+    if (throttleToMaxFramerate &&
+        state.utime < (last_uploaded_utime + (1e6)/state.maxFramerate)) {
       // Skip this render frame.
       return false;
     }
@@ -83,135 +189,848 @@ bool FlightGogglesClient::requestRender()
     // Debug
     // std::cout << "Frame " << std::to_string(state.utime) << std::endl;
 
+    // Only send the full state when something other than the poses changed,
+    // or periodically so that a renderer that (re)connected late catches up.
+    bool sendFullState = !deltaStateUpdates ||
+                         forceFullState ||
+                         !lastFullState ||
+                         state.utime >= lastFullStateUtime + fullStateIntervalUs ||
+                         !unity_outgoing::hasSameStaticSettings(state, *lastFullState);
+
     // Create new message object
     zmqpp::message msg;
-    // Add topic header
-    msg << "Pose";
+    if (sendFullState)
+    {
+        // Add topic header
+        msg << "Pose";
+        // Serialize status update & append to message. Produces the same
+        // bytes as json(state).dump() without building a json DOM.
+        msg << stateSerializer.serialize(state);
+        lastFullState = snapshot;
+        lastFullStateUtime = state.utime;
+        forceFullState = false;
+    }
+    else if (binaryPoseUpdates &&
+             unity_outgoing::encodeBinaryPoseUpdate(state, binaryPoseBuffer))
+    {
+        msg << unity_outgoing::kBinaryPoseUpdateTopic;
+        msg.add_raw(binaryPoseBuffer.data(), binaryPoseBuffer.size());
+    }
+    else
+    {
+        msg << "PoseUpdate";
+        msg << stateSerializer.serialize(unity_outgoing::PoseUpdateMessage_t{&state});
+    }
 
     // Update timestamp
     last_uploaded_utime = state.utime;
 
-    // Create JSON object for status update & append to message.
-    json json_msg = state;
-    msg << json_msg.dump();
-
     // Output debug messages at 1hz
     if (state.utime > last_upload_debug_utime + 1e6)
     {
+        std::string topic = msg.get<std::string>(0);
         std::cout << "Last message sent: \"";
-        std::cout << msg.get<std::string>(0) << std::endl;
-        // Print JSON object
-        std::cout << json_msg.dump(4) << std::endl;
+        std::cout << topic << std::endl;
+        if (topic == unity_outgoing::kBinaryPoseUpdateTopic)
+        {
+            std::cout << msg.size(1) << " bytes of binary pose update" << std::endl;
+        }
+        else
+        {
+            // Print JSON object
+            std::cout << json::parse(msg.get<std::string>(1)).dump(4) << std::endl;
+        }
         std::cout << "===================" << std::endl;
         // reset time of last debug message
         last_upload_debug_utime = state.utime;
     }
+    // Remember the request so that its frame can be matched to it. This has
+    // to happen before sending, as the frame can come back before send()
+    // returns.
+    InFlightRequests::Request request;
+    request.utime = state.utime;
+    request.state = snapshot;
+    request.sentUtime = getMonotonicTimestamp();
+    inFlightRequests.add(request);
+
     // Send message without blocking.
+    recordMessage(RenderLogDirection::Upload, request.sentUtime, msg);
+    bool sent;
+    try
+    {
+        sent = upload_socket.send(msg, true);
+    }
+    catch (...)
+    {
+        inFlightRequests.cancel(request.utime);
+        throw;
+    }
+    if (!sent)
+    {
+        inFlightRequests.cancel(request.utime);
+        return false;
+    }
+
+    if (pingIntervalUs > 0 && getMonotonicTimestamp() >= lastPingUtime + pingIntervalUs)
+    {
+        sendPing();
+    }
+    return true;
+}
+
+void FlightGogglesClient::sendPing()
+{
+    unity_outgoing::Ping_t ping;
+    ping.sequence = ++pingSequence;
+    ping.clientSendUtime = getMonotonicTimestamp();
+    unity_outgoing::encodePing(ping, pingBuffer);
+
+    zmqpp::message msg;
+    msg << unity_outgoing::kPingTopic;
+    msg.add_raw(pingBuffer.data(), pingBuffer.size());
+    recordMessage(RenderLogDirection::Upload, ping.clientSendUtime, msg);
     upload_socket.send(msg, true);
+    lastPingUtime = ping.clientSendUtime;
+}
+
+bool FlightGogglesClient::handlePong(const zmqpp::message &msg, int64_t receivedUtime)
+{
+    if (msg.parts() != 1 || !unity_incoming::isPong(msg.raw_data(0), msg.size(0)))
+    {
+        return false;
+    }
+    try
+    {
+        unity_incoming::Pong_t pong;
+        unity_incoming::decodePong(msg.raw_data(0), msg.size(0), pong);
+        clockOffsetEstimator.addSample(pong.clientSendUtime, pong.rendererReceiveUtime,
+                                       pong.rendererSendUtime, receivedUtime);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Dropping malformed pong: " << e.what() << std::endl;
+    }
     return true;
 }
 
+void FlightGogglesClient::startRenderScheduler(PoseUpdate updatePose)
+{
+    std::shared_ptr<const unity_outgoing::StateMessage_t> snapshot = getStateSnapshot();
+    double rate = snapshot ? snapshot->maxFramerate : state.maxFramerate;
+    renderScheduler.start(rate, [this, updatePose](int64_t deadlineUtime) {
+        if (updatePose && !updatePose(deadlineUtime))
+        {
+            return false;
+        }
+        return requestRender(false);
+    });
+}
+
+void FlightGogglesClient::stopRenderScheduler()
+{
+    renderScheduler.stop();
+}
+
+void FlightGogglesClient::startLockstep(size_t maxInFlight, PoseSource nextPose)
+{
+    stopLockstep();
+    lockstepRunning = true;
+    lockstepThread = std::thread(&FlightGogglesClient::lockstepLoop, this,
+                                 std::max<size_t>(1, maxInFlight), nextPose);
+}
+
+void FlightGogglesClient::stopLockstep()
+{
+    lockstepRunning = false;
+    waitForLockstep();
+}
+
+void FlightGogglesClient::waitForLockstep()
+{
+    if (lockstepThread.joinable())
+    {
+        lockstepThread.join();
+    }
+}
+
+void FlightGogglesClient::lockstepLoop(size_t maxInFlight, PoseSource nextPose)
+{
+    while (waitForLockstepSlot(maxInFlight))
+    {
+        bool more = false;
+        updateState([&](unity_outgoing::StateMessage_t &newState) {
+            more = nextPose(newState);
+            // Frames are told apart by utime alone.
+            if (more && newState.utime <= last_uploaded_utime)
+            {
+                newState.utime = last_uploaded_utime + 1;
+            }
+        });
+        if (!more)
+        {
+            // Let the last frames come in before reporting that we are done.
+            waitForLockstepSlot(1);
+            break;
+        }
+        requestRender(false);
+    }
+    lockstepRunning = false;
+}
+
+bool FlightGogglesClient::waitForLockstepSlot(size_t limit)
+{
+    while (lockstepRunning)
+    {
+        if (inFlightRequests.waitForSlot(limit, ioPollTimeoutMs * 1000))
+        {
+            return true;
+        }
+        size_t expired =
+            inFlightRequests.expireOlderThan(getMonotonicTimestamp() - lockstepRequestTimeoutUs);
+        if (expired)
+        {
+            std::cerr << "Gave up on " << expired << " render requests" << std::endl;
+        }
+    }
+    return false;
+}
+
 // This is a blocking call.
 unity_incoming::RenderOutput_t FlightGogglesClient::handleImageResponse()
+{
+    // Get data from client as fast as possible.
+    // The message is reference counted so that zero-copy images can keep it alive.
+    std::shared_ptr<zmqpp::message> msgHolder = std::make_shared<zmqpp::message>();
+    int64_t receivedUtime;
+    do
+    {
+        download_socket.receive(*msgHolder);
+        receivedUtime = getMonotonicTimestamp();
+        recordMessage(RenderLogDirection::Download, receivedUtime, *msgHolder);
+    } while (handlePong(*msgHolder, receivedUtime));
+    renderScheduler.notifyCompletion();
+
+    unity_incoming::RenderOutput_t output = decodeImageResponse(msgHolder, receivedUtime);
+    publishFrame(output);
+    // The caller is the consumer.
+    output.timing.dispatched = getMonotonicTimestamp();
+    recordFrameLatency(output.timing);
+    return output;
+}
+
+unity_incoming::RenderOutput_t FlightGogglesClient::decodeImageResponse(
+    const std::shared_ptr<zmqpp::message> &msgHolder, int64_t receivedUtime)
+{
+    const zmqpp::message &msg = *msgHolder;
+    framePartData.resize(msg.parts());
+    framePartSizes.resize(msg.parts());
+    for (size_t i = 0; i < msg.parts(); i++)
+    {
+        framePartData[i] = static_cast<const uint8_t *>(msg.raw_data(i));
+        framePartSizes[i] = msg.size(i);
+    }
+    return decodeFrameParts(framePartData.data(), framePartSizes.data(), msg.parts(),
+                            msgHolder, receivedUtime, inFlightRequests);
+}
+
+unity_incoming::RenderOutput_t FlightGogglesClient::decodeFrameParts(
+    const uint8_t *const *partData, const size_t *partSizes, size_t numParts,
+    const std::shared_ptr<const void> &owner, int64_t receivedUtime,
+    InFlightRequests &requests)
 {
     // Populate output
     unity_incoming::RenderOutput_t output;
-
-    // Get data from client as fast as possible
-    zmqpp::message msg;
-    download_socket.receive(msg);
+    output.timing.received = receivedUtime ? receivedUtime : getMonotonicTimestamp();
 
     // Sanity check the packet.
-    // if (msg.parts() <= 1)
-    // {
-    //     return NULL;
-    // }
-    // Unpack message metadata.
-    std::string json_metadata_string = msg.get(0);
-    // Parse metadata.
-    unity_incoming::RenderMetadata_t renderMetadata = json::parse(json_metadata_string);
-
-    // Log the latency in ms (1,000 microseconds)
+    if (numParts < 1)
+    {
+        throw std::runtime_error("Frame has no metadata");
+    }
+    // Parse message metadata straight from the message part. The renderer
+    // may send either JSON or binary metadata.
+    const char *metadata = reinterpret_cast<const char *>(partData[0]);
+    if (unity_incoming::isBinaryRenderMetadata(metadata, partSizes[0]))
+    {
+        unity_incoming::decodeBinaryRenderMetadata(metadata, partSizes[0], parsedMetadata);
+    }
+    else
+    {
+        renderMetadataParser.parse(metadata, partSizes[0], parsedMetadata);
+    }
+    const unity_incoming::RenderMetadata_t &renderMetadata = parsedMetadata;
+    output.timing.parsed = getMonotonicTimestamp();
+    // Everything below indexes channels by camera.
+    if (renderMetadata.channels.size() != renderMetadata.cameraIDs.size())
+    {
+        throw std::invalid_argument("Frame metadata has " +
+                                    std::to_string(renderMetadata.channels.size()) +
+                                    " channel counts for " +
+                                    std::to_string(renderMetadata.cameraIDs.size()) + " cameras");
+    }
+    if (numParts < renderMetadata.cameraIDs.size() + 1)
+    {
+        throw std::runtime_error("Frame has " + std::to_string(numParts - 1) +
+                                 " images for " +
+                                 std::to_string(renderMetadata.cameraIDs.size()) + " cameras");
+    }
+
+    // Attach the state this frame was requested with.
+    InFlightRequests::Request request;
+    if (requests.complete(renderMetadata.utime, request))
+    {
+        output.requestState = request.state;
+        output.timing.requestSent = request.sentUtime;
+    }
+
+    // Log the latency in ms (1,000 microseconds). A live frame that answers
+    // one of our requests is timed from when the request was sent, both on
+    // the monotonic clock, so neither the renderer's clock nor the one utime
+    // was taken from matter. Other frames only have their utime to go by.
+    int64_t latency = receivedUtime && output.timing.requestSent
+                          ? output.timing.received - output.timing.requestSent
+                          : getTimestamp() - renderMetadata.utime;
     if (!u_packet_latency)
     {
-        u_packet_latency = (getTimestamp() - renderMetadata.utime);
+        u_packet_latency = latency;
     }
     else
     {
         // avg over last ~10 frames
-        u_packet_latency =
-            ((u_packet_latency * (9) + (getTimestamp() - renderMetadata.utime)) / 10);
-    }
-
-    ensureBufferIsAllocated(renderMetadata);
-
-    // For each camera, save the received image.
-    for (uint i = 0; i < renderMetadata.cameraIDs.size(); i++)
-    {
-
-        // Reshape the received image
-        // Calculate how long the casted and reshaped image will be.
-        uint32_t imageLen = renderMetadata.camWidth * renderMetadata.camHeight * renderMetadata.channels[i];
-        // Get raw image bytes from ZMQ message.
-        // WARNING: This is a zero-copy operation that also casts the input to an array of unit8_t.
-        // when the message is deleted, this pointer is also dereferenced.
-        const uint8_t* imageData;
-        msg.get(imageData, i + 1);
-        // ALL images comes as 3-channel images from Unity. However, if this camera is supposed to be single channel, we need to discard the other 2 channels.
-        // Note: We assume that if the camera is supposed to be single channel, Unity has already done the "Right Thing (TM)" and done grayscale conversion for us.
-        // This is necessary since Unity is optimized for outputting 3-channel images and dropping channels in Unity would be costly.
-        uint32_t bufferRowLength = renderMetadata.camWidth * renderMetadata.channels[i];
-        // Convert image data into std::vector<uint8_t> by iterating over the output domain
-        for (uint16_t y = 0; y < renderMetadata.camHeight; y++)
-        {
-            // Additionally, the images that come from Unity are Y-inverted, so we should invert the rows.
-            uint16_t inv_y = renderMetadata.camHeight - y - 1;
-            for (uint16_t x = 0; x < renderMetadata.camWidth; x++)
-            {
-                for (uint8_t c = 0; c < renderMetadata.channels[i]; c++)
-                {
-                    // cast the input
-                    _castedInputBuffer[y * bufferRowLength + x * renderMetadata.channels[i] + c] = imageData[inv_y * renderMetadata.camWidth * renderMetadata.channels[i] + x*renderMetadata.channels[i] + c];
-                }
-            }
-        }
-
-        // 
+        u_packet_latency = (u_packet_latency * 9 + latency) / 10;
+    }
 
-        // Pack image into cv::Mat
-        cv::Mat new_image = cv::Mat(renderMetadata.camHeight, renderMetadata.camWidth, CV_MAKETYPE(CV_8U, renderMetadata.channels[i]));
-        memcpy(new_image.data, _castedInputBuffer.data(), imageLen);
+    // Decodes the image of one camera into its slot of the output. Writing by
+    // index keeps the output order deterministic when decoding in parallel.
+    size_t numCameras = renderMetadata.cameraIDs.size();
+    output.images.resize(numCameras);
+    auto decodeCamera = [&](size_t i)
+    {
+        // Get raw image bytes from the message. They are only valid while
+        // owner lives.
+        const uint8_t* imageData = partData[i + 1];
+        int srcChannels = getImageChannels(renderMetadata, i, partSizes[i + 1]);
 
+        if (zeroCopyImages)
+        {
+            // The image holds a reference to owner, so it stays valid for as
+            // long as it is kept, like a copied image would.
+            output.images[i] = makeSharedBufferMat(renderMetadata.camHeight,
+                                                   renderMetadata.camWidth,
+                                                   CV_MAKETYPE(CV_8U, srcChannels), imageData,
+                                                   owner);
+            return;
+        }
 
-        // FlightGoggles outputs RGB, but OpenCV expects BGR.
-        // So, tell OpenCv that the input is RGB.
-        if (renderMetadata.channels[i]==3){
-            cv::cvtColor(new_image, new_image, CV_RGB2BGR);
+        // Unity images may carry more channels than the camera asked for (e.g.
+        // grayscale rendered as RGB). Unity has already done the grayscale
+        // conversion, so the kernel keeps only the first channel in that case.
+        // It also un-inverts the rows and swaps RGB to BGR in the same pass.
+        cv::Mat new_image;
+        if (poolImages)
+        {
+            new_image = framePool.acquire(renderMetadata.camWidth, renderMetadata.camHeight,
+                                          renderMetadata.channels[i]);
         }
+        else
+        {
+            new_image = cv::Mat(renderMetadata.camHeight, renderMetadata.camWidth,
+                                CV_MAKETYPE(CV_8U, renderMetadata.channels[i]));
+        }
+        image_conversion::flipAndSwizzle(imageData, srcChannels,
+                                         new_image.data, new_image.step[0], renderMetadata.channels[i],
+                                         renderMetadata.camWidth, renderMetadata.camHeight);
 
         // debug
         // cv::imshow("Debug", new_image);
 
         // Add image to output vector
-        output.images.push_back(new_image);
+        output.images[i] = new_image;
+    };
+
+    // Zero-copy decoding is too cheap to be worth handing off to the pool.
+    if (decodePool && !zeroCopyImages && numCameras > 1)
+    {
+        decodePool->parallelFor(numCameras, decodeCamera);
+    }
+    else
+    {
+        for (size_t i = 0; i < numCameras; i++)
+        {
+            decodeCamera(i);
+        }
     }
 
+    output.imagesAreRaw = zeroCopyImages;
+
     // Add metadata to output
     output.renderMetadata = renderMetadata;
+    output.timing.decoded = getMonotonicTimestamp();
 
     // Output debug at 1hz
-    if (getTimestamp() > last_download_debug_utime + 1e6)
+    if (getMonotonicTimestamp() > last_download_debug_utime + 1e6)
     {
         // Log update FPS
         std::cout << "Update rate: "
                   << (num_frames * 1e6) /
-                         (getTimestamp() - last_download_debug_utime)
-                  << " ms_latency: " << u_packet_latency / 1e3 << std::endl;
+                         (getMonotonicTimestamp() - last_download_debug_utime)
+                  << " ms_latency: " << u_packet_latency / 1e3;
+        const LatencyHistogram &endToEnd = latencyHistograms.endToEnd;
+        if (endToEnd.getCount())
+        {
+            std::cout << " e2e_ms p50: " << endToEnd.getValueAtPercentile(50) / 1e3
+                      << " p99: " << endToEnd.getValueAtPercentile(99) / 1e3
+                      << " p99.9: " << endToEnd.getValueAtPercentile(99.9) / 1e3;
+        }
+        // How far the renderer's clock is off ours, for lining up its logs.
+        ClockOffsetEstimator::Estimate offset = clockOffsetEstimator.getEstimate();
+        if (offset.valid)
+        {
+            std::cout << " renderer_clock_offset_ms: " << offset.offset / 1e3 << " +- "
+                      << offset.roundTrip / 2e3;
+        }
+        std::cout << std::endl;
 
-        last_download_debug_utime = getTimestamp();
+        last_download_debug_utime = getMonotonicTimestamp();
         num_frames = 0;
     }
     num_frames++;
 
     return output;
 }
+
+// Converts a raw image from a zero-copy RenderOutput_t into a normal image.
+cv::Mat FlightGogglesClient::finalizeImage(const cv::Mat &rawImage, int channels)
+{
+    if (channels <= 0)
+    {
+        channels = rawImage.channels();
+    }
+    cv::Mat image = cv::Mat(rawImage.rows, rawImage.cols, CV_MAKETYPE(CV_8U, channels));
+    image_conversion::flipAndSwizzle(rawImage.data, rawImage.channels(),
+                                     image.data, image.step[0], channels,
+                                     rawImage.cols, rawImage.rows);
+    return image;
+}
+
+// Works out how many channels an image part actually has, since Unity may
+// send more channels than requested.
+int FlightGogglesClient::getImageChannels(const unity_incoming::RenderMetadata_t &renderMetadata,
+                                          int cam_index, size_t partSize)
+{
+    if (cam_index < 0 || static_cast<size_t>(cam_index) >= renderMetadata.channels.size() ||
+        static_cast<size_t>(cam_index) >= renderMetadata.cameraIDs.size())
+    {
+        throw std::invalid_argument("Frame metadata has no camera " + std::to_string(cam_index));
+    }
+    size_t numPixels = static_cast<size_t>(renderMetadata.camWidth) * renderMetadata.camHeight;
+    if (numPixels == 0 || partSize % numPixels != 0 ||
+        partSize / numPixels < static_cast<size_t>(renderMetadata.channels[cam_index]))
+    {
+        throw std::runtime_error("Image for camera " + renderMetadata.cameraIDs[cam_index] +
+                                 " has " + std::to_string(partSize) + " bytes, which does not match " +
+                                 std::to_string(renderMetadata.camWidth) + "x" +
+                                 std::to_string(renderMetadata.camHeight) + "x" +
+                                 std::to_string(renderMetadata.channels[cam_index]));
+    }
+    return static_cast<int>(partSize / numPixels);
+}
+
+///////////////////////
+// Shared memory publishing
+///////////////////////
+
+void FlightGogglesClient::startFramePublishing(const std::string &name, size_t numSlots,
+                                               size_t maxImageBytes)
+{
+    if (maxImageBytes == 0)
+    {
+        int maxChannels = 3;
+        for (const unity_outgoing::Camera_t &cam : state.cameras)
+        {
+            maxChannels = std::max(maxChannels, cam.channels);
+        }
+        maxImageBytes = static_cast<size_t>(state.camWidth) * state.camHeight * maxChannels;
+    }
+    std::atomic_store(&frameRing,
+                      std::make_shared<FrameRingWriter>(name, numSlots, maxImageBytes));
+}
+
+void FlightGogglesClient::stopFramePublishing()
+{
+    std::atomic_store(&frameRing, std::shared_ptr<FrameRingWriter>());
+}
+
+void FlightGogglesClient::publishFrame(const unity_incoming::RenderOutput_t &output)
+{
+    std::shared_ptr<FrameRingWriter> ring = std::atomic_load(&frameRing);
+    if (!ring)
+    {
+        return;
+    }
+    const unity_incoming::RenderMetadata_t &renderMetadata = output.renderMetadata;
+    size_t numCameras = std::min(output.images.size(), renderMetadata.cameraIDs.size());
+    for (size_t i = 0; i < numCameras; i++)
+    {
+        const cv::Mat &image = output.images[i];
+        if (image.empty() || image.depth() != CV_8U)
+        {
+            continue;
+        }
+        int channels = image.channels();
+        if (output.imagesAreRaw && i < renderMetadata.channels.size())
+        {
+            channels = renderMetadata.channels[i];
+        }
+        size_t rowSize = static_cast<size_t>(image.cols) * channels;
+        uint8_t *data = ring->beginImage(rowSize * image.rows);
+        if (!data)
+        {
+            continue;
+        }
+        // Raw images are flipped and swizzled straight into the ring, so
+        // they are still only copied once.
+        if (output.imagesAreRaw)
+        {
+            image_conversion::flipAndSwizzle(image.data, image.channels(), data, rowSize,
+                                             channels, image.cols, image.rows);
+        }
+        else
+        {
+            for (int y = 0; y < image.rows; y++)
+            {
+                memcpy(data + y * rowSize, image.ptr(y), rowSize);
+            }
+        }
+
+        FrameRingImage ringImage;
+        ringImage.utime = renderMetadata.utime;
+        ringImage.camDepthScale = renderMetadata.camDepthScale;
+        ringImage.isCompressed = renderMetadata.isCompressed;
+        ringImage.cameraIndex = static_cast<uint32_t>(i);
+        ringImage.numCameras = static_cast<uint32_t>(numCameras);
+        ringImage.width = image.cols;
+        ringImage.height = image.rows;
+        ringImage.channels = channels;
+        ringImage.cameraID = renderMetadata.cameraIDs[i];
+        ring->publishImage(ringImage);
+    }
+}
+
+///////////////////////
+// Record and replay
+///////////////////////
+
+void FlightGogglesClient::startRecording(const std::string &directory)
+{
+    std::atomic_store(&renderLog, std::make_shared<RenderLogWriter>(directory));
+}
+
+void FlightGogglesClient::stopRecording()
+{
+    // The last thread still appending closes the log.
+    std::atomic_store(&renderLog, std::shared_ptr<RenderLogWriter>());
+}
+
+void FlightGogglesClient::recordMessage(RenderLogDirection direction, int64_t timestamp,
+                                        const zmqpp::message &msg)
+{
+    std::shared_ptr<RenderLogWriter> log = std::atomic_load(&renderLog);
+    if (!log)
+    {
+        return;
+    }
+    try
+    {
+        log->append(direction, timestamp, msg);
+    }
+    catch (const std::exception &e)
+    {
+        // E.g. a full disk should not stop rendering.
+        std::cerr << "Stopped recording: " << e.what() << std::endl;
+        stopRecording();
+    }
+}
+
+void FlightGogglesClient::replay(const std::shared_ptr<const RenderLogReader> &log, double speed)
+{
+    if (ioRunning)
+    {
+        throw std::logic_error("Cannot replay while the I/O thread is running");
+    }
+
+    // Replayed frames are matched against the replayed requests, like live
+    // frames are against inFlightRequests.
+    InFlightRequests requests;
+    unity_outgoing::StateMessage_t requestState;
+    bool hasRequestState = false;
+
+    RenderLogRecord record;
+    int64_t firstTimestamp = 0;
+    int64_t startUtime = getMonotonicTimestamp();
+    for (size_t i = 0; i < log->size(); i++)
+    {
+        log->read(i, record);
+        if (i == 0)
+        {
+            firstTimestamp = record.timestamp;
+        }
+        if (speed > 0)
+        {
+            int64_t due = startUtime +
+                          static_cast<int64_t>((record.timestamp - firstTimestamp) / speed);
+            int64_t wait = due - getMonotonicTimestamp();
+            if (wait > 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(wait));
+            }
+        }
+
+        if (record.direction == RenderLogDirection::Upload)
+        {
+            if (record.parts() < 2)
+            {
+                continue;
+            }
+            std::string topic(reinterpret_cast<const char *>(record.partData[0]),
+                              record.partSizes[0]);
+            const char *body = reinterpret_cast<const char *>(record.partData[1]);
+            size_t bodySize = record.partSizes[1];
+            try
+            {
+                if (topic == "Pose")
+                {
+                    requestState = json::parse(std::string(body, bodySize))
+                                       .get<unity_outgoing::StateMessage_t>();
+                    hasRequestState = true;
+                }
+                else if (topic == "PoseUpdate" && hasRequestState)
+                {
+                    unity_outgoing::applyPoseUpdate(json::parse(std::string(body, bodySize)),
+                                                    requestState);
+                }
+                else if (topic == unity_outgoing::kBinaryPoseUpdateTopic && hasRequestState)
+                {
+                    unity_outgoing::applyBinaryPoseUpdate(body, bodySize, requestState);
+                }
+                else
+                {
+                    continue;
+                }
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Skipping malformed request in log: " << e.what() << std::endl;
+                continue;
+            }
+            InFlightRequests::Request request;
+            request.utime = requestState.utime;
+            request.state = std::make_shared<unity_outgoing::StateMessage_t>(requestState);
+            request.sentUtime = record.timestamp;
+            requests.add(request);
+            continue;
+        }
+
+        if (record.parts() == 1 && unity_incoming::isPong(record.partData[0], record.partSizes[0]))
+        {
+            continue;
+        }
+        unity_incoming::RenderOutput_t output;
+        try
+        {
+            output = decodeFrameParts(record.partData.data(), record.partSizes.data(),
+                                      record.parts(), log, 0, requests);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Skipping malformed frame in log: " << e.what() << std::endl;
+            continue;
+        }
+        // Recorded send times are from another session's clock.
+        output.timing.requestSent = 0;
+        output.timing.dispatched = getMonotonicTimestamp();
+        recordFrameLatency(output.timing);
+        dispatchRenderOutput(output);
+    }
+}
+
+///////////////////////
+// Asynchronous receive
+///////////////////////
+
+void FlightGogglesClient::addRenderOutputCallback(RenderOutputCallback callback)
+{
+    std::lock_guard<std::mutex> lock(consumersMutex);
+    renderOutputCallbacks.push_back(callback);
+}
+
+std::future<unity_incoming::RenderOutput_t> FlightGogglesClient::getNextRenderOutput()
+{
+    std::lock_guard<std::mutex> lock(consumersMutex);
+    renderOutputPromises.emplace_back();
+    return renderOutputPromises.back().get_future();
+}
+
+void FlightGogglesClient::start()
+{
+    if (ioRunning)
+    {
+        return;
+    }
+    frameQueue.reset(new FrameQueue<unity_incoming::RenderOutput_t>(frameQueueCapacity,
+                                                                    frameQueuePolicy));
+    ioRunning = true;
+    ioThread = std::thread(&FlightGogglesClient::ioLoop, this);
+    dispatchThread = std::thread(&FlightGogglesClient::dispatchLoop, this);
+}
+
+void FlightGogglesClient::stop()
+{
+    stopLockstep();
+    renderScheduler.stop();
+    if (!ioRunning)
+    {
+        return;
+    }
+    ioRunning = false;
+    // Release a producer blocked on a full queue.
+    frameQueue->close();
+    ioThread.join();
+    dispatchThread.join();
+
+    // Waiters on frames that will never arrive get a broken_promise error.
+    std::lock_guard<std::mutex> lock(consumersMutex);
+    renderOutputPromises.clear();
+}
+
+void FlightGogglesClient::ioLoop()
+{
+    // Poll with a timeout so that stop() is noticed even if Unity goes quiet.
+    zmqpp::poller poller;
+    poller.add(download_socket);
+
+    while (ioRunning)
+    {
+        if (!poller.poll(ioPollTimeoutMs) || !poller.has_input(download_socket))
+        {
+            continue;
+        }
+
+        std::shared_ptr<zmqpp::message> msgHolder = std::make_shared<zmqpp::message>();
+        download_socket.receive(*msgHolder);
+        int64_t receivedUtime = getMonotonicTimestamp();
+        recordMessage(RenderLogDirection::Download, receivedUtime, *msgHolder);
+        if (handlePong(*msgHolder, receivedUtime))
+        {
+            continue;
+        }
+        // Even a malformed frame means the renderer is ready for the next
+        // request.
+        renderScheduler.notifyCompletion();
+
+        unity_incoming::RenderOutput_t output;
+        try
+        {
+            output = decodeImageResponse(msgHolder, receivedUtime);
+        }
+        catch (const std::exception &e)
+        {
+            // A single malformed frame should not take down the I/O thread.
+            std::cerr << "Dropping malformed frame: " << e.what() << std::endl;
+            continue;
+        }
+
+        // Hand off to the dispatch thread so that slow consumers never hold
+        // up the socket. What happens when they fall behind is up to the
+        // queue's drop policy.
+        frameQueue->push(std::move(output));
+    }
+}
+
+void FlightGogglesClient::dispatchLoop()
+{
+    unity_incoming::RenderOutput_t output;
+    while (ioRunning)
+    {
+        if (frameQueue->pop(output, ioPollTimeoutMs * 1000))
+        {
+            output.timing.dispatched = getMonotonicTimestamp();
+            recordFrameLatency(output.timing);
+            dispatchRenderOutput(output);
+        }
+    }
+}
+
+FrameQueue<unity_incoming::RenderOutput_t>::Stats FlightGogglesClient::getFrameQueueStats() const
+{
+    if (!frameQueue)
+    {
+        return FrameQueue<unity_incoming::RenderOutput_t>::Stats();
+    }
+    return frameQueue->getStats();
+}
+
+void FlightGogglesClient::recordFrameLatency(const unity_incoming::FrameTiming_t &timing)
+{
+    if (timing.requestSent)
+    {
+        latencyHistograms.roundTrip.record(timing.received - timing.requestSent);
+        latencyHistograms.endToEnd.record(timing.dispatched - timing.requestSent);
+    }
+    latencyHistograms.parse.record(timing.parsed - timing.received);
+    latencyHistograms.decode.record(timing.decoded - timing.parsed);
+    latencyHistograms.handoff.record(timing.dispatched - timing.decoded);
+}
+
+void FlightGogglesClient::resetLatencyHistograms()
+{
+    latencyHistograms.roundTrip.reset();
+    latencyHistograms.parse.reset();
+    latencyHistograms.decode.reset();
+    latencyHistograms.handoff.reset();
+    latencyHistograms.endToEnd.reset();
+}
+
+void FlightGogglesClient::dispatchRenderOutput(const unity_incoming::RenderOutput_t &output)
+{
+    // Readers in other processes get the frame before any consumer here can
+    // hold it up.
+    publishFrame(output);
+
+    // Take the consumers out of the lock so that callbacks may register more.
+    std::vector<RenderOutputCallback> callbacks;
+    std::vector<std::promise<unity_incoming::RenderOutput_t>> promises;
+    {
+        std::lock_guard<std::mutex> lock(consumersMutex);
+        callbacks = renderOutputCallbacks;
+        promises.swap(renderOutputPromises);
+    }
+
+    for (std::promise<unity_incoming::RenderOutput_t> &promise : promises)
+    {
+        promise.set_value(output);
+    }
+
+    int64_t dispatchStart = getMonotonicTimestamp();
+    for (RenderOutputCallback &callback : callbacks)
+    {
+        callback(output);
+    }
+    int64_t dispatchTime = getMonotonicTimestamp() - dispatchStart;
+
+    // A consumer that takes longer than a frame makes the queue fill up, which
+    // drops or delays frames depending on the policy. Count those and warn at
+    // most at 1hz.
+    if (dispatchTime > slowConsumerThresholdUs)
+    {
+        slowConsumerCount++;
+        if (getMonotonicTimestamp() > lastSlowConsumerWarningUtime + 1e6)
+        {
+            std::cerr << "Render output callbacks took " << dispatchTime / 1e3
+                      << " ms, which is longer than the "
+                      << slowConsumerThresholdUs / 1e3 << " ms budget. "
+                      << slowConsumerCount << " slow frames so far." << std::endl;
+            lastSlowConsumerWarningUtime = getMonotonicTimestamp();
+        }
+    }
+}
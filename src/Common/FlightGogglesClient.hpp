@@ -10,6 +10,14 @@
 #include <fstream>
 #include <chrono>
 #include <unistd.h>
+#include <stdexcept>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 // Include ZMQ bindings for comms with Unity.
 #include <iostream>
@@ -27,17 +35,66 @@ using json = nlohmann::json;
 
 // For converting ROS/LCM coordinates to Unity coordinates
 #include "transforms.hpp"
+#include "CameraRig.hpp"
+
+// For reshaping raw images from Unity
+#include "imageConversion.hpp"
+#include "ThreadPool.hpp"
+#include "FramePool.hpp"
+#include "FrameQueue.hpp"
+#include "StateSerializer.hpp"
+#include "binaryMessageSpec.hpp"
+#include "RenderMetadataParser.hpp"
+#include "RenderScheduler.hpp"
+#include "InFlightRequests.hpp"
+#include "LatencyHistogram.hpp"
+#include "ClockOffsetEstimator.hpp"
+#include "RenderLog.hpp"
+#include "FrameRing.hpp"
+#include "PoseBuffer.hpp"
 
 class FlightGogglesClient
 {
   public:
 
+    // Called on the dispatch thread with every received frame.
+    typedef std::function<void(const unity_incoming::RenderOutput_t &)> RenderOutputCallback;
+
+    // Per-frame latencies in us, between the stages in FrameTiming_t.
+    struct LatencyHistograms
+    {
+        // Request sent to frame received, i.e. network and rendering.
+        LatencyHistogram roundTrip;
+        // Frame received to metadata parsed.
+        LatencyHistogram parse;
+        // Metadata parsed to images decoded.
+        LatencyHistogram decode;
+        // Images decoded to handed to the consumers, i.e. queueing.
+        LatencyHistogram handoff;
+        // Request sent to handed to the consumers.
+        LatencyHistogram endToEnd;
+    };
+
+    // Sets the next pose and utime in the given state for lockstep rendering.
+    // Returns false once there are no more poses.
+    typedef std::function<bool(unity_outgoing::StateMessage_t &)> PoseSource;
+
     //////////////////
     // VARIABLES
     //////////////////
 
-    // Base status object (which holds camera settings, env settings, etc)
+    // Base status object (which holds camera settings, env settings, etc).
+    // Only write it directly while setting up, before other threads use the
+    // client. Afterwards, go through updateState().
     unity_outgoing::StateMessage_t state;
+    // Guards state between concurrent writers, and spareStates.
+    std::mutex stateMutex;
+    // Immutable copy of state that requestRender() serializes.
+    std::shared_ptr<const unity_outgoing::StateMessage_t> publishedState;
+    // Previously published copies. Once nobody else holds one, the next
+    // publication copies state into it, which reuses its strings and
+    // vectors, so that pose updates do not allocate.
+    std::vector<std::shared_ptr<unity_outgoing::StateMessage_t>> spareStates;
 
     // ZMQ connection parameters
     std::string client_address = "tcp://*";
@@ -52,8 +109,56 @@ class FlightGogglesClient
         context,
         zmqpp::socket_type::subscribe};
 
-    // Temporary buffer for reshaping and casting of received images
-    std::vector<uint8_t> _castedInputBuffer;
+    // If true, handleImageResponse() skips reshaping and returns images that
+    // point directly into the received ZMQ message. Each image keeps the
+    // message alive for as long as it is kept.
+    bool zeroCopyImages = false;
+
+    // If true, decoded images are taken from framePool instead of being
+    // allocated per frame. Buffers are recycled once the consumer releases
+    // its RenderOutput_t.
+    bool poolImages = false;
+    FramePool framePool;
+
+    // Workers for decoding the cameras of one frame in parallel.
+    // Null when decoding serially. See setDecodeThreadCount().
+    std::unique_ptr<ThreadPool> decodePool;
+
+    // If true, requestRender() sends the full state only when something other
+    // than utime and the camera poses changed, and a "PoseUpdate" otherwise.
+    // Requires a renderer that understands "PoseUpdate" messages.
+    bool deltaStateUpdates = false;
+    // Full state is resent at least this often (in utime) in delta mode.
+    int64_t fullStateIntervalUs = 1e6;
+    // Set to make the next request carry the full state.
+    std::atomic<bool> forceFullState {false};
+    // Last state sent in full, and its utime.
+    std::shared_ptr<const unity_outgoing::StateMessage_t> lastFullState;
+    int64_t lastFullStateUtime = 0;
+
+    // In delta mode, send pose-only updates in the fixed layout binary
+    // encoding on the "PoseBinary" topic instead of as JSON. Requires a
+    // renderer that understands "PoseBinary" messages.
+    bool binaryPoseUpdates = false;
+
+    // Reusable writer for outgoing state messages.
+    StateSerializer stateSerializer;
+    std::string binaryPoseBuffer;
+
+    // Reusable reader for incoming frame metadata. Only touched by whichever
+    // thread receives frames.
+    RenderMetadataParser renderMetadataParser;
+    unity_incoming::RenderMetadata_t parsedMetadata;
+    std::vector<const uint8_t *> framePartData;
+    std::vector<size_t> framePartSizes;
+
+    // Log that every sent and received message is appended to while
+    // recording. See startRecording().
+    std::shared_ptr<RenderLogWriter> renderLog;
+
+    // Shared memory ring that every frame handed to consumers is copied into
+    // while publishing. See startFramePublishing().
+    std::shared_ptr<FrameRingWriter> frameRing;
 
     // Keep track of time of last sent/received messages
     int64_t last_uploaded_utime = 0;
@@ -62,6 +167,52 @@ class FlightGogglesClient
     int64_t last_download_debug_utime = 0;
     int64_t u_packet_latency = 0;
     int64_t num_frames = 0;
+    // Filled from the timing of every frame handed to consumers.
+    LatencyHistograms latencyHistograms;
+
+    // If positive, requestRender() also sends a ping this often (in
+    // monotonic us). Requires a renderer that answers "Ping" messages.
+    int64_t pingIntervalUs = 0;
+    int64_t lastPingUtime = 0;
+    int64_t pingSequence = 0;
+    std::string pingBuffer;
+    // Offset of the renderer's clock from getMonotonicTimestamp(), from the
+    // answered pings. Printed with the 1 Hz frame debug output.
+    ClockOffsetEstimator clockOffsetEstimator;
+
+    // Asynchronous receive state. See start().
+    std::thread ioThread;
+    std::thread dispatchThread;
+    std::atomic<bool> ioRunning {false};
+    // Frames travel from the I/O thread to the dispatch thread through this
+    // queue. Policy and capacity take effect on the next start().
+    FrameDropPolicy frameQueuePolicy = FrameDropPolicy::Block;
+    size_t frameQueueCapacity = 4;
+    std::unique_ptr<FrameQueue<unity_incoming::RenderOutput_t>> frameQueue;
+    // How often the I/O thread checks whether it should stop.
+    long ioPollTimeoutMs = 100;
+    std::mutex consumersMutex;
+    std::vector<RenderOutputCallback> renderOutputCallbacks;
+    std::vector<std::promise<unity_incoming::RenderOutput_t>> renderOutputPromises;
+
+    // Callbacks taking longer than this per frame are reported as slow consumers.
+    int64_t slowConsumerThresholdUs = 1e6 / 60;
+    std::atomic<uint64_t> slowConsumerCount {0};
+    int64_t lastSlowConsumerWarningUtime = 0;
+
+    // Sends render requests at state.maxFramerate. See startRenderScheduler().
+    // Set renderScheduler.completionDriven before starting it to only request
+    // a frame once the previous one came back.
+    RenderScheduler renderScheduler;
+
+    // Requests sent but not answered yet. Frames are matched to them by utime.
+    InFlightRequests inFlightRequests;
+
+    // Lockstep rendering state. See startLockstep().
+    std::thread lockstepThread;
+    std::atomic<bool> lockstepRunning {false};
+    // Requests that get no frame within this time are given up on.
+    int64_t lockstepRequestTimeoutUs = 1e6;
 
     ////////////////////////////////
     // FLIGHTGOGGLES SETUP FUNCTIONS
@@ -70,46 +221,221 @@ class FlightGogglesClient
     // Constructor.
     FlightGogglesClient();
 
+    // Stops the I/O thread if it is running.
+    ~FlightGogglesClient();
+
     // Connects to FlightGoggles.
     void initializeConnections();
 
+    // Number of threads used to decode the camera images of a frame,
+    // including the thread calling handleImageResponse(). 1 decodes serially.
+    void setDecodeThreadCount(size_t numThreads);
+
 
     //////////////////////////////////
     // FLIGHTGOGGLES OUTPUT FUNCTIONS
     //////////////////////////////////
 
-    // Set camera pose using ROS coordinates.
+    // Applies update to state and publishes the result for requestRender().
+    // Writers are serialized with each other, but never block the sender,
+    // which always sees either the previous or the new state as a whole.
+    void updateState(const std::function<void(unity_outgoing::StateMessage_t &)> &update);
+
+    // Publishes state as is, e.g. after setting it up directly.
+    void publishState();
+
+    // Latest published state. Null until the first publication.
+    std::shared_ptr<const unity_outgoing::StateMessage_t> getStateSnapshot() const;
+
+    // Set camera pose using ROS coordinates and publish the new state.
     void setCameraPoseUsingROSCoordinates(Eigen::Affine3d ros_pose, int cam_index);
 
-    // Send render request to Unity
-    bool requestRender();
+    // Set camera pose in the given state using ROS coordinates. Meant for use
+    // inside updateState() to change several cameras at once.
+    static void setCameraPoseUsingROSCoordinates(unity_outgoing::StateMessage_t &state,
+                                                 Eigen::Affine3d ros_pose, int cam_index);
+
+    // Same, for a pose given as position and orientation. Converts the
+    // quaternion directly instead of going through a rotation matrix, so the
+    // sign of the stored quaternion follows ros_rotation.
+    static void setCameraPoseUsingROSCoordinates(unity_outgoing::StateMessage_t &state,
+                                                 const Eigen::Vector3d &ros_position,
+                                                 const Eigen::Quaterniond &ros_rotation,
+                                                 int cam_index);
+
+    // Set the poses of all cameras of rig from one NED body pose and publish
+    // the new state. Cheaper than one call per camera for multi camera rigs.
+    void setCameraPosesUsingRig(const CameraRig &rig, const Transform3 &world_T_body);
+
+    // Send render request to Unity using the latest published state. Unless
+    // throttleToMaxFramerate is false, requests whose utime is less than a
+    // frame after the last one are skipped.
+    bool requestRender(bool throttleToMaxFramerate = true);
+
+    // Sends a ping to estimate the renderer's clock offset. Must be called
+    // from the thread that sends render requests, as ZMQ sockets are not
+    // thread safe.
+    void sendPing();
+
+    // Updates the state for a frame due at deadlineUtime, a
+    // getMonotonicTimestamp() time. Returns false to skip the frame, e.g.
+    // when there is no new pose.
+    typedef std::function<bool(int64_t deadlineUtime)> PoseUpdate;
+
+    // Starts renderScheduler at the maxFramerate of the current state. Each
+    // tick calls updatePose, if given, and sends a request unless it returned
+    // false. The scheduler keeps the rate, so the utime throttle of
+    // requestRender() is skipped.
+    void startRenderScheduler(PoseUpdate updatePose = nullptr);
+
+    // Stops renderScheduler.
+    void stopRenderScheduler();
+
+    // Renders poses from nextPose as fast as the renderer allows, keeping up
+    // to maxInFlight requests outstanding. A new request goes out as soon as
+    // a frame for an earlier one comes back. Each frame carries the state it
+    // was requested with in requestState. utime is bumped if nextPose does
+    // not advance it, as frames are matched to requests by utime. Must not
+    // run together with renderScheduler.
+    void startLockstep(size_t maxInFlight, PoseSource nextPose);
+
+    // Stops sending lockstep requests. Frames already requested still arrive.
+    void stopLockstep();
+
+    // Blocks until nextPose ran out and all its frames came back or timed out.
+    void waitForLockstep();
 
     ///////////////////////////////////////////
     // FLIGHTGOGGLES INCOMING MESSAGE HANDLERS
     ///////////////////////////////////////////
 
-    // Ensure that input buffer can handle the incoming message.
-    inline void ensureBufferIsAllocated(unity_incoming::RenderMetadata_t renderMetadata){
-        // Check that buffer size is correct
-        uint64_t requested_buffer_size = renderMetadata.camWidth * renderMetadata.camHeight * 3;
-        // Resize if necessary
-        if (_castedInputBuffer.size() != requested_buffer_size)
-        {
-            _castedInputBuffer.resize(requested_buffer_size);
-        }
-    };
-
     // Blocking call. Returns rendered images and render metadata whenever
-    // it becomes available.
+    // it becomes available. Must not be used while the I/O thread is running.
     unity_incoming::RenderOutput_t handleImageResponse();
 
+    // Parses and decodes an already received frame. receivedUtime is when it
+    // came in, now if 0.
+    unity_incoming::RenderOutput_t decodeImageResponse(
+        const std::shared_ptr<zmqpp::message> &msgHolder, int64_t receivedUtime = 0);
+
+    // Appends every message sent to or received from the renderer from now
+    // on to a new log in directory. Throws std::runtime_error if the log
+    // cannot be created.
+    void startRecording(const std::string &directory);
+
+    // Closes the log.
+    void stopRecording();
+
+    // Copies every camera image handed to consumers from now on, upright and
+    // BGR ordered, into a new shared memory ring of numSlots images, for
+    // FrameRingReaders in other processes. maxImageBytes defaults to the
+    // largest image the current state asks for. Throws std::runtime_error if
+    // the ring cannot be created.
+    void startFramePublishing(const std::string &name, size_t numSlots = 16,
+                              size_t maxImageBytes = 0);
+
+    // Removes the ring. Readers keep what was already published.
+    void stopFramePublishing();
+
+    // Feeds the frames of a recorded log to the registered callbacks and
+    // futures on the calling thread, as fast as possible if speed is 0, else
+    // at speed times the recorded pace. With zeroCopyImages, images point
+    // straight into the mapped log, and keep it mapped. Frames carry the
+    // requestState rebuilt from the recorded requests. Must not be called
+    // while the I/O thread is running. Throws std::runtime_error at a corrupt
+    // record.
+    void replay(const std::shared_ptr<const RenderLogReader> &log, double speed = 1.0);
+
+    // Starts a thread that receives and decodes frames, and a thread that
+    // hands them to registered callbacks and futures.
+    void start();
+
+    // Stops lockstep rendering, the render scheduler and the I/O thread.
+    // Pending futures fail with std::future_error.
+    void stop();
+
+    // Registers a callback for every frame received by the I/O thread.
+    // Callbacks run on the dispatch thread, one frame at a time.
+    void addRenderOutputCallback(RenderOutputCallback callback);
+
+    // Returns a future for the next frame received by the I/O thread.
+    std::future<unity_incoming::RenderOutput_t> getNextRenderOutput();
+
+    // Counters of frames dropped or overwritten between the I/O thread and
+    // the consumers.
+    FrameQueue<unity_incoming::RenderOutput_t>::Stats getFrameQueueStats() const;
+
+    // Flips and color converts a raw image from a zero-copy RenderOutput_t
+    // into a new upright BGR image. Channels defaults to that of rawImage.
+    static cv::Mat finalizeImage(const cv::Mat &rawImage, int channels = 0);
+
+    // Number of channels in a received image part. Throws
+    // std::invalid_argument if the metadata has no such camera, and
+    // std::runtime_error if the part size does not match the metadata.
+    static int getImageChannels(const unity_incoming::RenderMetadata_t &renderMetadata,
+                                int cam_index, size_t partSize);
+
     ///////////////////
     // HELPER FUNCTIONS
     ///////////////////
+
+    // Body of the I/O thread.
+    void ioLoop();
+
+    // Body of the dispatch thread.
+    void dispatchLoop();
+
+    // Body of the lockstep thread.
+    void lockstepLoop(size_t maxInFlight, PoseSource nextPose);
+
+    // Waits for fewer than limit requests to be pending, giving up on those
+    // older than lockstepRequestTimeoutUs. Returns false if lockstep stopped.
+    bool waitForLockstepSlot(size_t limit);
+
+    // Decodes a frame from its message parts. If zeroCopyImages is set,
+    // images point into the parts and hold a reference to owner, which must
+    // keep them alive and writable. The frame is
+    // matched against requests. Throws std::invalid_argument if the metadata
+    // does not have a channel count for every camera.
+    unity_incoming::RenderOutput_t decodeFrameParts(
+        const uint8_t *const *partData, const size_t *partSizes, size_t numParts,
+        const std::shared_ptr<const void> &owner, int64_t receivedUtime,
+        InFlightRequests &requests);
+
+    // Copies the images of output into frameRing if publishing.
+    void publishFrame(const unity_incoming::RenderOutput_t &output);
+
+    // Appends msg to renderLog if recording. Stops recording if that fails.
+    void recordMessage(RenderLogDirection direction, int64_t timestamp,
+                       const zmqpp::message &msg);
+
+    // Feeds a received pong to clockOffsetEstimator. Returns false if msg is
+    // not a pong.
+    bool handlePong(const zmqpp::message &msg, int64_t receivedUtime);
+
+    // Hands a frame to all registered callbacks and futures.
+    void dispatchRenderOutput(const unity_incoming::RenderOutput_t &output);
+
+    // Adds the stage latencies of a frame to latencyHistograms.
+    void recordFrameLatency(const unity_incoming::FrameTiming_t &timing);
+
+    // Clears latencyHistograms, e.g. after warming up.
+    void resetLatencyHistograms();
+
+    // Time since the epoch in us, used as the utime of render requests. It
+    // is read once from the system clock and then advanced by the monotonic
+    // clock, so that clock steps cannot reorder requests.
     static inline int64_t getTimestamp(){
-        int64_t time = std::chrono::high_resolution_clock::now().time_since_epoch() /
-                    std::chrono::microseconds(1);
-        return time;
+        static const int64_t epochOffset =
+            std::chrono::system_clock::now().time_since_epoch() / std::chrono::microseconds(1) -
+            getMonotonicTimestamp();
+        return epochOffset + getMonotonicTimestamp();
+    };
+
+    // Monotonic time in us, for scheduling and latency measurements.
+    static inline int64_t getMonotonicTimestamp(){
+        return std::chrono::steady_clock::now().time_since_epoch() /
+               std::chrono::microseconds(1);
     };
 };
 
@@ -0,0 +1,81 @@
+/**
+ * @file   FramePool.cpp
+ * @brief  Pool of recycled image buffers for received frames.
+ */
+
+#include "FramePool.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+FramePool::FramePool(size_t maxFramesPerShape)
+    : maxFramesPerShape(maxFramesPerShape)
+{
+}
+
+size_t FramePool::frameBytes(const cv::Mat &frame)
+{
+    return frame.total() * frame.elemSize();
+}
+
+bool FramePool::isFree(const cv::Mat &frame)
+{
+    // Consumers release their references from other threads, so read the
+    // reference count atomically.
+    return CV_XADD(&frame.u->refcount, 0) == 1;
+}
+
+cv::Mat FramePool::acquire(int width, int height, int channels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<cv::Mat> &bucket = buckets[ShapeKey(width, height, channels)];
+
+    for (const cv::Mat &frame : bucket)
+    {
+        if (isFree(frame))
+        {
+            stats.hits++;
+            return frame;
+        }
+    }
+
+    stats.misses++;
+    cv::Mat frame = cv::Mat(height, width, CV_MAKETYPE(CV_8U, channels));
+    if (bucket.size() < maxFramesPerShape)
+    {
+        // Touch every page now so that the first frame decoded into this
+        // buffer does not pay for the page faults.
+        memset(frame.data, 0, frameBytes(frame));
+        bucket.push_back(frame);
+        stats.bytesAllocated += frameBytes(frame);
+        stats.peakBytesAllocated = std::max(stats.peakBytesAllocated, stats.bytesAllocated);
+    }
+    return frame;
+}
+
+FramePool::Stats FramePool::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void FramePool::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &entry : buckets)
+    {
+        std::vector<cv::Mat> &bucket = entry.second;
+        for (size_t i = 0; i < bucket.size();)
+        {
+            if (isFree(bucket[i]))
+            {
+                stats.bytesAllocated -= frameBytes(bucket[i]);
+                bucket.erase(bucket.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef FLIGHTGOGGLESFRAMEPOOL_H
+#define FLIGHTGOGGLESFRAMEPOOL_H
+/**
+ * @file   FramePool.hpp
+ * @brief  Pool of recycled image buffers for received frames.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+class FramePool
+{
+  public:
+    struct Stats
+    {
+        // Frames handed out from an existing buffer.
+        uint64_t hits = 0;
+        // Frames that needed a new allocation.
+        uint64_t misses = 0;
+        // Bytes currently owned by the pool, and the most it ever owned.
+        size_t bytesAllocated = 0;
+        size_t peakBytesAllocated = 0;
+    };
+
+    // Keeps at most maxFramesPerShape buffers for every image shape. Once
+    // that many are in use, extra frames are allocated outside the pool.
+    explicit FramePool(size_t maxFramesPerShape = 8);
+
+    // Returns an 8-bit image of the given shape. The buffer goes back to the
+    // pool once every cv::Mat referencing it has been released.
+    cv::Mat acquire(int width, int height, int channels);
+
+    Stats getStats() const;
+
+    // Frees all buffers that are not currently in use.
+    void clear();
+
+  private:
+    // (width, height, channels)
+    typedef std::tuple<int, int, int> ShapeKey;
+
+    static size_t frameBytes(const cv::Mat &frame);
+    // True if the pool holds the only reference to the frame.
+    static bool isFree(const cv::Mat &frame);
+
+    size_t maxFramesPerShape;
+    std::map<ShapeKey, std::vector<cv::Mat>> buckets;
+    Stats stats;
+    mutable std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef FLIGHTGOGGLESFRAMEQUEUE_H
+#define FLIGHTGOGGLESFRAMEQUEUE_H
+/**
+ * @file   FrameQueue.hpp
+ * @brief  Bounded lock-free queue for handing received frames from the I/O
+ * thread to consumers, with a configurable policy for when it is full.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// What push() does when the queue is full.
+enum class FrameDropPolicy
+{
+    // Discard everything still queued so that consumers only see the newest frame.
+    KeepLatest,
+    // Discard the oldest queued frame to make room.
+    DropOldest,
+    // Wait for the consumer to make room. Backpressure ends up in ZMQ.
+    Block
+};
+
+/**
+ * @brief Bounded queue based on Dmitry Vyukov's sequence-numbered ring.
+ *
+ * Safe for any number of producers and consumers; the client uses one of
+ * each. Producers also act as consumers when they evict frames, which the
+ * per-slot sequence numbers make safe without locks.
+ */
+template <typename T>
+class FrameQueue
+{
+  public:
+    struct Stats
+    {
+        uint64_t pushed = 0;
+        uint64_t popped = 0;
+        // Frames evicted by DropOldest.
+        uint64_t dropped = 0;
+        // Frames replaced by a newer one under KeepLatest.
+        uint64_t overwritten = 0;
+        // Pushes that had to wait under Block.
+        uint64_t blockedPushes = 0;
+    };
+
+    // Capacity is rounded up to a power of two, and at least 2: with a
+    // single slot, its sequence number cannot tell full from empty.
+    FrameQueue(size_t capacity, FrameDropPolicy policy)
+        : policy(policy)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        mask = size - 1;
+        slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Adds an item according to the drop policy. Only returns false if the
+    // queue was closed while a Block push was waiting.
+    bool push(T item)
+    {
+        pushedCount.fetch_add(1, std::memory_order_relaxed);
+
+        if (policy == FrameDropPolicy::KeepLatest)
+        {
+            T stale;
+            while (tryDequeue(stale))
+            {
+                overwrittenCount.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        bool waited = false;
+        for (int attempt = 0; !tryEnqueue(item); attempt++)
+        {
+            if (policy == FrameDropPolicy::Block)
+            {
+                if (closed.load(std::memory_order_acquire))
+                {
+                    return false;
+                }
+                if (!waited)
+                {
+                    blockedCount.fetch_add(1, std::memory_order_relaxed);
+                    waited = true;
+                }
+                if (attempt < kSpinAttempts)
+                {
+                    std::this_thread::yield();
+                }
+                else if (waitUnless(waitingProducers, slotFreed, nullptr,
+                                    [&]() { return tryEnqueue(item); }))
+                {
+                    break;
+                }
+                continue;
+            }
+
+            // Make room by evicting the oldest frame.
+            T oldest;
+            if (tryDequeue(oldest))
+            {
+                if (policy == FrameDropPolicy::KeepLatest)
+                {
+                    overwrittenCount.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    droppedCount.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        notifyWaiters(waitingConsumers, itemPushed);
+        return true;
+    }
+
+    // Removes the oldest item without waiting.
+    bool tryPop(T &item)
+    {
+        if (!tryDequeue(item))
+        {
+            return false;
+        }
+        poppedCount.fetch_add(1, std::memory_order_relaxed);
+        notifyWaiters(waitingProducers, slotFreed);
+        return true;
+    }
+
+    // Waits up to timeoutUs for an item. Spins briefly, then sleeps until a
+    // push or close() wakes it up.
+    bool pop(T &item, int64_t timeoutUs)
+    {
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+        for (int attempt = 0;; attempt++)
+        {
+            if (tryPop(item))
+            {
+                return true;
+            }
+            if (closed.load(std::memory_order_acquire) ||
+                std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            if (attempt < kSpinAttempts)
+            {
+                std::this_thread::yield();
+            }
+            // tryPop() would wake producers with the wait mutex held, so
+            // the item is only accounted for once the mutex is released.
+            else if (waitUnless(waitingConsumers, itemPushed, &deadline,
+                                [&]() { return tryDequeue(item); }))
+            {
+                poppedCount.fetch_add(1, std::memory_order_relaxed);
+                notifyWaiters(waitingProducers, slotFreed);
+                return true;
+            }
+        }
+    }
+
+    // Wakes up waiting producers and consumers for shutdown.
+    void close()
+    {
+        closed.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(waitMutex);
+        itemPushed.notify_all();
+        slotFreed.notify_all();
+    }
+
+    // Approximate number of queued items.
+    size_t size() const
+    {
+        size_t enqueued = enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeued = dequeuePos.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    FrameDropPolicy getPolicy() const { return policy; }
+
+    Stats getStats() const
+    {
+        Stats stats;
+        stats.pushed = pushedCount.load(std::memory_order_relaxed);
+        stats.popped = poppedCount.load(std::memory_order_relaxed);
+        stats.dropped = droppedCount.load(std::memory_order_relaxed);
+        stats.overwritten = overwrittenCount.load(std::memory_order_relaxed);
+        stats.blockedPushes = blockedCount.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+  private:
+    // Yields before a waiting push or pop goes to sleep. Frames usually come
+    // and go within that window, which keeps the mutex off the fast path.
+    static const int kSpinAttempts = 64;
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    bool tryEnqueue(T &item)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true)
+        {
+            slot = &slots[pos & mask];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Full.
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::move(item);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryDequeue(T &item)
+    {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true)
+        {
+            slot = &slots[pos & mask];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Empty.
+                return false;
+            }
+            else
+            {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(slot->value);
+        // Do not keep the frame's buffers alive in the ring.
+        slot->value = T();
+        slot->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Sleeps on condition unless ready() succeeds, or until deadline if it is
+    // set. Returns whether ready() succeeded. ready() runs with waitMutex
+    // held, so it must not notify. The waiter registers itself
+    // before its last check, and notifiers look for waiters after publishing
+    // their change. With a full fence on both sides, either the check sees
+    // the change or the notifier sees the waiter, so no wakeup is lost.
+    template <typename Ready>
+    bool waitUnless(std::atomic<int> &waiting, std::condition_variable &condition,
+                    const std::chrono::steady_clock::time_point *deadline, Ready ready)
+    {
+        std::unique_lock<std::mutex> lock(waitMutex);
+        waiting.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool succeeded = ready();
+        if (!succeeded && !closed.load(std::memory_order_acquire))
+        {
+            if (deadline)
+            {
+                condition.wait_until(lock, *deadline);
+            }
+            else
+            {
+                condition.wait(lock);
+            }
+        }
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+        return succeeded;
+    }
+
+    // Wakes a waiter, if there are any. Costs a fence but no lock otherwise.
+    void notifyWaiters(std::atomic<int> &waiting, std::condition_variable &condition)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(waitMutex);
+            condition.notify_one();
+        }
+    }
+
+    const FrameDropPolicy policy;
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    // Keep producer and consumer positions on separate cache lines. Padding
+    // is used over alignas since C++11 new ignores extended alignment.
+    char padding0[64];
+    std::atomic<size_t> enqueuePos {0};
+    char padding1[64];
+    std::atomic<size_t> dequeuePos {0};
+    char padding2[64];
+    std::atomic<bool> closed {false};
+
+    // Sleeping consumers and Block producers.
+    std::mutex waitMutex;
+    std::condition_variable itemPushed;
+    std::condition_variable slotFreed;
+    std::atomic<int> waitingConsumers {0};
+    std::atomic<int> waitingProducers {0};
+
+    std::atomic<uint64_t> pushedCount {0};
+    std::atomic<uint64_t> poppedCount {0};
+    std::atomic<uint64_t> droppedCount {0};
+    std::atomic<uint64_t> overwrittenCount {0};
+    std::atomic<uint64_t> blockedCount {0};
+};
+
+#endif
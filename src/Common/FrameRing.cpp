@@ -0,0 +1,346 @@
+/**
+ * @file   FrameRing.cpp
+ * @brief  Shared memory frame ring writer and reader.
+ */
+
+#include "FrameRing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char kRingMagic[4] = {'F', 'G', 'F', 'R'};
+const uint16_t kRingVersion = 1;
+
+const size_t kRingHeaderSize = 64;
+const size_t kSlotHeaderSize = 128;
+const size_t kCameraIDSize = 64;
+
+struct RingHeader
+{
+    char magic[4];
+    uint16_t version;
+    std::atomic<uint8_t> closed;
+    uint8_t reserved;
+    uint32_t numSlots;
+    uint32_t reserved2;
+    uint64_t slotStride;
+    uint64_t maxImageBytes;
+    std::atomic<uint64_t> published;
+    uint8_t reserved3[24];
+};
+
+struct SlotHeader
+{
+    std::atomic<uint64_t> sequence;
+    int64_t utime;
+    int64_t publishedUtime;
+    double camDepthScale;
+    uint64_t dataSize;
+    uint32_t cameraIndex;
+    uint32_t numCameras;
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    uint8_t isCompressed;
+    uint8_t reserved[3];
+    char cameraID[kCameraIDSize];
+};
+
+static_assert(sizeof(RingHeader) == kRingHeaderSize, "unexpected padding");
+static_assert(sizeof(SlotHeader) == kSlotHeaderSize, "unexpected padding");
+// Other processes see the counters as plain memory, so they must not hide
+// a lock.
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_CHAR_LOCK_FREE == 2,
+              "frame ring needs lock-free atomics");
+
+// Sequence of a slot once image n is complete in it.
+uint64_t completeSequence(uint64_t n)
+{
+    return 2 * n + 2;
+}
+
+int64_t monotonicUs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+// shm_open() wants names starting with a slash.
+std::string shmName(const std::string &name)
+{
+    return !name.empty() && name[0] == '/' ? name : "/" + name;
+}
+
+}
+
+///////////////////////
+// Writer
+///////////////////////
+
+FrameRingWriter::FrameRingWriter(const std::string &name, size_t numSlots, size_t maxImageBytes)
+    : name(shmName(name)), numSlots(numSlots), maxImageBytes(maxImageBytes)
+{
+    if (numSlots == 0 || numSlots > UINT32_MAX)
+    {
+        throw std::invalid_argument("Frame ring needs between 1 and 2^32 - 1 slots");
+    }
+    // Keep every slot cache line aligned.
+    slotStride = (kSlotHeaderSize + maxImageBytes + 63) & ~size_t(63);
+    memorySize = kRingHeaderSize + numSlots * slotStride;
+
+    // Readers of a previous ring keep their mapping of the old object.
+    shm_unlink(this->name.c_str());
+    int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot create " + this->name + ": " + strerror(errno));
+    }
+    void *data = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(memorySize)) == 0)
+    {
+        data = mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int error = errno;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        shm_unlink(this->name.c_str());
+        throw std::runtime_error("Cannot map " + this->name + ": " + strerror(error));
+    }
+    memory = static_cast<uint8_t *>(data);
+
+    // The object starts zero filled, i.e. with no published images.
+    RingHeader *header = reinterpret_cast<RingHeader *>(memory);
+    header->version = kRingVersion;
+    header->numSlots = static_cast<uint32_t>(numSlots);
+    header->slotStride = slotStride;
+    header->maxImageBytes = maxImageBytes;
+    // Readers check the magic first, so it goes in last.
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, kRingMagic, sizeof(header->magic));
+}
+
+FrameRingWriter::~FrameRingWriter()
+{
+    reinterpret_cast<RingHeader *>(memory)->closed.store(1, std::memory_order_release);
+    munmap(memory, memorySize);
+    shm_unlink(name.c_str());
+}
+
+uint8_t *FrameRingWriter::beginImage(size_t dataSize)
+{
+    if (dataSize > maxImageBytes)
+    {
+        stats.imagesSkipped++;
+        return nullptr;
+    }
+    RingHeader *header = reinterpret_cast<RingHeader *>(memory);
+    pendingSequence = header->published.load(std::memory_order_relaxed);
+    pendingSize = dataSize;
+    pending = true;
+
+    uint8_t *slot = memory + kRingHeaderSize + (pendingSequence % numSlots) * slotStride;
+    SlotHeader *slotHeader = reinterpret_cast<SlotHeader *>(slot);
+    // Readers of the image that was in this slot now see it change.
+    slotHeader->sequence.store(2 * pendingSequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return slot + kSlotHeaderSize;
+}
+
+void FrameRingWriter::publishImage(const FrameRingImage &image)
+{
+    if (!pending)
+    {
+        throw std::logic_error("publishImage() without beginImage()");
+    }
+    pending = false;
+
+    uint8_t *slot = memory + kRingHeaderSize + (pendingSequence % numSlots) * slotStride;
+    SlotHeader *slotHeader = reinterpret_cast<SlotHeader *>(slot);
+    slotHeader->utime = image.utime;
+    slotHeader->publishedUtime = monotonicUs();
+    slotHeader->camDepthScale = image.camDepthScale;
+    slotHeader->dataSize = pendingSize;
+    slotHeader->cameraIndex = image.cameraIndex;
+    slotHeader->numCameras = image.numCameras;
+    slotHeader->width = image.width;
+    slotHeader->height = image.height;
+    slotHeader->channels = image.channels;
+    slotHeader->isCompressed = image.isCompressed;
+    memset(slotHeader->cameraID, 0, kCameraIDSize);
+    memcpy(slotHeader->cameraID, image.cameraID.data(),
+           std::min(image.cameraID.size(), kCameraIDSize - 1));
+
+    slotHeader->sequence.store(completeSequence(pendingSequence), std::memory_order_release);
+    reinterpret_cast<RingHeader *>(memory)->published.store(pendingSequence + 1,
+                                                            std::memory_order_release);
+    stats.imagesPublished++;
+}
+
+///////////////////////
+// Reader
+///////////////////////
+
+FrameRingReader::FrameRingReader(const std::string &name)
+{
+    std::string path = shmName(name);
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open " + path + ": " + strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(kRingHeaderSize))
+    {
+        close(fd);
+        throw std::runtime_error(path + " is not a frame ring");
+    }
+    memorySize = static_cast<size_t>(info.st_size);
+    void *data = mmap(nullptr, memorySize, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("Cannot map " + path + ": " + strerror(error));
+    }
+    memory = static_cast<const uint8_t *>(data);
+
+    const RingHeader *header = reinterpret_cast<const RingHeader *>(memory);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (memcmp(header->magic, kRingMagic, sizeof(header->magic)) != 0 ||
+        header->version != kRingVersion || header->numSlots == 0 ||
+        header->slotStride < kSlotHeaderSize + header->maxImageBytes ||
+        (memorySize - kRingHeaderSize) / header->slotStride < header->numSlots)
+    {
+        munmap(const_cast<uint8_t *>(memory), memorySize);
+        throw std::runtime_error(path + " is not a frame ring or has an unsupported version");
+    }
+    numSlots = header->numSlots;
+    slotStride = header->slotStride;
+    maxImageBytes = header->maxImageBytes;
+    nextSequence = header->published.load(std::memory_order_acquire);
+}
+
+FrameRingReader::~FrameRingReader()
+{
+    munmap(const_cast<uint8_t *>(memory), memorySize);
+}
+
+bool FrameRingReader::nextSlot(FrameRingImage &image, const uint8_t *&data)
+{
+    const RingHeader *header = reinterpret_cast<const RingHeader *>(memory);
+    while (true)
+    {
+        uint64_t published = header->published.load(std::memory_order_acquire);
+        if (nextSequence >= published)
+        {
+            return false;
+        }
+        // Everything older than a full lap has been overwritten.
+        if (published - nextSequence > numSlots)
+        {
+            stats.imagesMissed += published - numSlots - nextSequence;
+            nextSequence = published - numSlots;
+        }
+
+        const uint8_t *slot = memory + kRingHeaderSize + (nextSequence % numSlots) * slotStride;
+        const SlotHeader *slotHeader = reinterpret_cast<const SlotHeader *>(slot);
+        uint64_t sequence = nextSequence++;
+        if (slotHeader->sequence.load(std::memory_order_acquire) != completeSequence(sequence) ||
+            slotHeader->dataSize > maxImageBytes)
+        {
+            // The writer has lapped us since reading published.
+            stats.imagesMissed++;
+            continue;
+        }
+
+        image.sequence = sequence;
+        image.utime = slotHeader->utime;
+        image.publishedUtime = slotHeader->publishedUtime;
+        image.camDepthScale = slotHeader->camDepthScale;
+        image.isCompressed = slotHeader->isCompressed != 0;
+        image.cameraIndex = slotHeader->cameraIndex;
+        image.numCameras = slotHeader->numCameras;
+        image.width = slotHeader->width;
+        image.height = slotHeader->height;
+        image.channels = slotHeader->channels;
+        image.cameraID.assign(slotHeader->cameraID,
+                              strnlen(slotHeader->cameraID, kCameraIDSize));
+        image.dataSize = static_cast<size_t>(slotHeader->dataSize);
+        data = slot + kSlotHeaderSize;
+        return true;
+    }
+}
+
+bool FrameRingReader::isStillValid(const FrameRingImage &image) const
+{
+    const uint8_t *slot = memory + kRingHeaderSize + (image.sequence % numSlots) * slotStride;
+    const SlotHeader *slotHeader = reinterpret_cast<const SlotHeader *>(slot);
+    // Orders the reads of the image before the check.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slotHeader->sequence.load(std::memory_order_relaxed) ==
+           completeSequence(image.sequence);
+}
+
+bool FrameRingReader::peekNext(FrameRingImage &image, const uint8_t *&data)
+{
+    if (!nextSlot(image, data))
+    {
+        return false;
+    }
+    stats.imagesRead++;
+    return true;
+}
+
+bool FrameRingReader::readNext(FrameRingImage &image, std::vector<uint8_t> &data)
+{
+    const uint8_t *slotData;
+    while (nextSlot(image, slotData))
+    {
+        data.resize(image.dataSize);
+        memcpy(data.data(), slotData, image.dataSize);
+        if (isStillValid(image))
+        {
+            stats.imagesRead++;
+            return true;
+        }
+        stats.imagesMissed++;
+    }
+    return false;
+}
+
+void FrameRingReader::skipToLatest()
+{
+    uint64_t published =
+        reinterpret_cast<const RingHeader *>(memory)->published.load(std::memory_order_acquire);
+    if (published > nextSequence + 1)
+    {
+        nextSequence = published - 1;
+    }
+}
+
+uint64_t FrameRingReader::available() const
+{
+    uint64_t published =
+        reinterpret_cast<const RingHeader *>(memory)->published.load(std::memory_order_acquire);
+    return published - nextSequence;
+}
+
+bool FrameRingReader::isWriterClosed() const
+{
+    const RingHeader *header = reinterpret_cast<const RingHeader *>(memory);
+    return header->closed.load(std::memory_order_acquire) != 0;
+}
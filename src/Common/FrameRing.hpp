@@ -0,0 +1,186 @@
+#ifndef FLIGHTGOGGLESFRAMERING_H
+#define FLIGHTGOGGLESFRAMERING_H
+/**
+ * @file   FrameRing.hpp
+ * @brief  Ring of camera images in POSIX shared memory, written by the client
+ * and read without locks by any number of local processes.
+ *
+ * Only depends on the C++ standard library and POSIX, so that readers can
+ * link against it without zmq or OpenCV.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * The shared memory object holds a header followed by numSlots slots. Fields
+ * are in host byte order, readers have to run on the same machine.
+ *
+ *   offset  size  field
+ *   0       4     magic, the characters "FGFR"
+ *   4       2     uint16 version
+ *   6       1     uint8 set once the writer has closed the ring
+ *   7       1     reserved
+ *   8       4     uint32 number of slots
+ *   12      4     reserved
+ *   16      8     uint64 bytes from one slot to the next
+ *   24      8     uint64 largest image a slot holds
+ *   32      8     uint64 number of images published so far
+ *   40      24    reserved
+ *   64            slots
+ *
+ * Slot:
+ *
+ *   0       8     uint64 sequence, see below
+ *   8       8     int64 utime of the frame
+ *   16      8     int64 monotonic time the image was published, in us
+ *   24      8     double camDepthScale
+ *   32      8     uint64 image size in bytes
+ *   40      4     uint32 index of the camera in the frame
+ *   44      4     uint32 number of cameras in the frame
+ *   48      4     int32 width
+ *   52      4     int32 height
+ *   56      4     int32 channels
+ *   60      1     uint8 isCompressed
+ *   61      3     reserved
+ *   64      64    camera ID, NUL terminated
+ *   128           image, upright and BGR ordered, rows tightly packed
+ *
+ * Image n (counting from 0) goes into slot n % numSlots. While it is being
+ * written, the slot's sequence is 2n + 1, and once it is complete 2n + 2. A
+ * reader copies the slot and then checks that the sequence did not change in
+ * the meantime; if it did, the image was overwritten and is skipped.
+ */
+
+// One image in the ring, without its pixels.
+struct FrameRingImage
+{
+    // Number of the image since the ring was created.
+    uint64_t sequence = 0;
+    int64_t utime = 0;
+    // Monotonic time at which the image was published, comparable with
+    // std::chrono::steady_clock in other processes on the same machine.
+    int64_t publishedUtime = 0;
+    double camDepthScale = 0;
+    bool isCompressed = false;
+    uint32_t cameraIndex = 0;
+    uint32_t numCameras = 0;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    // Truncated to 63 characters.
+    std::string cameraID;
+    size_t dataSize = 0;
+};
+
+class FrameRingWriter
+{
+  public:
+    struct Stats
+    {
+        uint64_t imagesPublished = 0;
+        // Images larger than a slot.
+        uint64_t imagesSkipped = 0;
+    };
+
+    // Creates the shared memory object name (e.g. "/flightgoggles"),
+    // replacing an existing one. Throws std::runtime_error if it cannot be
+    // created.
+    FrameRingWriter(const std::string &name, size_t numSlots, size_t maxImageBytes);
+
+    // Marks the ring as closed and removes its name. Readers that have it
+    // open can still read what was published.
+    ~FrameRingWriter();
+
+    FrameRingWriter(const FrameRingWriter &) = delete;
+    FrameRingWriter &operator=(const FrameRingWriter &) = delete;
+
+    // Claims the next slot for an image of dataSize bytes and returns where
+    // to write it, or nullptr if the image does not fit. Every successful
+    // call has to be followed by publishImage(). Only one thread may write
+    // at a time.
+    uint8_t *beginImage(size_t dataSize);
+
+    // Publishes the image claimed by beginImage(). Its sequence and
+    // publishedUtime are filled in here.
+    void publishImage(const FrameRingImage &image);
+
+    Stats getStats() const { return stats; }
+
+    const std::string &getName() const { return name; }
+
+  private:
+    std::string name;
+    uint8_t *memory = nullptr;
+    size_t memorySize = 0;
+    size_t numSlots;
+    size_t slotStride;
+    size_t maxImageBytes;
+    // Image being written, between beginImage() and publishImage().
+    uint64_t pendingSequence = 0;
+    size_t pendingSize = 0;
+    bool pending = false;
+    Stats stats;
+};
+
+class FrameRingReader
+{
+  public:
+    struct Stats
+    {
+        uint64_t imagesRead = 0;
+        // Images overwritten before this reader got to them.
+        uint64_t imagesMissed = 0;
+    };
+
+    // Maps the ring written under name read-only. Reading starts with the
+    // next image published. Throws std::runtime_error if the ring does not
+    // exist or has a bad header.
+    explicit FrameRingReader(const std::string &name);
+
+    ~FrameRingReader();
+
+    FrameRingReader(const FrameRingReader &) = delete;
+    FrameRingReader &operator=(const FrameRingReader &) = delete;
+
+    // Copies the next unread image into image and data. Returns false if no
+    // new image has been published. Images that were overwritten before they
+    // could be copied are skipped.
+    bool readNext(FrameRingImage &image, std::vector<uint8_t> &data);
+
+    // Like readNext(), but data points straight into shared memory. The
+    // writer may overwrite it at any time, so once done with it, call
+    // isStillValid(image) to check that what was read was intact.
+    bool peekNext(FrameRingImage &image, const uint8_t *&data);
+    bool isStillValid(const FrameRingImage &image) const;
+
+    // Skips all images but the newest one.
+    void skipToLatest();
+
+    // Number of published images not read yet, including ones that have
+    // already been overwritten.
+    uint64_t available() const;
+
+    // True once the writer has gone away. Images it published can still be
+    // read.
+    bool isWriterClosed() const;
+
+    Stats getStats() const { return stats; }
+
+  private:
+    // Reads the header of the next image into image. Returns false if there
+    // is none, skipping overwritten ones.
+    bool nextSlot(FrameRingImage &image, const uint8_t *&data);
+
+    const uint8_t *memory = nullptr;
+    size_t memorySize = 0;
+    size_t numSlots = 0;
+    size_t slotStride = 0;
+    size_t maxImageBytes = 0;
+    uint64_t nextSequence = 0;
+    Stats stats;
+};
+
+#endif
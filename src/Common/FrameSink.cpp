@@ -0,0 +1,346 @@
+/**
+ * @file   FrameSink.cpp
+ * @brief  Asynchronous writer of rendered frames.
+ */
+
+#include "FrameSink.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include "FlightGogglesClient.hpp"
+
+namespace
+{
+
+int64_t monotonicUs()
+{
+    return std::chrono::steady_clock::now().time_since_epoch() / std::chrono::microseconds(1);
+}
+
+const char *extension(FrameSinkFormat format)
+{
+    switch (format)
+    {
+    case FrameSinkFormat::Png:
+        return ".png";
+    case FrameSinkFormat::Raw:
+        return ".raw";
+    case FrameSinkFormat::Pgm16:
+        return ".pgm";
+    }
+    return "";
+}
+
+// Frames answering one of our requests say which cameras are depth cameras.
+// Otherwise single channel images are assumed to be depth.
+bool isDepthCamera(const unity_incoming::RenderOutput_t &renderOutput, size_t cam_index)
+{
+    const std::string &cameraID = renderOutput.renderMetadata.cameraIDs[cam_index];
+    if (renderOutput.requestState)
+    {
+        for (const unity_outgoing::Camera_t &cam : renderOutput.requestState->cameras)
+        {
+            if (cam.ID == cameraID)
+            {
+                return cam.isDepth;
+            }
+        }
+    }
+    const std::vector<int> &channels = renderOutput.renderMetadata.channels;
+    if (cam_index < channels.size())
+    {
+        return channels[cam_index] == 1;
+    }
+    return renderOutput.images[cam_index].channels() == 1;
+}
+
+}
+
+FrameSink::FrameSink(const Settings &settings)
+    : settings(settings), startUs(monotonicUs()), workers(std::max<size_t>(1, settings.numThreads))
+{
+    const std::string &directory = settings.directory;
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        throw std::runtime_error("Cannot create " + directory + ": " + strerror(errno));
+    }
+    directoryFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directoryFd < 0)
+    {
+        throw std::runtime_error("Cannot open " + directory + ": " + strerror(errno));
+    }
+
+    std::string path = directory + "/frames.csv";
+    frameList = fopen(path.c_str(), "w");
+    if (!frameList)
+    {
+        close(directoryFd);
+        throw std::runtime_error("Cannot create " + path + ": " + strerror(errno));
+    }
+    fprintf(frameList, "utime,cameraID,file,width,height,channels,bytesPerSample\n");
+}
+
+FrameSink::~FrameSink()
+{
+    flush();
+    fclose(frameList);
+    close(directoryFd);
+}
+
+std::string FrameSink::fileName(int64_t utime, const std::string &cameraID,
+                                FrameSinkFormat format)
+{
+    std::string name = std::to_string(utime) + "_" + cameraID + extension(format);
+    // Camera IDs are free form, keep them from escaping the directory.
+    for (char &c : name)
+    {
+        if (c == '/')
+        {
+            c = '_';
+        }
+    }
+    return name;
+}
+
+bool FrameSink::submit(const unity_incoming::RenderOutput_t &renderOutput)
+{
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        if (stats.queueDepth >= settings.maxQueuedFrames)
+        {
+            stats.framesDropped++;
+            return false;
+        }
+        stats.queueDepth++;
+        stats.peakQueueDepth = std::max(stats.peakQueueDepth, stats.queueDepth);
+    }
+
+    workers.enqueue([this, renderOutput]() {
+        writeFrame(renderOutput);
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.queueDepth--;
+        if (stats.queueDepth == 0)
+        {
+            queueDrained.notify_all();
+        }
+    });
+    return true;
+}
+
+void FrameSink::flush()
+{
+    {
+        std::unique_lock<std::mutex> lock(statsMutex);
+        queueDrained.wait(lock, [this]() { return stats.queueDepth == 0; });
+    }
+    {
+        std::lock_guard<std::mutex> lock(frameListMutex);
+        fflush(frameList);
+    }
+    syncFiles(true);
+}
+
+FrameSink::Stats FrameSink::getStats() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    Stats result = stats;
+    int64_t elapsedUs = monotonicUs() - startUs;
+    result.megabytesPerSecond = elapsedUs > 0 ? stats.bytesWritten / double(elapsedUs) : 0;
+    return result;
+}
+
+void FrameSink::writeFrame(const unity_incoming::RenderOutput_t &renderOutput)
+{
+    const unity_incoming::RenderMetadata_t &metadata = renderOutput.renderMetadata;
+    std::vector<uint8_t> buffer;
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    bool failed = false;
+
+    for (size_t i = 0; i < renderOutput.images.size() && i < metadata.cameraIDs.size(); i++)
+    {
+        try
+        {
+            cv::Mat image = renderOutput.images[i];
+            if (renderOutput.imagesAreRaw)
+            {
+                int channels = i < metadata.channels.size() ? metadata.channels[i] : 0;
+                image = FlightGogglesClient::finalizeImage(image, channels);
+            }
+            FrameSinkFormat format =
+                isDepthCamera(renderOutput, i) ? settings.depthFormat : settings.colorFormat;
+            size_t bytesPerSample = encode(image, format, buffer);
+
+            std::string name = fileName(metadata.utime, metadata.cameraIDs[i], format);
+            int fd = writeFile(settings.directory + "/" + name, buffer);
+            finishFile(fd);
+            files++;
+            bytes += buffer.size();
+
+            std::lock_guard<std::mutex> lock(frameListMutex);
+            fprintf(frameList, "%lld,%s,%s,%d,%d,%d,%zu\n",
+                    static_cast<long long>(metadata.utime), metadata.cameraIDs[i].c_str(),
+                    name.c_str(), image.cols, image.rows, image.channels(), bytesPerSample);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Cannot save " << metadata.cameraIDs[i] << " of frame "
+                      << metadata.utime << ": " << e.what() << std::endl;
+            failed = true;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.filesWritten += files;
+    stats.bytesWritten += bytes;
+    if (failed)
+    {
+        stats.framesFailed++;
+    }
+    else
+    {
+        stats.framesWritten++;
+    }
+}
+
+size_t FrameSink::encode(const cv::Mat &image, FrameSinkFormat format,
+                         std::vector<uint8_t> &buffer) const
+{
+    bool wide = image.depth() == CV_16U;
+    if (image.depth() != CV_8U && !wide)
+    {
+        throw std::invalid_argument("Only 8 and 16-bit images can be saved");
+    }
+    size_t rowSize = image.cols * image.elemSize();
+
+    switch (format)
+    {
+    case FrameSinkFormat::Png:
+    {
+        std::vector<int> params = {cv::IMWRITE_PNG_COMPRESSION, settings.pngCompression};
+        if (!cv::imencode(".png", image, buffer, params))
+        {
+            throw std::runtime_error("PNG encoding failed");
+        }
+        return wide ? 2 : 1;
+    }
+    case FrameSinkFormat::Raw:
+        buffer.resize(rowSize * image.rows);
+        for (int y = 0; y < image.rows; y++)
+        {
+            memcpy(&buffer[y * rowSize], image.ptr(y), rowSize);
+        }
+        return wide ? 2 : 1;
+    case FrameSinkFormat::Pgm16:
+    {
+        // PGM is single channel, so only the first channel is kept.
+        std::string header = "P5\n" + std::to_string(image.cols) + " " +
+                             std::to_string(image.rows) + "\n65535\n";
+        buffer.resize(header.size() + size_t(2) * image.cols * image.rows);
+        memcpy(buffer.data(), header.data(), header.size());
+        uint8_t *out = buffer.data() + header.size();
+        int channels = image.channels();
+        for (int y = 0; y < image.rows; y++)
+        {
+            const uint8_t *row = image.ptr(y);
+            for (int x = 0; x < image.cols; x++)
+            {
+                uint16_t value;
+                if (wide)
+                {
+                    memcpy(&value, row + size_t(2) * x * channels, sizeof(value));
+                }
+                else
+                {
+                    // Maps 255 to 65535.
+                    value = static_cast<uint16_t>(row[x * channels] * 257);
+                }
+                *out++ = static_cast<uint8_t>(value >> 8);
+                *out++ = static_cast<uint8_t>(value & 0xFF);
+            }
+        }
+        return 2;
+    }
+    }
+    throw std::invalid_argument("Unknown frame sink format");
+}
+
+int FrameSink::writeFile(const std::string &path, const std::vector<uint8_t> &buffer)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot create " + path + ": " + strerror(errno));
+    }
+    size_t written = 0;
+    while (written < buffer.size())
+    {
+        ssize_t result = write(fd, buffer.data() + written, buffer.size() - written);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result < 0)
+        {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error("Cannot write " + path + ": " + strerror(error));
+        }
+        written += static_cast<size_t>(result);
+    }
+    return fd;
+}
+
+void FrameSink::finishFile(int fd)
+{
+    if (settings.filesPerSync == 0)
+    {
+        close(fd);
+        return;
+    }
+    bool batchFull;
+    {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        unsyncedFiles.push_back(fd);
+        batchFull = unsyncedFiles.size() >= settings.filesPerSync;
+    }
+    if (batchFull)
+    {
+        syncFiles(false);
+    }
+}
+
+void FrameSink::syncFiles(bool all)
+{
+    std::vector<int> batch;
+    {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        // Another worker may have taken the batch already.
+        if (unsyncedFiles.empty() || (!all && unsyncedFiles.size() < settings.filesPerSync))
+        {
+            return;
+        }
+        batch.swap(unsyncedFiles);
+    }
+    for (int fd : batch)
+    {
+        if (fdatasync(fd) != 0)
+        {
+            std::cerr << "Cannot sync frame file: " << strerror(errno) << std::endl;
+        }
+        close(fd);
+    }
+    // Makes the new directory entries durable too.
+    fsync(directoryFd);
+}
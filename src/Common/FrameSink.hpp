@@ -0,0 +1,123 @@
+#ifndef FLIGHTGOGGLESFRAMESINK_H
+#define FLIGHTGOGGLESFRAMESINK_H
+/**
+ * @file   FrameSink.hpp
+ * @brief  Writes rendered frames to disk on a worker pool, so that dataset
+ * capture does not hold up the thread receiving frames.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "jsonMessageSpec.hpp"
+
+enum class FrameSinkFormat
+{
+    // Lossless PNG, 8 bits per channel.
+    Png,
+    // Upright, BGR ordered pixel bytes without a header. The shape of every
+    // file is listed in the sink's frames.csv.
+    Raw,
+    // Binary PGM with 16-bit big-endian samples, for depth images. 8-bit
+    // images are widened to the full 16-bit range.
+    Pgm16
+};
+
+class FrameSink
+{
+  public:
+    struct Settings
+    {
+        // Created if it does not exist.
+        std::string directory;
+        size_t numThreads = 2;
+        // Frames waiting to be written. Frames submitted beyond this are
+        // dropped.
+        size_t maxQueuedFrames = 32;
+        FrameSinkFormat colorFormat = FrameSinkFormat::Png;
+        FrameSinkFormat depthFormat = FrameSinkFormat::Pgm16;
+        // 0-9. Low levels trade disk space for encoding speed.
+        int pngCompression = 1;
+        // Files written between two fsync() batches. 0 leaves writeback to
+        // the OS.
+        size_t filesPerSync = 64;
+    };
+
+    struct Stats
+    {
+        uint64_t framesWritten = 0;
+        // Frames submitted while the queue was full.
+        uint64_t framesDropped = 0;
+        // Frames with at least one image that could not be written.
+        uint64_t framesFailed = 0;
+        uint64_t filesWritten = 0;
+        uint64_t bytesWritten = 0;
+        // Frames queued or being written, now and at most.
+        size_t queueDepth = 0;
+        size_t peakQueueDepth = 0;
+        // Mean write rate since the sink was created.
+        double megabytesPerSecond = 0;
+    };
+
+    // Creates the output directory and starts the workers. Throws
+    // std::runtime_error if the directory or frames.csv cannot be created.
+    explicit FrameSink(const Settings &settings);
+
+    // Writes all queued frames and syncs them to disk.
+    ~FrameSink();
+
+    FrameSink(const FrameSink &) = delete;
+    FrameSink &operator=(const FrameSink &) = delete;
+
+    // Queues all images of a frame for writing and returns immediately.
+    // Images are shared, not copied. Returns false if the frame was dropped
+    // because the queue is full. Safe to call from several threads.
+    bool submit(const unity_incoming::RenderOutput_t &renderOutput);
+
+    // Blocks until every queued frame is written and synced to disk.
+    void flush();
+
+    Stats getStats() const;
+
+    // Name of the file holding one camera image, e.g. "1234567_Camera_RGB.png".
+    static std::string fileName(int64_t utime, const std::string &cameraID,
+                                FrameSinkFormat format);
+
+  private:
+    void writeFrame(const unity_incoming::RenderOutput_t &renderOutput);
+    // Encodes one image into buffer. Returns the bytes per sample written.
+    size_t encode(const cv::Mat &image, FrameSinkFormat format, std::vector<uint8_t> &buffer) const;
+    // Writes buffer to a new file and returns its descriptor, still open.
+    int writeFile(const std::string &path, const std::vector<uint8_t> &buffer);
+    // Hands a written file over to be synced with the next batch.
+    void finishFile(int fd);
+    // Syncs and closes files waiting for a batch, and the directory.
+    void syncFiles(bool all);
+
+    Settings settings;
+    int directoryFd = -1;
+    FILE *frameList = nullptr;
+    std::mutex frameListMutex;
+
+    // Files written but not yet synced.
+    std::vector<int> unsyncedFiles;
+    std::mutex syncMutex;
+
+    mutable std::mutex statsMutex;
+    std::condition_variable queueDrained;
+    Stats stats;
+    int64_t startUs;
+
+    // Declared last so that the workers stop before anything they use is
+    // destroyed.
+    ThreadPool workers;
+};
+
+#endif
@@ -0,0 +1,114 @@
+/**
+ * @file   InFlightRequests.cpp
+ * @brief  Bookkeeping of unanswered render requests.
+ */
+
+#include "InFlightRequests.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+InFlightRequests::InFlightRequests(size_t capacity)
+    : capacity(capacity > 0 ? capacity : 1)
+{
+}
+
+void InFlightRequests::add(const Request &request)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.size() >= capacity)
+    {
+        pending.pop_front();
+        stats.lost++;
+    }
+    pending.push_back(request);
+    stats.sent++;
+}
+
+bool InFlightRequests::complete(int64_t utime, Request &request)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t index = 0;
+        while (index < pending.size() && pending[index].utime != utime)
+        {
+            index++;
+        }
+        if (index == pending.size())
+        {
+            stats.unmatched++;
+            return false;
+        }
+
+        request = std::move(pending[index]);
+        pending.erase(pending.begin(), pending.begin() + index + 1);
+        stats.lost += index;
+        stats.completed++;
+    }
+    slotFreed.notify_all();
+    return true;
+}
+
+bool InFlightRequests::waitForSlot(size_t limit, int64_t timeoutUs)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return slotFreed.wait_for(lock, std::chrono::microseconds(timeoutUs),
+                              [&]() { return pending.size() < limit; });
+}
+
+bool InFlightRequests::cancel(int64_t utime)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto request = std::find_if(pending.begin(), pending.end(),
+                                    [utime](const Request &r) { return r.utime == utime; });
+        if (request == pending.end())
+        {
+            return false;
+        }
+        pending.erase(request);
+        stats.sent--;
+    }
+    slotFreed.notify_all();
+    return true;
+}
+
+size_t InFlightRequests::expireOlderThan(int64_t sentUtime)
+{
+    size_t expired = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!pending.empty() && pending.front().sentUtime < sentUtime)
+        {
+            pending.pop_front();
+            expired++;
+        }
+        stats.lost += expired;
+    }
+    if (expired)
+    {
+        slotFreed.notify_all();
+    }
+    return expired;
+}
+
+void InFlightRequests::clear()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.clear();
+    }
+    slotFreed.notify_all();
+}
+
+size_t InFlightRequests::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size();
+}
+
+InFlightRequests::Stats InFlightRequests::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
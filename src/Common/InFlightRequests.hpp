@@ -0,0 +1,87 @@
+#ifndef FLIGHTGOGGLESINFLIGHTREQUESTS_H
+#define FLIGHTGOGGLESINFLIGHTREQUESTS_H
+/**
+ * @file   InFlightRequests.hpp
+ * @brief  Tracks render requests that have been sent but not answered yet,
+ * so that returned frames can be matched to the state they were rendered from.
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "jsonMessageSpec.hpp"
+
+/**
+ * @brief Requests in send order, keyed by utime.
+ *
+ * The renderer answers requests in the order it received them, and its frame
+ * metadata carries the utime of the request. A frame therefore completes the
+ * request with its utime, and every older request still pending is counted
+ * as lost.
+ */
+class InFlightRequests
+{
+  public:
+    struct Request
+    {
+        int64_t utime = 0;
+        // State the request was serialized from.
+        std::shared_ptr<const unity_outgoing::StateMessage_t> state;
+        // Client monotonic timestamp at which the request was sent.
+        int64_t sentUtime = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t sent = 0;
+        uint64_t completed = 0;
+        // Requests that were skipped by a newer frame, expired or evicted.
+        uint64_t lost = 0;
+        // Frames whose utime matched no pending request.
+        uint64_t unmatched = 0;
+    };
+
+    // At most capacity requests are kept. Adding more evicts the oldest, so
+    // that a renderer that never answers does not grow the list.
+    explicit InFlightRequests(size_t capacity = 64);
+
+    // Records a sent request. utime must be larger than that of all pending
+    // requests.
+    void add(const Request &request);
+
+    // Removes the request answered by a frame with the given utime, together
+    // with all older ones. Returns false if there was no such request.
+    bool complete(int64_t utime, Request &request);
+
+    // Waits up to timeoutUs until fewer than limit requests are pending.
+    // Returns false on timeout.
+    bool waitForSlot(size_t limit, int64_t timeoutUs);
+
+    // Takes back a request that was added but could not be sent. It counts
+    // as neither sent nor lost. Returns false if it is not pending.
+    bool cancel(int64_t utime);
+
+    // Drops requests sent before sentUtime. Returns how many were dropped.
+    size_t expireOlderThan(int64_t sentUtime);
+
+    // Forgets all pending requests without counting them as lost, e.g. after
+    // the renderer was restarted.
+    void clear();
+
+    size_t size() const;
+
+    Stats getStats() const;
+
+  private:
+    size_t capacity;
+    mutable std::mutex mutex;
+    std::condition_variable slotFreed;
+    std::deque<Request> pending;
+    Stats stats;
+};
+
+#endif
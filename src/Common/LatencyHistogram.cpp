@@ -0,0 +1,132 @@
+/**
+ * @file   LatencyHistogram.cpp
+ * @brief  Log-linear latency histogram.
+ */
+
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const int LatencyHistogram::kMaxValueBits;
+const int LatencyHistogram::kSubBucketBits;
+const size_t LatencyHistogram::kSubBucketCount;
+const size_t LatencyHistogram::kBucketCount;
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(int64_t value)
+{
+    value = std::max<int64_t>(0, value);
+    counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    totalCount.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    int64_t current = minValue.load(std::memory_order_relaxed);
+    while (value < current &&
+           !minValue.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+    current = maxValue.load(std::memory_order_relaxed);
+    while (value > current &&
+           !maxValue.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+int64_t LatencyHistogram::getValueAtPercentile(double percentile) const
+{
+    uint64_t total = getCount();
+    if (total == 0)
+    {
+        return 0;
+    }
+    percentile = std::min(100.0, std::max(0.0, percentile));
+    uint64_t target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * total));
+    target = std::max<uint64_t>(1, std::min(target, total));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; i++)
+    {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            // The bucket bound can overshoot the largest recorded value.
+            return std::min(bucketUpperBound(i), getMax());
+        }
+    }
+    // Counts went up concurrently since total was read.
+    return getMax();
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+    return totalCount.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::getMin() const
+{
+    return getCount() ? minValue.load(std::memory_order_relaxed) : 0;
+}
+
+int64_t LatencyHistogram::getMax() const
+{
+    return maxValue.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::getMean() const
+{
+    uint64_t total = getCount();
+    return total ? static_cast<double>(sum.load(std::memory_order_relaxed)) / total : 0;
+}
+
+void LatencyHistogram::reset()
+{
+    for (size_t i = 0; i < kBucketCount; i++)
+    {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+    totalCount.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    minValue.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::bucketIndex(int64_t value)
+{
+    uint64_t v = static_cast<uint64_t>(value);
+    if (v < kSubBucketCount)
+    {
+        return static_cast<size_t>(v);
+    }
+    int msb = 63 - __builtin_clzll(v);
+    if (msb >= kMaxValueBits)
+    {
+        return kBucketCount - 1;
+    }
+    // The top kSubBucketBits + 1 bits select the bucket within the power of
+    // two range, whose group starts at (msb - kSubBucketBits + 1) * 128.
+    int shift = msb - kSubBucketBits;
+    size_t group = static_cast<size_t>(shift + 1);
+    size_t sub = static_cast<size_t>(v >> shift) - kSubBucketCount;
+    return group * kSubBucketCount + sub;
+}
+
+int64_t LatencyHistogram::bucketUpperBound(size_t index)
+{
+    if (index < kSubBucketCount)
+    {
+        return static_cast<int64_t>(index);
+    }
+    if (index == kBucketCount - 1)
+    {
+        return std::numeric_limits<int64_t>::max();
+    }
+    int shift = static_cast<int>(index / kSubBucketCount) - 1;
+    int64_t lower = static_cast<int64_t>(kSubBucketCount + index % kSubBucketCount) << shift;
+    return lower + (int64_t(1) << shift) - 1;
+}
@@ -0,0 +1,65 @@
+#ifndef FLIGHTGOGGLESLATENCYHISTOGRAM_H
+#define FLIGHTGOGGLESLATENCYHISTOGRAM_H
+/**
+ * @file   LatencyHistogram.hpp
+ * @brief  Fixed memory histogram of latencies with bounded relative error,
+ * for querying tail percentiles of per-frame timings.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Log-linear histogram in the style of HdrHistogram.
+ *
+ * Every power of two range is split into 128 equal buckets, so a reported
+ * value is within 1% of the recorded one. Values below 128 are exact.
+ * Recording is lock-free and never allocates, so it can be done on the
+ * receive path. It may run concurrently with queries, which then see a
+ * slightly stale but valid histogram.
+ */
+class LatencyHistogram
+{
+  public:
+    // Values at or above 2^kMaxValueBits are counted in the last bucket.
+    static const int kMaxValueBits = 40;
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    // Records one value. Negative values, e.g. from clock steps, count as 0.
+    void record(int64_t value);
+
+    // Smallest recorded value v such that at least percentile% of the values
+    // are <= v, up to the bucket resolution. Percentile is in [0, 100].
+    // Returns 0 if nothing was recorded.
+    int64_t getValueAtPercentile(double percentile) const;
+
+    uint64_t getCount() const;
+    int64_t getMin() const;
+    int64_t getMax() const;
+    double getMean() const;
+
+    // Discards all values. Values recorded concurrently may be lost.
+    void reset();
+
+  private:
+    static const int kSubBucketBits = 7;
+    static const size_t kSubBucketCount = size_t(1) << kSubBucketBits;
+    static const size_t kBucketCount = (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+
+    static size_t bucketIndex(int64_t value);
+    // Largest value that falls into the bucket.
+    static int64_t bucketUpperBound(size_t index);
+
+    std::atomic<uint64_t> counts[kBucketCount];
+    std::atomic<uint64_t> totalCount;
+    std::atomic<int64_t> sum;
+    std::atomic<int64_t> minValue;
+    std::atomic<int64_t> maxValue;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * @file   PoseBuffer.cpp
+ * @brief  Interpolating pose history.
+ */
+
+#include "PoseBuffer.hpp"
+
+#include <algorithm>
+
+PoseBuffer::PoseBuffer(size_t capacity) : capacity(std::max<size_t>(2, capacity))
+{
+}
+
+bool PoseBuffer::add(const Pose &pose)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!poses.empty() && pose.utime <= poses.back().utime)
+    {
+        stats.outOfOrder++;
+        return false;
+    }
+    if (poses.size() >= capacity)
+    {
+        poses.pop_front();
+    }
+    poses.push_back(pose);
+    stats.added++;
+    return true;
+}
+
+bool PoseBuffer::sample(int64_t utime, Pose &pose)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (poses.empty() || utime < poses.front().utime)
+    {
+        stats.missed++;
+        return false;
+    }
+    if (utime >= poses.back().utime)
+    {
+        pose = poses.back();
+        if (utime == pose.utime)
+        {
+            stats.interpolated++;
+        }
+        else
+        {
+            stats.clamped++;
+        }
+        return true;
+    }
+
+    // First pose after utime. Lookups are usually close to the newest pose,
+    // but the buffer is short enough for a binary search either way.
+    auto after = std::upper_bound(poses.begin(), poses.end(), utime,
+                                  [](int64_t t, const Pose &p) { return t < p.utime; });
+    const Pose &next = *after;
+    const Pose &previous = *(after - 1);
+    double t = static_cast<double>(utime - previous.utime) / (next.utime - previous.utime);
+
+    pose.utime = utime;
+    pose.position = previous.position + t * (next.position - previous.position);
+    // slerp() takes the shorter way around, whatever the quaternion signs.
+    pose.rotation = previous.rotation.slerp(t, next.rotation);
+    stats.interpolated++;
+    return true;
+}
+
+bool PoseBuffer::latest(Pose &pose) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (poses.empty())
+    {
+        return false;
+    }
+    pose = poses.back();
+    return true;
+}
+
+size_t PoseBuffer::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return poses.size();
+}
+
+void PoseBuffer::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    poses.clear();
+}
+
+PoseBuffer::Stats PoseBuffer::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,77 @@
+#ifndef FLIGHTGOGGLESPOSEBUFFER_H
+#define FLIGHTGOGGLESPOSEBUFFER_H
+/**
+ * @file   PoseBuffer.hpp
+ * @brief  Time-indexed history of poses, e.g. from odometry, that can be
+ * sampled at arbitrary times in between.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "transforms.hpp"
+
+/**
+ * @brief The most recent poses in time order, interpolated on lookup.
+ *
+ * Positions are interpolated linearly and rotations by SLERP. Times are in
+ * us in whatever clock the poses are stamped with, e.g. the header stamps of
+ * odometry messages.
+ */
+class PoseBuffer
+{
+  public:
+    struct Pose
+    {
+        int64_t utime = 0;
+        Vector3 position = Vector3::Zero();
+        Quaternionx rotation = Quaternionx::Identity();
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+
+    struct Stats
+    {
+        uint64_t added = 0;
+        // Poses not newer than the newest one, which are dropped.
+        uint64_t outOfOrder = 0;
+        // Lookups between two poses, and lookups past the newest pose that
+        // got the newest pose.
+        uint64_t interpolated = 0;
+        uint64_t clamped = 0;
+        // Lookups before the oldest pose or into an empty buffer.
+        uint64_t missed = 0;
+    };
+
+    // Keeps the capacity most recent poses.
+    explicit PoseBuffer(size_t capacity = 1024);
+
+    // Appends a pose. Poses have to arrive in time order; ones that are not
+    // newer than the newest pose are dropped. Returns false in that case.
+    bool add(const Pose &pose);
+
+    // Fills pose with the pose at utime. Past the newest pose, pose is the
+    // newest one, with its own utime, so that the result always carries the
+    // time it is actually valid for. Returns false if utime is before the
+    // oldest pose or the buffer is empty.
+    bool sample(int64_t utime, Pose &pose);
+
+    // Newest pose. Returns false if the buffer is empty.
+    bool latest(Pose &pose) const;
+
+    size_t size() const;
+
+    void clear();
+
+    Stats getStats() const;
+
+  private:
+    size_t capacity;
+    std::deque<Pose, Eigen::aligned_allocator<Pose>> poses;
+    Stats stats;
+    mutable std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,375 @@
+/**
+ * @file   RenderLog.cpp
+ * @brief  Writer and memory-mapped reader of render message logs.
+ */
+
+#include "RenderLog.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char kSegmentMagic[4] = {'F', 'G', 'L', 'S'};
+const char kRecordMagic[4] = {'F', 'G', 'L', 'R'};
+const char kIndexMagic[4] = {'F', 'G', 'L', 'I'};
+const uint16_t kRenderLogVersion = 1;
+
+const size_t kFileHeaderSize = 8;
+const size_t kRecordHeaderSize = 24;
+const size_t kIndexEntrySize = 32;
+
+struct FileHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+};
+
+struct RecordHeader
+{
+    char magic[4];
+    uint8_t direction;
+    uint8_t reserved[3];
+    int64_t timestamp;
+    uint32_t numParts;
+    uint32_t reserved2;
+};
+
+struct IndexEntry
+{
+    uint32_t segment;
+    uint8_t direction;
+    uint8_t reserved[3];
+    uint64_t offset;
+    uint64_t size;
+    int64_t timestamp;
+};
+
+static_assert(sizeof(FileHeader) == kFileHeaderSize, "unexpected padding");
+static_assert(sizeof(RecordHeader) == kRecordHeaderSize, "unexpected padding");
+static_assert(sizeof(IndexEntry) == kIndexEntrySize, "unexpected padding");
+
+size_t padTo8(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+std::string segmentPath(const std::string &directory, uint32_t number)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/segment-%06u.fglog", number);
+    return directory + name;
+}
+
+std::string indexPath(const std::string &directory)
+{
+    return directory + "/index.fgidx";
+}
+
+FileHeader makeHeader(const char (&magic)[4])
+{
+    FileHeader header;
+    memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = kRenderLogVersion;
+    header.reserved = 0;
+    return header;
+}
+
+void checkHeader(const uint8_t *data, size_t size, const char (&magic)[4],
+                 const std::string &path)
+{
+    FileHeader header;
+    if (size < sizeof(header))
+    {
+        throw std::runtime_error(path + " is truncated");
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, magic, sizeof(header.magic)) != 0)
+    {
+        throw std::runtime_error(path + " is not a render log file");
+    }
+    if (header.version != kRenderLogVersion)
+    {
+        throw std::runtime_error(path + " has unsupported version " +
+                                 std::to_string(header.version));
+    }
+}
+
+}
+
+///////////////////////
+// Writer
+///////////////////////
+
+RenderLogWriter::RenderLogWriter(const std::string &directory, size_t segmentSize)
+    : directory(directory), segmentSize(segmentSize)
+{
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        throw std::runtime_error("Cannot create " + directory + ": " + strerror(errno));
+    }
+
+    std::string path = indexPath(directory);
+    index = fopen(path.c_str(), "wb");
+    if (!index)
+    {
+        throw std::runtime_error("Cannot create " + path + ": " + strerror(errno));
+    }
+    FileHeader header = makeHeader(kIndexMagic);
+    try
+    {
+        write(index, &header, sizeof(header));
+        openSegment();
+    }
+    catch (...)
+    {
+        fclose(index);
+        throw;
+    }
+}
+
+RenderLogWriter::~RenderLogWriter()
+{
+    if (segment)
+    {
+        fclose(segment);
+    }
+    fclose(index);
+}
+
+void RenderLogWriter::openSegment()
+{
+    if (segment)
+    {
+        fclose(segment);
+        segment = nullptr;
+        segmentNumber++;
+    }
+    std::string path = segmentPath(directory, segmentNumber);
+    segment = fopen(path.c_str(), "wb");
+    if (!segment)
+    {
+        throw std::runtime_error("Cannot create " + path + ": " + strerror(errno));
+    }
+    // Large enough for a whole frame, so that a record goes out in one write.
+    setvbuf(segment, nullptr, _IOFBF, size_t(1) << 20);
+
+    FileHeader header = makeHeader(kSegmentMagic);
+    write(segment, &header, sizeof(header));
+    segmentOffset = sizeof(header);
+}
+
+void RenderLogWriter::append(RenderLogDirection direction, int64_t timestamp,
+                             const zmqpp::message &msg)
+{
+    size_t numParts = msg.parts();
+    size_t recordSize = kRecordHeaderSize + 8 * numParts;
+    for (size_t i = 0; i < numParts; i++)
+    {
+        recordSize += padTo8(msg.size(i));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // Records larger than a segment get a segment of their own.
+    if (segmentOffset + recordSize > segmentSize && segmentOffset > kFileHeaderSize)
+    {
+        openSegment();
+    }
+
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kRecordMagic, sizeof(header.magic));
+    header.direction = static_cast<uint8_t>(direction);
+    header.timestamp = timestamp;
+    header.numParts = static_cast<uint32_t>(numParts);
+    write(segment, &header, sizeof(header));
+    for (size_t i = 0; i < numParts; i++)
+    {
+        uint64_t size = msg.size(i);
+        write(segment, &size, sizeof(size));
+    }
+    static const char padding[8] = {0};
+    for (size_t i = 0; i < numParts; i++)
+    {
+        size_t size = msg.size(i);
+        write(segment, msg.raw_data(i), size);
+        write(segment, padding, padTo8(size) - size);
+    }
+
+    IndexEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.segment = segmentNumber;
+    entry.direction = header.direction;
+    entry.offset = segmentOffset;
+    entry.size = recordSize;
+    entry.timestamp = timestamp;
+    // The record has to be in the file before the index refers to it.
+    if (fflush(segment) != 0)
+    {
+        throw std::runtime_error("Cannot write render log: " + std::string(strerror(errno)));
+    }
+    write(index, &entry, sizeof(entry));
+    segmentOffset += recordSize;
+}
+
+void RenderLogWriter::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    fflush(segment);
+    fflush(index);
+}
+
+void RenderLogWriter::write(FILE *file, const void *data, size_t size)
+{
+    if (size && fwrite(data, 1, size, file) != size)
+    {
+        throw std::runtime_error("Cannot write render log: " + std::string(strerror(errno)));
+    }
+}
+
+///////////////////////
+// Reader
+///////////////////////
+
+RenderLogReader::RenderLogReader(const std::string &directory)
+{
+    std::string path = indexPath(directory);
+    indexMapping = map(path);
+    try
+    {
+        checkHeader(indexMapping.data, indexMapping.size, kIndexMagic, path);
+        // A trailing partial entry is from a crash while appending.
+        numEntries = (indexMapping.size - kFileHeaderSize) / kIndexEntrySize;
+
+        uint32_t lastSegment = 0;
+        for (size_t i = 0; i < numEntries; i++)
+        {
+            IndexEntry entry;
+            memcpy(&entry, indexMapping.data + kFileHeaderSize + i * kIndexEntrySize,
+                   sizeof(entry));
+            lastSegment = std::max(lastSegment, entry.segment);
+        }
+        for (uint32_t s = 0; numEntries && s <= lastSegment; s++)
+        {
+            std::string segment = segmentPath(directory, s);
+            segments.push_back(map(segment));
+            checkHeader(segments.back().data, segments.back().size, kSegmentMagic, segment);
+            // Replay reads front to back.
+            madvise(const_cast<uint8_t *>(segments.back().data), segments.back().size,
+                    MADV_SEQUENTIAL);
+        }
+    }
+    catch (...)
+    {
+        unmapAll();
+        throw;
+    }
+}
+
+RenderLogReader::~RenderLogReader()
+{
+    unmapAll();
+}
+
+void RenderLogReader::unmapAll()
+{
+    for (const Mapping &mapping : segments)
+    {
+        munmap(const_cast<uint8_t *>(mapping.data), mapping.size);
+    }
+    segments.clear();
+    if (indexMapping.data)
+    {
+        munmap(const_cast<uint8_t *>(indexMapping.data), indexMapping.size);
+        indexMapping = Mapping();
+    }
+}
+
+RenderLogReader::Mapping RenderLogReader::map(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open " + path + ": " + strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(kFileHeaderSize))
+    {
+        close(fd);
+        throw std::runtime_error(path + " is truncated");
+    }
+
+    Mapping mapping;
+    mapping.size = static_cast<size_t>(info.st_size);
+    // Copy on write, so that consumers may write to replayed images in place
+    // without touching the file.
+    void *data = mmap(nullptr, mapping.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive on its own.
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("Cannot map " + path + ": " + strerror(errno));
+    }
+    mapping.data = static_cast<const uint8_t *>(data);
+    return mapping;
+}
+
+void RenderLogReader::read(size_t i, RenderLogRecord &record) const
+{
+    if (i >= numEntries)
+    {
+        throw std::out_of_range("Render log has no record " + std::to_string(i));
+    }
+    IndexEntry entry;
+    memcpy(&entry, indexMapping.data + kFileHeaderSize + i * kIndexEntrySize, sizeof(entry));
+
+    if (entry.segment >= segments.size())
+    {
+        throw std::runtime_error("Render log record " + std::to_string(i) +
+                                 " is in missing segment " + std::to_string(entry.segment));
+    }
+    const Mapping &segment = segments[entry.segment];
+    if (entry.offset > segment.size || entry.size > segment.size - entry.offset ||
+        entry.size < kRecordHeaderSize)
+    {
+        throw std::runtime_error("Render log record " + std::to_string(i) +
+                                 " is outside of its segment");
+    }
+    const uint8_t *data = segment.data + entry.offset;
+    RecordHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, kRecordMagic, sizeof(header.magic)) != 0 ||
+        header.numParts > (entry.size - kRecordHeaderSize) / 8)
+    {
+        throw std::runtime_error("Render log record " + std::to_string(i) + " is corrupt");
+    }
+
+    record.direction = static_cast<RenderLogDirection>(header.direction);
+    record.timestamp = header.timestamp;
+    record.partData.resize(header.numParts);
+    record.partSizes.resize(header.numParts);
+
+    size_t offset = kRecordHeaderSize + 8 * header.numParts;
+    for (size_t p = 0; p < header.numParts; p++)
+    {
+        uint64_t size;
+        memcpy(&size, data + kRecordHeaderSize + 8 * p, sizeof(size));
+        if (size > entry.size - offset || padTo8(size) > entry.size - offset)
+        {
+            throw std::runtime_error("Render log record " + std::to_string(i) +
+                                     " has a truncated part");
+        }
+        record.partData[p] = data + offset;
+        record.partSizes[p] = static_cast<size_t>(size);
+        offset += padTo8(size);
+    }
+}
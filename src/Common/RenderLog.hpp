@@ -0,0 +1,149 @@
+#ifndef FLIGHTGOGGLESRENDERLOG_H
+#define FLIGHTGOGGLESRENDERLOG_H
+/**
+ * @file   RenderLog.hpp
+ * @brief  Append-only log of the raw messages exchanged with the renderer,
+ * for replaying a session without Unity.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <zmqpp/zmqpp.hpp>
+
+/*
+ * A log is a directory holding numbered segment files and one index file.
+ * All fields are in host byte order, as logs are meant to be replayed on the
+ * machine (or at least the architecture) that recorded them.
+ *
+ * Segment "segment-NNNNNN.fglog":
+ *
+ *   offset  size  field
+ *   0       4     magic, the characters "FGLS"
+ *   4       2     uint16 version
+ *   6       2     reserved
+ *   8             records, each 8 byte aligned:
+ *     0     4     magic, the characters "FGLR"
+ *     4     1     uint8 direction
+ *     5     3     reserved
+ *     8     8     int64 timestamp
+ *     16    4     uint32 number of message parts
+ *     20    4     reserved
+ *     24    8*n   uint64 size of each part
+ *     ...         the parts, each padded to 8 bytes
+ *
+ * Index "index.fgidx":
+ *
+ *   0       4     magic, the characters "FGLI"
+ *   4       2     uint16 version
+ *   6       2     reserved
+ *   8             entries of 32 bytes, in append order:
+ *     0     4     uint32 segment number
+ *     4     1     uint8 direction
+ *     5     3     reserved
+ *     8     8     uint64 offset of the record in its segment
+ *     16    8     uint64 size of the record
+ *     24    8     int64 timestamp
+ *
+ * An index entry is only written after its record, so a crash can lose the
+ * last records but never leaves the index pointing at a partial one.
+ */
+
+enum class RenderLogDirection : uint8_t
+{
+    // Requests and pings sent to the renderer.
+    Upload = 0,
+    // Frames and pongs received from the renderer.
+    Download = 1
+};
+
+// One message read back from a log. The parts point into the mapped log.
+struct RenderLogRecord
+{
+    RenderLogDirection direction = RenderLogDirection::Upload;
+    // Monotonic client time at which the message was sent or received.
+    int64_t timestamp = 0;
+    std::vector<const uint8_t *> partData;
+    std::vector<size_t> partSizes;
+
+    size_t parts() const { return partData.size(); }
+};
+
+class RenderLogWriter
+{
+  public:
+    // Creates directory if needed and starts a new log in it, replacing an
+    // existing one. A new segment is started once the current one would grow
+    // past segmentSize. Throws std::runtime_error if the files cannot be
+    // created.
+    explicit RenderLogWriter(const std::string &directory,
+                             size_t segmentSize = size_t(256) << 20);
+
+    // Flushes and closes the log.
+    ~RenderLogWriter();
+
+    RenderLogWriter(const RenderLogWriter &) = delete;
+    RenderLogWriter &operator=(const RenderLogWriter &) = delete;
+
+    // Appends all parts of msg. Safe to call from several threads. Throws
+    // std::runtime_error if the write fails.
+    void append(RenderLogDirection direction, int64_t timestamp, const zmqpp::message &msg);
+
+    // Hands buffered data to the OS.
+    void flush();
+
+  private:
+    void openSegment();
+    void write(FILE *file, const void *data, size_t size);
+
+    std::string directory;
+    size_t segmentSize;
+    std::mutex mutex;
+    FILE *segment = nullptr;
+    FILE *index = nullptr;
+    uint32_t segmentNumber = 0;
+    uint64_t segmentOffset = 0;
+};
+
+class RenderLogReader
+{
+  public:
+    // Maps the index and all segments of the log in directory. Throws
+    // std::runtime_error if they cannot be opened or have a bad header.
+    explicit RenderLogReader(const std::string &directory);
+
+    ~RenderLogReader();
+
+    RenderLogReader(const RenderLogReader &) = delete;
+    RenderLogReader &operator=(const RenderLogReader &) = delete;
+
+    // Number of records.
+    size_t size() const { return numEntries; }
+
+    // Fills record with the i-th message, reusing its storage. Nothing is
+    // copied, the parts stay valid as long as the reader. They may be
+    // written to in place, e.g. by a consumer of zero-copy images. Writes
+    // are private to this reader and never reach the file. Throws
+    // std::runtime_error if the record is corrupt.
+    void read(size_t i, RenderLogRecord &record) const;
+
+  private:
+    struct Mapping
+    {
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+    };
+
+    static Mapping map(const std::string &path);
+    void unmapAll();
+
+    Mapping indexMapping;
+    std::vector<Mapping> segments;
+    size_t numEntries = 0;
+};
+
+#endif
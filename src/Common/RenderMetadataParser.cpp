@@ -0,0 +1,806 @@
+/**
+ * @file   RenderMetadataParser.cpp
+ * @brief  Streaming parser for RenderMetadata_t.
+ */
+
+#include "RenderMetadataParser.hpp"
+
+#include <algorithm>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+
+// Fields that from_json(RenderMetadata_t) requires, in the order it reads
+// them. That order decides which error is reported if several fields are bad.
+enum MetadataField
+{
+    FIELD_UTIME,
+    FIELD_CAM_WIDTH,
+    FIELD_CAM_HEIGHT,
+    FIELD_CAM_DEPTH_SCALE,
+    FIELD_IS_COMPRESSED,
+    FIELD_CAMERA_IDS,
+    FIELD_CHANNELS,
+    FIELD_COUNT,
+    FIELD_UNKNOWN = FIELD_COUNT
+};
+
+const char *const kFieldNames[FIELD_COUNT] = {
+    "utime", "camWidth", "camHeight", "camDepthScale", "isCompressed", "cameraIDs", "channels",
+};
+
+// Nesting limit for skipped values, so that hostile input cannot blow the stack.
+const int kMaxSkipDepth = 64;
+
+MetadataField lookupField(const char *key, size_t length)
+{
+    for (int field = 0; field < FIELD_COUNT; field++)
+    {
+        // key is not NUL terminated and may contain NULs, so compare lengths
+        // first and never read past either string.
+        const char *name = kFieldNames[field];
+        if (length == strlen(name) && memcmp(name, key, length) == 0)
+        {
+            return static_cast<MetadataField>(field);
+        }
+    }
+    return FIELD_UNKNOWN;
+}
+
+// Name of the JSON type starting with c, as used in json's error messages.
+const char *typeName(char c)
+{
+    switch (c)
+    {
+    case '"':
+        return "string";
+    case '{':
+        return "object";
+    case '[':
+        return "array";
+    case 't':
+    case 'f':
+        return "boolean";
+    case 'n':
+        return "null";
+    default:
+        return "number";
+    }
+}
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+void appendUtf8(std::string &out, unsigned long codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        out += static_cast<char>(codepoint);
+    }
+    else if (codepoint < 0x800)
+    {
+        out += static_cast<char>(0xC0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        out += static_cast<char>(0xE0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        out += static_cast<char>(0xF0 | (codepoint >> 18));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+}
+
+///////////////////////
+// Lexing
+///////////////////////
+
+void RenderMetadataParser::fail(const char *what)
+{
+    throw std::invalid_argument("parse error in render metadata at byte " +
+                                std::to_string(pos - begin) + ": " + what);
+}
+
+void RenderMetadataParser::typeError(int field, const char *expected)
+{
+    if (!(typeErrors & (1u << field)))
+    {
+        typeErrors |= 1u << field;
+        expectedTypes[field] = expected;
+        foundTypes[field] = typeName(*pos);
+        if (*pos == '-' || isDigit(*pos))
+        {
+            // Numbers out of the range of double are stored as null by json.
+            const char *number = pos;
+            int64_t integerValue;
+            bool isInteger;
+            if (!std::isfinite(parseNumber(integerValue, isInteger)))
+            {
+                foundTypes[field] = "null";
+            }
+            pos = number;
+        }
+    }
+}
+
+void RenderMetadataParser::skipWhitespace()
+{
+    while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r'))
+    {
+        pos++;
+    }
+}
+
+void RenderMetadataParser::expect(char c)
+{
+    if (pos >= end || *pos != c)
+    {
+        fail(pos >= end ? "unexpected end of input" : "unexpected character");
+    }
+    pos++;
+}
+
+void RenderMetadataParser::skipUtf8Sequence()
+{
+    // Well formed sequences as listed in RFC 3629.
+    unsigned char lead = static_cast<unsigned char>(*pos);
+    int continuation;
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        continuation = 1;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        continuation = 2;
+        if (lead == 0xE0)
+            low = 0xA0;
+        else if (lead == 0xED)
+            high = 0x9F;
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        continuation = 3;
+        if (lead == 0xF0)
+            low = 0x90;
+        else if (lead == 0xF4)
+            high = 0x8F;
+    }
+    else
+    {
+        fail("invalid UTF-8");
+    }
+    if (end - pos <= continuation)
+    {
+        fail("invalid UTF-8");
+    }
+    pos++;
+    for (int i = 0; i < continuation; i++, pos++)
+    {
+        unsigned char c = static_cast<unsigned char>(*pos);
+        if (c < low || c > high)
+        {
+            fail("invalid UTF-8");
+        }
+        low = 0x80;
+        high = 0xBF;
+    }
+}
+
+void RenderMetadataParser::parseString(const char *&contents, size_t &length)
+{
+    expect('"');
+    const char *start = pos;
+
+    // Fast path: no escapes, so the contents can be used in place.
+    while (pos < end && *pos != '"' && *pos != '\\')
+    {
+        unsigned char c = static_cast<unsigned char>(*pos);
+        if (c < 0x20)
+        {
+            fail("control character in string");
+        }
+        if (c >= 0x80)
+        {
+            skipUtf8Sequence();
+        }
+        else
+        {
+            pos++;
+        }
+    }
+    if (pos >= end)
+    {
+        fail("unterminated string");
+    }
+    if (*pos == '"')
+    {
+        contents = start;
+        length = pos - start;
+        pos++;
+        return;
+    }
+
+    // Slow path: unescape into scratch.
+    scratch.assign(start, pos - start);
+    while (true)
+    {
+        if (pos >= end)
+        {
+            fail("unterminated string");
+        }
+        unsigned char c = static_cast<unsigned char>(*pos);
+        if (c == '"')
+        {
+            pos++;
+            break;
+        }
+        if (c < 0x20)
+        {
+            fail("control character in string");
+        }
+        if (c >= 0x80)
+        {
+            const char *sequence = pos;
+            skipUtf8Sequence();
+            scratch.append(sequence, pos - sequence);
+            continue;
+        }
+        pos++;
+        if (c != '\\')
+        {
+            scratch += static_cast<char>(c);
+            continue;
+        }
+
+        if (pos >= end)
+        {
+            fail("unterminated string");
+        }
+        switch (*pos++)
+        {
+        case '"':
+            scratch += '"';
+            break;
+        case '\\':
+            scratch += '\\';
+            break;
+        case '/':
+            scratch += '/';
+            break;
+        case 'b':
+            scratch += '\b';
+            break;
+        case 'f':
+            scratch += '\f';
+            break;
+        case 'n':
+            scratch += '\n';
+            break;
+        case 'r':
+            scratch += '\r';
+            break;
+        case 't':
+            scratch += '\t';
+            break;
+        case 'u':
+        {
+            unsigned long units[2] = {0, 0};
+            for (int n = 0; n < 2; n++)
+            {
+                if (end - pos < 4)
+                {
+                    fail("invalid \\u escape");
+                }
+                for (int i = 0; i < 4; i++)
+                {
+                    char h = *pos++;
+                    units[n] <<= 4;
+                    if (isDigit(h))
+                        units[n] |= h - '0';
+                    else if (h >= 'a' && h <= 'f')
+                        units[n] |= h - 'a' + 10;
+                    else if (h >= 'A' && h <= 'F')
+                        units[n] |= h - 'A' + 10;
+                    else
+                        fail("invalid \\u escape");
+                }
+                if (n == 0)
+                {
+                    if (units[0] >= 0xDC00 && units[0] <= 0xDFFF)
+                    {
+                        fail("missing high surrogate");
+                    }
+                    if (units[0] < 0xD800 || units[0] > 0xDBFF)
+                    {
+                        break;
+                    }
+                    // A high surrogate must be followed by an escaped low one.
+                    if (end - pos < 2 || pos[0] != '\\' || pos[1] != 'u')
+                    {
+                        fail("missing low surrogate");
+                    }
+                    pos += 2;
+                }
+                else if (units[1] < 0xDC00 || units[1] > 0xDFFF)
+                {
+                    fail("missing or wrong low surrogate");
+                }
+            }
+            if (units[1])
+            {
+                appendUtf8(scratch, 0x10000 + ((units[0] - 0xD800) << 10) + (units[1] - 0xDC00));
+            }
+            else
+            {
+                appendUtf8(scratch, units[0]);
+            }
+            break;
+        }
+        default:
+            fail("invalid escape");
+        }
+    }
+    contents = scratch.data();
+    length = scratch.size();
+}
+
+double RenderMetadataParser::parseNumber(int64_t &integerValue, bool &isInteger)
+{
+    const char *start = pos;
+    bool negative = false;
+    if (pos < end && *pos == '-')
+    {
+        negative = true;
+        pos++;
+    }
+    if (pos >= end || !isDigit(*pos))
+    {
+        fail("invalid number");
+    }
+
+    // Accumulate as a negative number so that INT64_MIN fits.
+    bool overflow = false;
+    int64_t value = 0;
+    if (*pos == '0')
+    {
+        pos++;
+    }
+    else
+    {
+        while (pos < end && isDigit(*pos))
+        {
+            int digit = *pos++ - '0';
+            if (value < (std::numeric_limits<int64_t>::min() + digit) / 10)
+            {
+                overflow = true;
+            }
+            value = value * 10 - digit;
+        }
+    }
+
+    isInteger = true;
+    if (pos < end && *pos == '.')
+    {
+        isInteger = false;
+        pos++;
+        if (pos >= end || !isDigit(*pos))
+        {
+            fail("invalid number");
+        }
+        while (pos < end && isDigit(*pos))
+        {
+            pos++;
+        }
+    }
+    if (pos < end && (*pos == 'e' || *pos == 'E'))
+    {
+        isInteger = false;
+        pos++;
+        if (pos < end && (*pos == '+' || *pos == '-'))
+        {
+            pos++;
+        }
+        if (pos >= end || !isDigit(*pos))
+        {
+            fail("invalid number");
+        }
+        while (pos < end && isDigit(*pos))
+        {
+            pos++;
+        }
+    }
+
+    if (isInteger && !overflow && (negative || value != std::numeric_limits<int64_t>::min()))
+    {
+        integerValue = negative ? value : -value;
+        return static_cast<double>(integerValue);
+    }
+    isInteger = false;
+
+    // The input is not null terminated, so copy the number out for strtod,
+    // which expects the locale's decimal point.
+    scratch.assign(start, pos - start);
+    const struct lconv *loc = localeconv();
+    const char decimalPoint = (loc && loc->decimal_point) ? loc->decimal_point[0] : '.';
+    if (decimalPoint != '\0' && decimalPoint != '.')
+    {
+        size_t dot = scratch.find('.');
+        if (dot != std::string::npos)
+        {
+            scratch[dot] = decimalPoint;
+        }
+    }
+    return strtod(scratch.c_str(), nullptr);
+}
+
+bool RenderMetadataParser::parseBool(bool &value)
+{
+    if (end - pos >= 4 && memcmp(pos, "true", 4) == 0)
+    {
+        pos += 4;
+        value = true;
+        return true;
+    }
+    if (end - pos >= 5 && memcmp(pos, "false", 5) == 0)
+    {
+        pos += 5;
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+bool RenderMetadataParser::parseInteger(int64_t &value)
+{
+    // json reads booleans as 0 and 1 into integers, though not into doubles.
+    bool boolean;
+    if (parseBool(boolean))
+    {
+        value = boolean;
+        return true;
+    }
+    if (pos >= end || (*pos != '-' && !isDigit(*pos)))
+    {
+        return false;
+    }
+    const char *number = pos;
+    bool isInteger;
+    double result = parseNumber(value, isInteger);
+    if (!std::isfinite(result))
+    {
+        pos = number;
+        return false;
+    }
+    if (!isInteger)
+    {
+        // Like json, floating point values are truncated. Unlike json, out
+        // of range values are clamped rather than left undefined.
+        const double limit = 9223372036854774784.0;
+        value = static_cast<int64_t>(std::max(-limit, std::min(result, limit)));
+    }
+    return true;
+}
+
+bool RenderMetadataParser::parseDouble(double &value)
+{
+    if (pos >= end || (*pos != '-' && !isDigit(*pos)))
+    {
+        return false;
+    }
+    const char *number = pos;
+    int64_t integerValue;
+    bool isInteger;
+    double result = parseNumber(integerValue, isInteger);
+    if (!std::isfinite(result))
+    {
+        pos = number;
+        return false;
+    }
+    value = result;
+    return true;
+}
+
+void RenderMetadataParser::skipValue()
+{
+    // Iterative, with an explicit stack of open containers.
+    char stack[kMaxSkipDepth];
+    int depth = 0;
+    const char *s;
+    size_t length;
+    while (true)
+    {
+        skipWhitespace();
+        if (pos >= end)
+        {
+            fail("unexpected end of input");
+        }
+
+        char c = *pos;
+        if (c == '{' || c == '[')
+        {
+            if (depth == kMaxSkipDepth)
+            {
+                fail("nesting too deep");
+            }
+            pos++;
+            skipWhitespace();
+            if (pos < end && *pos == (c == '{' ? '}' : ']'))
+            {
+                pos++;
+            }
+            else
+            {
+                stack[depth++] = c;
+                if (c == '{')
+                {
+                    parseString(s, length);
+                    skipWhitespace();
+                    expect(':');
+                }
+                continue;
+            }
+        }
+        else if (c == '"')
+        {
+            parseString(s, length);
+        }
+        else if (end - pos >= 4 && memcmp(pos, "null", 4) == 0)
+        {
+            pos += 4;
+        }
+        else
+        {
+            bool b;
+            if (!parseBool(b))
+            {
+                int64_t i;
+                bool isInteger;
+                parseNumber(i, isInteger);
+            }
+        }
+
+        // A value is complete. Close finished containers, or move on to the
+        // next element of the innermost one.
+        while (depth > 0)
+        {
+            skipWhitespace();
+            if (pos < end && *pos == ',')
+            {
+                pos++;
+                if (stack[depth - 1] == '{')
+                {
+                    skipWhitespace();
+                    parseString(s, length);
+                    skipWhitespace();
+                    expect(':');
+                }
+                break;
+            }
+            expect(stack[depth - 1] == '{' ? '}' : ']');
+            depth--;
+        }
+        if (depth == 0)
+        {
+            return;
+        }
+    }
+}
+
+///////////////////////
+// Metadata
+///////////////////////
+
+void RenderMetadataParser::parse(const char *data, size_t size, unity_incoming::RenderMetadata_t &o)
+{
+    begin = pos = data;
+    end = data + size;
+    typeErrors = 0;
+    unsigned int seen = 0;
+
+    skipWhitespace();
+    if (pos < end && *pos != '{')
+    {
+        // Valid JSON that is not an object still is a type error.
+        const char *found = typeName(*pos);
+        skipValue();
+        skipWhitespace();
+        if (pos != end)
+        {
+            fail("unexpected data after metadata");
+        }
+        throw std::domain_error("cannot use at() with " + std::string(found));
+    }
+    expect('{');
+    skipWhitespace();
+    bool empty = (pos < end && *pos == '}');
+    if (empty)
+    {
+        pos++;
+    }
+
+    while (!empty)
+    {
+        skipWhitespace();
+        const char *key;
+        size_t keyLength;
+        parseString(key, keyLength);
+        MetadataField field = lookupField(key, keyLength);
+        skipWhitespace();
+        expect(':');
+        skipWhitespace();
+        if (pos >= end)
+        {
+            fail("unexpected end of input");
+        }
+
+        // Later duplicates replace earlier values, as in json.
+        typeErrors &= ~(1u << field);
+        int64_t integer;
+        bool valid = true;
+        switch (field)
+        {
+        case FIELD_UTIME:
+            if ((valid = parseInteger(integer)))
+                o.utime = integer;
+            break;
+        case FIELD_CAM_WIDTH:
+            if ((valid = parseInteger(integer)))
+                o.camWidth = static_cast<int>(integer);
+            break;
+        case FIELD_CAM_HEIGHT:
+            if ((valid = parseInteger(integer)))
+                o.camHeight = static_cast<int>(integer);
+            break;
+        case FIELD_CAM_DEPTH_SCALE:
+            valid = parseDouble(o.camDepthScale);
+            break;
+        case FIELD_IS_COMPRESSED:
+            valid = parseBool(o.isCompressed);
+            break;
+        case FIELD_CAMERA_IDS:
+        case FIELD_CHANNELS:
+        {
+            if (*pos != '[')
+            {
+                valid = false;
+                break;
+            }
+            pos++;
+            skipWhitespace();
+            size_t count = 0;
+            bool closed = (pos < end && *pos == ']');
+            if (closed)
+            {
+                pos++;
+            }
+            while (!closed)
+            {
+                skipWhitespace();
+                if (pos >= end)
+                {
+                    fail("unexpected end of input");
+                }
+                if (field == FIELD_CAMERA_IDS && *pos == '"')
+                {
+                    const char *id;
+                    size_t idLength;
+                    parseString(id, idLength);
+                    // Keep the previous frame's string if the ID is unchanged.
+                    if (count < o.cameraIDs.size())
+                    {
+                        std::string &cached = o.cameraIDs[count];
+                        if (cached.size() != idLength || memcmp(cached.data(), id, idLength) != 0)
+                        {
+                            cached.assign(id, idLength);
+                        }
+                    }
+                    else
+                    {
+                        o.cameraIDs.emplace_back(id, idLength);
+                    }
+                    count++;
+                }
+                else if (field == FIELD_CHANNELS && parseInteger(integer))
+                {
+                    if (count < o.channels.size())
+                    {
+                        o.channels[count] = static_cast<int>(integer);
+                    }
+                    else
+                    {
+                        o.channels.push_back(static_cast<int>(integer));
+                    }
+                    count++;
+                }
+                else
+                {
+                    typeError(field, field == FIELD_CAMERA_IDS ? "string" : "number");
+                    skipValue();
+                }
+
+                skipWhitespace();
+                if (pos < end && *pos == ',')
+                {
+                    pos++;
+                    continue;
+                }
+                expect(']');
+                closed = true;
+            }
+            if (field == FIELD_CAMERA_IDS)
+            {
+                o.cameraIDs.resize(count);
+            }
+            else
+            {
+                o.channels.resize(count);
+            }
+            break;
+        }
+        default:
+            // Fields this client does not know about.
+            skipValue();
+            break;
+        }
+
+        if (!valid)
+        {
+            static const char *const expected[FIELD_COUNT] = {
+                "number", "number", "number", "number", "boolean", "array", "array",
+            };
+            typeError(field, expected[field]);
+            skipValue();
+        }
+        if (field != FIELD_UNKNOWN)
+        {
+            seen |= 1u << field;
+        }
+
+        skipWhitespace();
+        if (pos < end && *pos == ',')
+        {
+            pos++;
+            continue;
+        }
+        expect('}');
+        break;
+    }
+
+    skipWhitespace();
+    if (pos != end)
+    {
+        fail("unexpected data after metadata");
+    }
+
+    for (int field = 0; field < FIELD_COUNT; field++)
+    {
+        if (!(seen & (1u << field)))
+        {
+            throw std::out_of_range("key '" + std::string(kFieldNames[field]) + "' not found");
+        }
+        if (typeErrors & (1u << field))
+        {
+            throw std::domain_error("type must be " + std::string(expectedTypes[field]) +
+                                    ", but is " + foundTypes[field] + " (render metadata field '" +
+                                    kFieldNames[field] + "')");
+        }
+    }
+}
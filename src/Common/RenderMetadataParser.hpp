@@ -0,0 +1,65 @@
+#ifndef FLIGHTGOGGLESRENDERMETADATAPARSER_H
+#define FLIGHTGOGGLESRENDERMETADATAPARSER_H
+/**
+ * @file   RenderMetadataParser.hpp
+ * @brief  Streaming parser for the JSON metadata that starts every frame
+ * from Unity. Fills a RenderMetadata_t in place without building a json DOM.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "jsonMessageSpec.hpp"
+
+class RenderMetadataParser
+{
+  public:
+    /**
+     * @brief Parses the metadata into o, reusing its storage. Camera IDs are
+     * only rewritten when they differ from what o already holds, so parsing
+     * the same cameras every frame does not allocate.
+     *
+     * Errors are reported the same way as json::parse() followed by
+     * from_json(): std::invalid_argument for malformed JSON,
+     * std::out_of_range for missing keys and std::domain_error for values
+     * of the wrong type. o is left partially updated if parsing fails.
+     */
+    void parse(const char *data, size_t size, unity_incoming::RenderMetadata_t &o);
+
+  private:
+    // Reads a JSON string. Returns a pointer to the unescaped contents, which
+    // either point into the input or into scratch if unescaping was needed.
+    void parseString(const char *&contents, size_t &length);
+    // Reads a JSON number. Sets isInteger if it had no fraction or exponent.
+    double parseNumber(int64_t &integerValue, bool &isInteger);
+    // Read a value of the given type. Return false without consuming
+    // anything if the next value has a different type.
+    bool parseBool(bool &value);
+    bool parseInteger(int64_t &value);
+    bool parseDouble(double &value);
+    // Skips over any JSON value.
+    void skipValue();
+    // Checks the UTF-8 sequence starting at pos and moves past it.
+    void skipUtf8Sequence();
+
+    void skipWhitespace();
+    void expect(char c);
+    [[noreturn]] void fail(const char *what);
+
+    // json::parse() validates the whole document before from_json() looks
+    // at any field, so type errors are recorded per field and only reported
+    // once the document turned out to be well formed.
+    void typeError(int field, const char *expected);
+
+    const char *pos = nullptr;
+    const char *end = nullptr;
+    const char *begin = nullptr;
+    std::string scratch;
+
+    unsigned int typeErrors = 0;
+    const char *expectedTypes[8];
+    const char *foundTypes[8];
+};
+
+#endif
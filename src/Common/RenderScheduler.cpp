@@ -0,0 +1,229 @@
+/**
+ * @file   RenderScheduler.cpp
+ * @brief  Deadline driven render request scheduler.
+ */
+
+#include "RenderScheduler.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+// Upper bound on a single sleep, so that stop() does not have to wait out a
+// whole period at low rates.
+const int64_t kMaxSleepNs = 20000000;
+
+int64_t monotonicNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+}
+
+RenderScheduler::~RenderScheduler()
+{
+    stop();
+}
+
+void RenderScheduler::start(double rateHz, Tick tick)
+{
+    if (!(rateHz > 0))
+    {
+        throw std::invalid_argument("Render rate must be positive, got " +
+                                    std::to_string(rateHz));
+    }
+    stop();
+
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats = Stats();
+        startNs = monotonicNs();
+        jitterSumUs = 0;
+        jitterSamples = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        awaitingCompletion = false;
+    }
+    waitForFrames = completionDriven;
+    running = true;
+    thread = std::thread(&RenderScheduler::run, this,
+                         std::max<int64_t>(1, static_cast<int64_t>(1e9 / rateHz)), tick);
+}
+
+void RenderScheduler::stop()
+{
+    if (!running)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        running = false;
+    }
+    completionCondition.notify_all();
+    thread.join();
+}
+
+void RenderScheduler::notifyCompletion()
+{
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        awaitingCompletion = false;
+    }
+    completionCondition.notify_all();
+}
+
+RenderScheduler::Stats RenderScheduler::getStats() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    Stats result = stats;
+    result.meanJitterUs = jitterSamples ? jitterSumUs / jitterSamples : 0;
+    int64_t elapsedNs = monotonicNs() - startNs;
+    result.achievedRate = elapsedNs > 0 ? stats.requests * 1e9 / elapsedNs : 0;
+    return result;
+}
+
+void RenderScheduler::run(int64_t periodNs, Tick tick)
+{
+    int64_t deadline = monotonicNs() + periodNs;
+    int64_t requestSentNs = 0;
+
+    while (running)
+    {
+        // Hold the next request back until the previous frame is in. A frame
+        // that arrives late restarts the deadlines, since catching up would
+        // only mean sending requests back to back.
+        bool stalled = false;
+        if (waitForFrames)
+        {
+            if (!waitForCompletion(requestSentNs + completionTimeoutUs * 1000))
+            {
+                if (!running)
+                {
+                    break;
+                }
+                std::lock_guard<std::mutex> lock(statsMutex);
+                stats.completionTimeouts++;
+            }
+            int64_t now = monotonicNs();
+            if (now > deadline)
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                stats.completionStalls++;
+                stats.missedDeadlines += (now - deadline) / periodNs;
+                deadline = now;
+                stalled = true;
+            }
+        }
+
+        if (!sleepUntil(deadline))
+        {
+            break;
+        }
+        int64_t wakeNs = monotonicNs();
+        if (!stalled)
+        {
+            recordJitter(wakeNs - deadline);
+        }
+
+        // Mark the frame as outstanding before sending, so that a reply that
+        // beats the tick's return is not missed.
+        if (waitForFrames)
+        {
+            std::lock_guard<std::mutex> lock(completionMutex);
+            awaitingCompletion = true;
+        }
+        bool sent = false;
+        try
+        {
+            sent = tick(deadline / 1000);
+        }
+        catch (const std::exception &e)
+        {
+            // A failing update should not stop the render loop.
+            std::cerr << "Render tick failed: " << e.what() << std::endl;
+        }
+        if (waitForFrames && !sent)
+        {
+            std::lock_guard<std::mutex> lock(completionMutex);
+            awaitingCompletion = false;
+        }
+        requestSentNs = wakeNs;
+
+        // Advance on the original grid and skip whatever has passed already.
+        deadline += periodNs;
+        int64_t now = monotonicNs();
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.ticks++;
+        if (sent)
+        {
+            stats.requests++;
+        }
+        if (now >= deadline)
+        {
+            int64_t skipped = (now - deadline) / periodNs + 1;
+            deadline += skipped * periodNs;
+            stats.missedDeadlines += skipped;
+        }
+    }
+}
+
+bool RenderScheduler::sleepUntil(int64_t deadlineNs)
+{
+    while (running)
+    {
+        int64_t target = std::min(deadlineNs, monotonicNs() + kMaxSleepNs);
+        timespec wake;
+        wake.tv_sec = target / 1000000000;
+        wake.tv_nsec = target % 1000000000;
+        // Absolute sleeps are not cut short by signals in a way that loses
+        // time: retrying with the same target just resumes the wait.
+        int err;
+        do
+        {
+            err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr);
+        } while (err == EINTR);
+
+        if (target == deadlineNs)
+        {
+            return running;
+        }
+    }
+    return false;
+}
+
+bool RenderScheduler::waitForCompletion(int64_t deadlineNs)
+{
+    std::unique_lock<std::mutex> lock(completionMutex);
+    while (awaitingCompletion && running)
+    {
+        int64_t remaining = deadlineNs - monotonicNs();
+        if (remaining <= 0)
+        {
+            awaitingCompletion = false;
+            return false;
+        }
+        completionCondition.wait_for(lock, std::chrono::nanoseconds(remaining));
+    }
+    return running;
+}
+
+void RenderScheduler::recordJitter(int64_t latenessNs)
+{
+    double latenessUs = latenessNs / 1e3;
+    std::lock_guard<std::mutex> lock(statsMutex);
+    jitterSumUs += latenessUs;
+    jitterSamples++;
+    stats.maxJitterUs = std::max(stats.maxJitterUs, latenessUs);
+}
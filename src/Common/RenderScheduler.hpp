@@ -0,0 +1,116 @@
+#ifndef FLIGHTGOGGLESRENDERSCHEDULER_H
+#define FLIGHTGOGGLESRENDERSCHEDULER_H
+/**
+ * @file   RenderScheduler.hpp
+ * @brief  Issues render requests on a fixed rate deadline clock, optionally
+ * waiting for each frame to come back before asking for the next one.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Calls a tick function at absolute deadlines on CLOCK_MONOTONIC.
+ *
+ * Deadlines are start + n * period, so unlike sleeping for a period after
+ * each request, the time spent in the tick and wakeup latency do not add
+ * up. Deadlines that have already passed when a tick returns are skipped
+ * and counted instead of being run back to back.
+ *
+ * In completion driven mode, a tick that sent a request is not followed by
+ * another until notifyCompletion() is called, e.g. by the I/O thread on
+ * every received frame. If the frame comes back after the next deadline,
+ * the next request goes out right away and the deadlines restart from there.
+ */
+class RenderScheduler
+{
+  public:
+    // Updates the state and sends a request. Returns true if a request went
+    // out. deadlineUs is the CLOCK_MONOTONIC time in us the tick was due at,
+    // e.g. for sampling poses at the exact frame time.
+    typedef std::function<bool(int64_t deadlineUs)> Tick;
+
+    struct Stats
+    {
+        // Calls of the tick function, and how many of them sent a request.
+        uint64_t ticks = 0;
+        uint64_t requests = 0;
+        // Deadlines skipped because a tick or a frame took too long.
+        uint64_t missedDeadlines = 0;
+        // Ticks that waited for a frame past their deadline.
+        uint64_t completionStalls = 0;
+        // Frames that were given up on after completionTimeoutUs.
+        uint64_t completionTimeouts = 0;
+        // Wakeup lateness relative to the deadline, over ticks that were not
+        // held back by a frame.
+        double meanJitterUs = 0;
+        double maxJitterUs = 0;
+        // Requests per second since start().
+        double achievedRate = 0;
+    };
+
+    RenderScheduler() = default;
+
+    // Stops the scheduler thread if it is running.
+    ~RenderScheduler();
+
+    RenderScheduler(const RenderScheduler &) = delete;
+    RenderScheduler &operator=(const RenderScheduler &) = delete;
+
+    // If true, wait for notifyCompletion() between requests. Takes effect on
+    // the next start().
+    bool completionDriven = false;
+    // How long to wait for a frame in completion driven mode before assuming
+    // it was lost.
+    int64_t completionTimeoutUs = 1e6;
+
+    // Starts a thread that calls tick at rateHz, with the first call one
+    // period from now. Resets the statistics. Throws std::invalid_argument
+    // if rateHz is not positive.
+    void start(double rateHz, Tick tick);
+
+    // Stops and joins the scheduler thread. Returns within a few ms even for
+    // low rates.
+    void stop();
+
+    bool isRunning() const { return running; }
+
+    // Tells the scheduler that a requested frame came back.
+    void notifyCompletion();
+
+    Stats getStats() const;
+
+  private:
+    // Body of the scheduler thread.
+    void run(int64_t periodNs, Tick tick);
+
+    // Sleeps until the absolute CLOCK_MONOTONIC time deadlineNs, or until
+    // stop() is called. Returns false in the latter case.
+    bool sleepUntil(int64_t deadlineNs);
+
+    // Waits for notifyCompletion() until deadlineNs. Returns false on timeout
+    // or stop().
+    bool waitForCompletion(int64_t deadlineNs);
+
+    void recordJitter(int64_t latenessNs);
+
+    std::thread thread;
+    std::atomic<bool> running {false};
+    bool waitForFrames = false;
+
+    std::mutex completionMutex;
+    std::condition_variable completionCondition;
+    bool awaitingCompletion = false;
+
+    mutable std::mutex statsMutex;
+    Stats stats;
+    int64_t startNs = 0;
+    double jitterSumUs = 0;
+    uint64_t jitterSamples = 0;
+};
+
+#endif
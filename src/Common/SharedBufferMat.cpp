@@ -0,0 +1,69 @@
+/**
+ * @file   SharedBufferMat.cpp
+ * @brief  cv::Mat views into buffers owned by someone else, such as a
+ * received ZMQ message, that keep their owner alive.
+ */
+
+#include "SharedBufferMat.hpp"
+
+namespace
+{
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag AccessFlags;
+#else
+typedef int AccessFlags;
+#endif
+
+// A Mat releases its UMatData through the data's allocator once the last Mat
+// referencing it goes away. This one allocates nothing: Mat::create() on a
+// wrapped Mat uses the default allocator for the new pixels, and releasing
+// the wrapped data just drops the reference to its owner.
+class SharedBufferAllocator : public cv::MatAllocator
+{
+  public:
+    cv::UMatData *allocate(int, const int *, int, void *, size_t *, AccessFlags,
+                           cv::UMatUsageFlags) const override
+    {
+        return nullptr;
+    }
+
+    bool allocate(cv::UMatData *, AccessFlags, cv::UMatUsageFlags) const override
+    {
+        return false;
+    }
+
+    void deallocate(cv::UMatData *u) const override
+    {
+        if (!u)
+        {
+            return;
+        }
+        CV_Assert(u->urefcount == 0 && u->refcount == 0);
+        delete static_cast<std::shared_ptr<const void> *>(u->userdata);
+        u->userdata = nullptr;
+        delete u;
+    }
+};
+
+const SharedBufferAllocator sharedBufferAllocator {};
+
+}
+
+cv::Mat makeSharedBufferMat(int rows, int cols, int type, const void *data,
+                            const std::shared_ptr<const void> &owner, size_t step)
+{
+    uint8_t *pixels = static_cast<uint8_t *>(const_cast<void *>(data));
+    // A step of 0 is cv::Mat::AUTO_STEP.
+    cv::Mat image(rows, cols, type, pixels, step);
+
+    cv::UMatData *u = new cv::UMatData(&sharedBufferAllocator);
+    u->data = u->origdata = pixels;
+    u->size = image.step[0] * rows;
+    u->flags |= cv::UMatData::USER_ALLOCATED;
+    u->userdata = new std::shared_ptr<const void>(owner);
+    // The Mat below takes the only reference.
+    u->refcount = 1;
+    image.u = u;
+    return image;
+}
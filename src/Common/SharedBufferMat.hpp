@@ -0,0 +1,21 @@
+#ifndef FLIGHTGOGGLESSHAREDBUFFERMAT_H
+#define FLIGHTGOGGLESSHAREDBUFFERMAT_H
+/**
+ * @file   SharedBufferMat.hpp
+ * @brief  cv::Mat views into buffers owned by someone else, such as a
+ * received ZMQ message, that keep their owner alive.
+ */
+
+#include <memory>
+
+#include <opencv2/core/core.hpp>
+
+// Wraps rows x cols pixels of type at data, with rows step bytes apart (0
+// for packed rows), without copying them. Every Mat sharing the result holds
+// a reference to owner, which is released together with the last of them,
+// like a Mat releases its own pixels. data must stay valid and writable as
+// long as owner lives.
+cv::Mat makeSharedBufferMat(int rows, int cols, int type, const void *data,
+                            const std::shared_ptr<const void> &owner, size_t step = 0);
+
+#endif
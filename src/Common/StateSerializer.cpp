@@ -0,0 +1,479 @@
+/**
+ * @file   StateSerializer.cpp
+ * @brief  DOM free JSON writer for outgoing messages.
+ */
+
+#include "StateSerializer.hpp"
+
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+// Powers of ten that are exactly representable as doubles.
+const double kExactPowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+const int kMaxExactPower = 22;
+
+// Significant digits used by json::dump() (std::numeric_limits<double>::digits10).
+const int kDigits = 15;
+const uint64_t kMinDigitsValue = 100000000000000ULL;  // 10^14
+const uint64_t kMaxDigitsValue = 1000000000000000ULL; // 10^15
+
+// Appends ".0" to numbers that would otherwise read as integers, like json does.
+size_t appendDecimalIfIntLike(char *out, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (out[i] == '.' || out[i] == 'e' || out[i] == 'E')
+        {
+            return len;
+        }
+    }
+    out[len++] = '.';
+    out[len++] = '0';
+    out[len] = '\0';
+    return len;
+}
+
+// Reference implementation, the same as json's numtostr.
+size_t formatDoubleSlow(double x, char *out)
+{
+    int len = snprintf(out, 32, "%.*g", kDigits, x);
+    // Undo locales that use something other than '.' as decimal point.
+    const struct lconv *loc = localeconv();
+    const char decimal_point = (loc && loc->decimal_point) ? loc->decimal_point[0] : '.';
+    if (decimal_point != '\0' && decimal_point != '.')
+    {
+        for (int i = 0; i < len; i++)
+        {
+            if (out[i] == decimal_point)
+            {
+                out[i] = '.';
+                break;
+            }
+        }
+    }
+    return appendDecimalIfIntLike(out, len);
+}
+
+// Scales |x| so that it has kDigits digits before the decimal point.
+// Returns false if that cannot be done with a single correctly rounded
+// multiplication or division.
+bool scaleToDigits(double a, int k, double &scaled)
+{
+    if (k > kMaxExactPower || k < -kMaxExactPower)
+    {
+        return false;
+    }
+    scaled = (k >= 0) ? a * kExactPowersOf10[k] : a / kExactPowersOf10[-k];
+    return true;
+}
+
+}
+
+size_t StateSerializer::formatDouble(double x, char *out)
+{
+    if (x == 0)
+    {
+        size_t len = 0;
+        if (std::signbit(x))
+        {
+            out[len++] = '-';
+        }
+        memcpy(out + len, "0.0", 4);
+        return len + 3;
+    }
+    if (!std::isfinite(x))
+    {
+        // json stores NaN and infinity as null.
+        memcpy(out, "null", 5);
+        return 4;
+    }
+
+    // Find k such that 10^14 <= |x| * 10^k < 10^15.
+    const double a = std::fabs(x);
+    int k = (kDigits - 1) - static_cast<int>(std::floor(std::log10(a)));
+    double scaled;
+    if (!scaleToDigits(a, k, scaled))
+    {
+        return formatDoubleSlow(x, out);
+    }
+    // log10 can be off by one near powers of ten.
+    if (scaled >= static_cast<double>(kMaxDigitsValue))
+    {
+        k--;
+    }
+    else if (scaled < static_cast<double>(kMinDigitsValue))
+    {
+        k++;
+    }
+    if (!scaleToDigits(a, k, scaled))
+    {
+        return formatDoubleSlow(x, out);
+    }
+
+    // scaled is below 2^53, so it is off from the exact product by at most
+    // half an ulp (1/16). Only trust the rounding if the fraction is clearly
+    // away from one half. printf rounds the exact value, so near ties are
+    // left to it.
+    const double whole = std::floor(scaled);
+    const double fraction = scaled - whole;
+    if (std::fabs(fraction - 0.5) < 0.1)
+    {
+        return formatDoubleSlow(x, out);
+    }
+    uint64_t digits = static_cast<uint64_t>(whole) + (fraction > 0.5 ? 1 : 0);
+    // Decimal exponent of the leading digit.
+    int exponent = (kDigits - 1) - k;
+    if (digits >= kMaxDigitsValue)
+    {
+        digits /= 10;
+        exponent++;
+    }
+    if (digits < kMinDigitsValue)
+    {
+        return formatDoubleSlow(x, out);
+    }
+
+    // Unpack the digits and drop trailing zeros, as %g does.
+    char d[kDigits];
+    for (int i = kDigits - 1; i >= 0; i--)
+    {
+        d[i] = static_cast<char>('0' + digits % 10);
+        digits /= 10;
+    }
+    int numDigits = kDigits;
+    while (numDigits > 1 && d[numDigits - 1] == '0')
+    {
+        numDigits--;
+    }
+
+    size_t len = 0;
+    if (x < 0)
+    {
+        out[len++] = '-';
+    }
+
+    if (exponent < -4 || exponent >= kDigits)
+    {
+        // Scientific notation: d.ddde+XX
+        out[len++] = d[0];
+        if (numDigits > 1)
+        {
+            out[len++] = '.';
+            memcpy(out + len, d + 1, numDigits - 1);
+            len += numDigits - 1;
+        }
+        out[len++] = 'e';
+        out[len++] = exponent < 0 ? '-' : '+';
+        int absExponent = exponent < 0 ? -exponent : exponent;
+        if (absExponent >= 100)
+        {
+            out[len++] = static_cast<char>('0' + absExponent / 100);
+        }
+        out[len++] = static_cast<char>('0' + (absExponent / 10) % 10);
+        out[len++] = static_cast<char>('0' + absExponent % 10);
+    }
+    else if (exponent >= 0)
+    {
+        // Fixed notation with exponent + 1 integer digits.
+        int intDigits = exponent + 1;
+        for (int i = 0; i < intDigits; i++)
+        {
+            out[len++] = i < numDigits ? d[i] : '0';
+        }
+        if (numDigits > intDigits)
+        {
+            out[len++] = '.';
+            memcpy(out + len, d + intDigits, numDigits - intDigits);
+            len += numDigits - intDigits;
+        }
+    }
+    else
+    {
+        // Fixed notation below one: 0.000ddd
+        out[len++] = '0';
+        out[len++] = '.';
+        for (int i = 0; i < -exponent - 1; i++)
+        {
+            out[len++] = '0';
+        }
+        memcpy(out + len, d, numDigits);
+        len += numDigits;
+    }
+    out[len] = '\0';
+    return appendDecimalIfIntLike(out, len);
+}
+
+///////////////////////
+// Primitive writers
+///////////////////////
+
+void StateSerializer::writeKey(const char *key)
+{
+    buffer += '"';
+    buffer += key;
+    buffer += "\":";
+}
+
+// Same escaping rules as json::escape_string().
+void StateSerializer::writeString(const std::string &value)
+{
+    static const char hexify[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
+                                    '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+    buffer += '"';
+    for (char c : value)
+    {
+        switch (c)
+        {
+        case '"':
+            buffer += "\\\"";
+            break;
+        case '\\':
+            buffer += "\\\\";
+            break;
+        case '\b':
+            buffer += "\\b";
+            break;
+        case '\f':
+            buffer += "\\f";
+            break;
+        case '\n':
+            buffer += "\\n";
+            break;
+        case '\r':
+            buffer += "\\r";
+            break;
+        case '\t':
+            buffer += "\\t";
+            break;
+        default:
+            if (c >= 0x00 && c <= 0x1f)
+            {
+                buffer += "\\u00";
+                buffer += hexify[c >> 4];
+                buffer += hexify[c & 0x0f];
+            }
+            else
+            {
+                buffer += c;
+            }
+            break;
+        }
+    }
+    buffer += '"';
+}
+
+void StateSerializer::writeBool(bool value)
+{
+    buffer += value ? "true" : "false";
+}
+
+void StateSerializer::writeInt(int64_t value)
+{
+    char digits[24];
+    size_t len = 0;
+    // Work with negative numbers so that INT64_MIN does not overflow.
+    int64_t remaining = value < 0 ? value : -value;
+    do
+    {
+        digits[len++] = static_cast<char>('0' - remaining % 10);
+        remaining /= 10;
+    } while (remaining != 0);
+    if (value < 0)
+    {
+        buffer += '-';
+    }
+    while (len > 0)
+    {
+        buffer += digits[--len];
+    }
+}
+
+void StateSerializer::writeDouble(double value)
+{
+    char text[32];
+    size_t len = formatDouble(value, text);
+    buffer.append(text, len);
+}
+
+void StateSerializer::writeDoubleArray(const double *values, size_t size)
+{
+    buffer += '[';
+    for (size_t i = 0; i < size; i++)
+    {
+        if (i > 0)
+        {
+            buffer += ',';
+        }
+        writeDouble(values[i]);
+    }
+    buffer += ']';
+}
+
+///////////////////////
+// Message writers
+///////////////////////
+
+void StateSerializer::writeCamera(const unity_outgoing::Camera_t &o)
+{
+    buffer += '{';
+    writeKey("ID");
+    writeString(o.ID);
+    buffer += ',';
+    writeKey("channels");
+    writeInt(o.channels);
+    buffer += ',';
+    writeKey("isDepth");
+    writeBool(o.isDepth);
+    buffer += ',';
+    writeKey("outputIndex");
+    writeInt(o.outputIndex);
+    buffer += ',';
+    writeKey("position");
+    writeDoubleArray(o.position);
+    buffer += ',';
+    writeKey("rotation");
+    writeDoubleArray(o.rotation);
+    buffer += '}';
+}
+
+void StateSerializer::writeCameraPose(const unity_outgoing::Camera_t &o)
+{
+    buffer += '{';
+    writeKey("ID");
+    writeString(o.ID);
+    buffer += ',';
+    writeKey("position");
+    writeDoubleArray(o.position);
+    buffer += ',';
+    writeKey("rotation");
+    writeDoubleArray(o.rotation);
+    buffer += '}';
+}
+
+void StateSerializer::writeObject(const unity_outgoing::Object_t &o)
+{
+    buffer += '{';
+    writeKey("ID");
+    writeString(o.ID);
+    buffer += ',';
+    writeKey("position");
+    writeDoubleArray(o.position);
+    buffer += ',';
+    writeKey("prefabID");
+    writeString(o.prefabID);
+    buffer += ',';
+    writeKey("rotation");
+    writeDoubleArray(o.rotation);
+    buffer += ',';
+    writeKey("size");
+    writeDoubleArray(o.size);
+    buffer += '}';
+}
+
+const std::string &StateSerializer::serialize(const unity_outgoing::StateMessage_t &o)
+{
+    buffer.clear();
+    buffer += '{';
+    writeKey("adaptiveEnhance");
+    writeDouble(o.adaptiveEnhance);
+    buffer += ',';
+    writeKey("camDepthScale");
+    writeDouble(o.camDepthScale);
+    buffer += ',';
+    writeKey("camFOV");
+    writeDouble(o.camFOV);
+    buffer += ',';
+    writeKey("camHeight");
+    writeInt(o.camHeight);
+    buffer += ',';
+    writeKey("camWidth");
+    writeInt(o.camWidth);
+    buffer += ',';
+    writeKey("cameras");
+    buffer += '[';
+    for (size_t i = 0; i < o.cameras.size(); i++)
+    {
+        if (i > 0)
+        {
+            buffer += ',';
+        }
+        writeCamera(o.cameras[i]);
+    }
+    buffer += ']';
+    buffer += ',';
+    writeKey("compressImage");
+    writeBool(o.compressImage);
+    buffer += ',';
+    writeKey("hdrResponse");
+    writeDouble(o.hdrResponse);
+    buffer += ',';
+    writeKey("maxFramerate");
+    writeInt(o.maxFramerate);
+    buffer += ',';
+    writeKey("microShimmerReduction");
+    writeDouble(o.microShimmerReduction);
+    buffer += ',';
+    writeKey("objects");
+    buffer += '[';
+    for (size_t i = 0; i < o.objects.size(); i++)
+    {
+        if (i > 0)
+        {
+            buffer += ',';
+        }
+        writeObject(o.objects[i]);
+    }
+    buffer += ']';
+    buffer += ',';
+    writeKey("sceneFilename");
+    writeString(o.sceneFilename);
+    buffer += ',';
+    writeKey("sceneIsInternal");
+    writeBool(o.sceneIsInternal);
+    buffer += ',';
+    writeKey("sharpness");
+    writeDouble(o.sharpness);
+    buffer += ',';
+    writeKey("staticStabilityPower");
+    writeDouble(o.staticStabilityPower);
+    buffer += ',';
+    writeKey("temporalJitterScale");
+    writeDouble(o.temporalJitterScale);
+    buffer += ',';
+    writeKey("temporalStability");
+    writeInt(o.temporalStability);
+    buffer += ',';
+    writeKey("utime");
+    writeInt(o.utime);
+    buffer += '}';
+    return buffer;
+}
+
+const std::string &StateSerializer::serialize(const unity_outgoing::PoseUpdateMessage_t &o)
+{
+    buffer.clear();
+    buffer += '{';
+    writeKey("cameras");
+    buffer += '[';
+    for (size_t i = 0; i < o.state->cameras.size(); i++)
+    {
+        if (i > 0)
+        {
+            buffer += ',';
+        }
+        writeCameraPose(o.state->cameras[i]);
+    }
+    buffer += ']';
+    buffer += ',';
+    writeKey("utime");
+    writeInt(o.state->utime);
+    buffer += '}';
+    return buffer;
+}
@@ -0,0 +1,52 @@
+#ifndef FLIGHTGOGGLESSTATESERIALIZER_H
+#define FLIGHTGOGGLESSTATESERIALIZER_H
+/**
+ * @file   StateSerializer.hpp
+ * @brief  Writes outgoing messages as JSON without building a json DOM.
+ * The output is byte for byte identical to json(message).dump().
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "jsonMessageSpec.hpp"
+
+class StateSerializer
+{
+  public:
+    // Serializes the message into a buffer that is reused by the next call,
+    // so steady state serialization does not allocate.
+    const std::string &serialize(const unity_outgoing::StateMessage_t &o);
+    const std::string &serialize(const unity_outgoing::PoseUpdateMessage_t &o);
+
+    // Formats a double like json::dump() does ("%.15g", plus ".0" for
+    // integral values). Returns the number of characters written to out,
+    // which must hold at least 32 characters.
+    static size_t formatDouble(double x, char *out);
+
+  private:
+    // Writers for the fields listed in the to_json() functions of
+    // jsonMessageSpec.hpp. json objects keep their keys sorted, so every
+    // writer emits keys in std::string order rather than declaration order.
+    void writeCamera(const unity_outgoing::Camera_t &o);
+    void writeCameraPose(const unity_outgoing::Camera_t &o);
+    void writeObject(const unity_outgoing::Object_t &o);
+
+    void writeKey(const char *key);
+    void writeString(const std::string &value);
+    void writeBool(bool value);
+    void writeInt(int64_t value);
+    void writeDouble(double value);
+    void writeDoubleArray(const double *values, size_t size);
+    template <size_t N>
+    void writeDoubleArray(const std::array<double, N> &values)
+    {
+        writeDoubleArray(values.data(), N);
+    }
+
+    std::string buffer;
+};
+
+#endif
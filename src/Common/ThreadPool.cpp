@@ -0,0 +1,135 @@
+/**
+ * @file   ThreadPool.cpp
+ * @brief  Fixed size worker pool.
+ */
+
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t numThreads)
+{
+    for (size_t i = 0; i < numThreads; i++)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        stopping = true;
+    }
+    tasksAvailable.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        tasks.push_back(std::move(task));
+    }
+    tasksAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(tasksMutex);
+            tasksAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+            // Drain the queue before exiting.
+            if (tasks.empty())
+            {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+namespace
+{
+
+// State shared between the participants of one parallelFor() call.
+struct ParallelForJob
+{
+    size_t n;
+    const std::function<void(size_t)> *fn;
+    std::atomic<size_t> nextIndex{0};
+    size_t numDone = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable allDone;
+
+    // Claims and runs indices until none are left.
+    void run()
+    {
+        size_t i;
+        while ((i = nextIndex.fetch_add(1)) < n)
+        {
+            std::exception_ptr thrown;
+            try
+            {
+                (*fn)(i);
+            }
+            catch (...)
+            {
+                thrown = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (thrown && !error)
+            {
+                error = thrown;
+            }
+            if (++numDone == n)
+            {
+                allDone.notify_all();
+            }
+        }
+    }
+};
+
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)> &fn)
+{
+    if (n == 0)
+    {
+        return;
+    }
+
+    // Helpers may still be queued when the caller returns, so the job is
+    // reference counted.
+    std::shared_ptr<ParallelForJob> job = std::make_shared<ParallelForJob>();
+    job->n = n;
+    job->fn = &fn;
+
+    // The calling thread takes part too, so at most n - 1 helpers are needed.
+    size_t numHelpers = std::min(workers.size(), n - 1);
+    for (size_t i = 0; i < numHelpers; i++)
+    {
+        enqueue([job] { job->run(); });
+    }
+    job->run();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->allDone.wait(lock, [&job] { return job->numDone == job->n; });
+    if (job->error)
+    {
+        std::rethrow_exception(job->error);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef FLIGHTGOGGLESTHREADPOOL_H
+#define FLIGHTGOGGLESTHREADPOOL_H
+/**
+ * @file   ThreadPool.hpp
+ * @brief  Fixed size worker pool used to spread per-frame work (e.g. decoding
+ * several camera images) across cores.
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+  public:
+    // Starts numThreads workers.
+    explicit ThreadPool(size_t numThreads);
+
+    // Finishes queued tasks and joins all workers.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Queues a task to be run by one of the workers.
+    void enqueue(std::function<void()> task);
+
+    // Runs fn(i) for every i in [0, n) on the workers and the calling thread.
+    // Blocks until all calls have returned. If any call throws, the first
+    // exception is rethrown here.
+    void parallelFor(size_t n, const std::function<void(size_t)> &fn);
+
+    // Number of worker threads.
+    size_t size() const { return workers.size(); }
+
+  private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex tasksMutex;
+    std::condition_variable tasksAvailable;
+    bool stopping = false;
+};
+
+#endif
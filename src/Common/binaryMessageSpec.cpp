@@ -0,0 +1,310 @@
+/**
+ * @file   binaryMessageSpec.cpp
+ * @brief  Encoders and decoders for binary pose updates and frame metadata.
+ */
+
+#include "binaryMessageSpec.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+
+const char kPoseUpdateMagic[4] = {'F', 'G', 'P', 'U'};
+const char kRenderMetadataMagic[4] = {'F', 'G', 'R', 'M'};
+const char kPingMagic[4] = {'F', 'G', 'P', 'I'};
+const char kPongMagic[4] = {'F', 'G', 'P', 'O'};
+
+// Fixed size little-endian stores and loads. On little-endian hosts these
+// compile down to plain unaligned moves.
+template <typename T>
+void storeLE(char *out, T value)
+{
+    static_assert(sizeof(T) <= 8, "unsupported field size");
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(out, &bits, sizeof(T));
+#else
+    for (size_t i = 0; i < sizeof(T); i++)
+    {
+        out[i] = static_cast<char>((bits >> (8 * i)) & 0xFF);
+    }
+#endif
+}
+
+template <typename T>
+T loadLE(const char *in)
+{
+    static_assert(sizeof(T) <= 8, "unsupported field size");
+    uint64_t bits = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&bits, in, sizeof(T));
+#else
+    for (size_t i = 0; i < sizeof(T); i++)
+    {
+        bits |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+#endif
+    T value;
+    memcpy(&value, &bits, sizeof(T));
+    return value;
+}
+
+}
+
+namespace unity_outgoing
+{
+
+bool encodeBinaryPoseUpdate(const StateMessage_t &state, std::string &out)
+{
+    if (state.cameras.size() > UINT16_MAX)
+    {
+        return false;
+    }
+
+    out.resize(binaryPoseUpdateSize(state.cameras.size()));
+    char *p = &out[0];
+    memcpy(p, kPoseUpdateMagic, sizeof(kPoseUpdateMagic));
+    storeLE<uint16_t>(p + 4, kBinaryPoseUpdateVersion);
+    storeLE<uint16_t>(p + 6, static_cast<uint16_t>(state.cameras.size()));
+    storeLE<int64_t>(p + 8, state.utime);
+    p += kBinaryPoseUpdateHeaderSize;
+
+    for (const Camera_t &cam : state.cameras)
+    {
+        for (size_t i = 0; i < 3; i++)
+        {
+            storeLE<double>(p + 8 * i, cam.position[i]);
+        }
+        for (size_t i = 0; i < 4; i++)
+        {
+            storeLE<double>(p + 24 + 8 * i, cam.rotation[i]);
+        }
+        p += kBinaryPoseUpdateCameraSize;
+    }
+    return true;
+}
+
+void applyBinaryPoseUpdate(const void *data, size_t size, StateMessage_t &state)
+{
+    const char *p = static_cast<const char *>(data);
+    if (size < kBinaryPoseUpdateHeaderSize ||
+        memcmp(p, kPoseUpdateMagic, sizeof(kPoseUpdateMagic)) != 0)
+    {
+        throw std::invalid_argument("Not a binary pose update");
+    }
+    uint16_t version = loadLE<uint16_t>(p + 4);
+    if (version != kBinaryPoseUpdateVersion)
+    {
+        throw std::invalid_argument("Unsupported binary pose update version " +
+                                    std::to_string(version));
+    }
+    size_t numCameras = loadLE<uint16_t>(p + 6);
+    if (size != binaryPoseUpdateSize(numCameras))
+    {
+        throw std::invalid_argument("Binary pose update has " + std::to_string(size) +
+                                    " bytes, expected " +
+                                    std::to_string(binaryPoseUpdateSize(numCameras)));
+    }
+    if (numCameras != state.cameras.size())
+    {
+        throw std::invalid_argument("Binary pose update has " + std::to_string(numCameras) +
+                                    " cameras, but the scene has " +
+                                    std::to_string(state.cameras.size()));
+    }
+
+    state.utime = loadLE<int64_t>(p + 8);
+    p += kBinaryPoseUpdateHeaderSize;
+    for (Camera_t &cam : state.cameras)
+    {
+        for (size_t i = 0; i < 3; i++)
+        {
+            cam.position[i] = loadLE<double>(p + 8 * i);
+        }
+        for (size_t i = 0; i < 4; i++)
+        {
+            cam.rotation[i] = loadLE<double>(p + 24 + 8 * i);
+        }
+        p += kBinaryPoseUpdateCameraSize;
+    }
+}
+
+void encodePing(const Ping_t &ping, std::string &out)
+{
+    out.assign(kPingSize, '\0');
+    char *p = &out[0];
+    memcpy(p, kPingMagic, sizeof(kPingMagic));
+    storeLE<uint16_t>(p + 4, kPingVersion);
+    storeLE<int64_t>(p + 8, ping.sequence);
+    storeLE<int64_t>(p + 16, ping.clientSendUtime);
+}
+
+void decodePing(const void *data, size_t size, Ping_t &ping)
+{
+    const char *p = static_cast<const char *>(data);
+    if (size != kPingSize || memcmp(p, kPingMagic, sizeof(kPingMagic)) != 0)
+    {
+        throw std::invalid_argument("Not a ping");
+    }
+    uint16_t version = loadLE<uint16_t>(p + 4);
+    if (version != kPingVersion)
+    {
+        throw std::invalid_argument("Unsupported ping version " + std::to_string(version));
+    }
+    ping.sequence = loadLE<int64_t>(p + 8);
+    ping.clientSendUtime = loadLE<int64_t>(p + 16);
+}
+
+}
+
+namespace unity_incoming
+{
+
+bool isBinaryRenderMetadata(const void *data, size_t size)
+{
+    return size >= sizeof(kRenderMetadataMagic) &&
+           memcmp(data, kRenderMetadataMagic, sizeof(kRenderMetadataMagic)) == 0;
+}
+
+void encodeBinaryRenderMetadata(const RenderMetadata_t &o, std::string &out)
+{
+    size_t numCameras = o.cameraIDs.size();
+    if (o.channels.size() != numCameras || numCameras > UINT16_MAX)
+    {
+        throw std::invalid_argument("Cannot encode metadata for " + std::to_string(numCameras) +
+                                    " camera IDs and " + std::to_string(o.channels.size()) +
+                                    " channel counts");
+    }
+    size_t size = kBinaryRenderMetadataHeaderSize + numCameras * kBinaryRenderMetadataCameraSize;
+    for (const std::string &id : o.cameraIDs)
+    {
+        size += id.size();
+    }
+
+    out.assign(size, '\0');
+    char *p = &out[0];
+    memcpy(p, kRenderMetadataMagic, sizeof(kRenderMetadataMagic));
+    storeLE<uint16_t>(p + 4, kBinaryRenderMetadataVersion);
+    storeLE<uint16_t>(p + 6, static_cast<uint16_t>(numCameras));
+    storeLE<int64_t>(p + 8, o.utime);
+    storeLE<int32_t>(p + 16, o.camWidth);
+    storeLE<int32_t>(p + 20, o.camHeight);
+    storeLE<double>(p + 24, o.camDepthScale);
+    p[32] = o.isCompressed ? 1 : 0;
+
+    char *table = p + kBinaryRenderMetadataHeaderSize;
+    char *ids = table + numCameras * kBinaryRenderMetadataCameraSize;
+    for (size_t i = 0; i < numCameras; i++)
+    {
+        const std::string &id = o.cameraIDs[i];
+        storeLE<int32_t>(table, o.channels[i]);
+        storeLE<uint32_t>(table + 4, static_cast<uint32_t>(id.size()));
+        memcpy(ids, id.data(), id.size());
+        table += kBinaryRenderMetadataCameraSize;
+        ids += id.size();
+    }
+}
+
+void decodeBinaryRenderMetadata(const void *data, size_t size, RenderMetadata_t &o)
+{
+    const char *p = static_cast<const char *>(data);
+    if (size < kBinaryRenderMetadataHeaderSize || !isBinaryRenderMetadata(data, size))
+    {
+        throw std::invalid_argument("Binary render metadata is truncated");
+    }
+    uint16_t version = loadLE<uint16_t>(p + 4);
+    if (version != kBinaryRenderMetadataVersion)
+    {
+        throw std::invalid_argument("Unsupported binary render metadata version " +
+                                    std::to_string(version));
+    }
+    size_t numCameras = loadLE<uint16_t>(p + 6);
+    // The table size cannot overflow, as numCameras is only 16 bits wide.
+    size_t tableEnd = kBinaryRenderMetadataHeaderSize + numCameras * kBinaryRenderMetadataCameraSize;
+    if (size < tableEnd)
+    {
+        throw std::invalid_argument("Binary render metadata camera table is truncated");
+    }
+
+    // Check all ID lengths before touching o.
+    size_t idsSize = 0;
+    for (size_t i = 0; i < numCameras; i++)
+    {
+        size_t length = loadLE<uint32_t>(p + kBinaryRenderMetadataHeaderSize +
+                                         i * kBinaryRenderMetadataCameraSize + 4);
+        if (length > size - tableEnd - idsSize)
+        {
+            throw std::invalid_argument("Binary render metadata camera IDs are truncated");
+        }
+        idsSize += length;
+    }
+    if (tableEnd + idsSize != size)
+    {
+        throw std::invalid_argument("Binary render metadata has " +
+                                    std::to_string(size - tableEnd - idsSize) +
+                                    " trailing bytes");
+    }
+
+    o.utime = loadLE<int64_t>(p + 8);
+    o.camWidth = loadLE<int32_t>(p + 16);
+    o.camHeight = loadLE<int32_t>(p + 20);
+    o.camDepthScale = loadLE<double>(p + 24);
+    o.isCompressed = p[32] != 0;
+
+    o.cameraIDs.resize(numCameras);
+    o.channels.resize(numCameras);
+    const char *table = p + kBinaryRenderMetadataHeaderSize;
+    const char *id = p + tableEnd;
+    for (size_t i = 0; i < numCameras; i++)
+    {
+        o.channels[i] = loadLE<int32_t>(table);
+        size_t length = loadLE<uint32_t>(table + 4);
+        // Keep the previous frame's string if the ID is unchanged.
+        std::string &cached = o.cameraIDs[i];
+        if (cached.size() != length || memcmp(cached.data(), id, length) != 0)
+        {
+            cached.assign(id, length);
+        }
+        table += kBinaryRenderMetadataCameraSize;
+        id += length;
+    }
+}
+
+bool isPong(const void *data, size_t size)
+{
+    return size >= sizeof(kPongMagic) && memcmp(data, kPongMagic, sizeof(kPongMagic)) == 0;
+}
+
+void encodePong(const Pong_t &pong, std::string &out)
+{
+    out.assign(kPongSize, '\0');
+    char *p = &out[0];
+    memcpy(p, kPongMagic, sizeof(kPongMagic));
+    storeLE<uint16_t>(p + 4, kPongVersion);
+    storeLE<int64_t>(p + 8, pong.sequence);
+    storeLE<int64_t>(p + 16, pong.clientSendUtime);
+    storeLE<int64_t>(p + 24, pong.rendererReceiveUtime);
+    storeLE<int64_t>(p + 32, pong.rendererSendUtime);
+}
+
+void decodePong(const void *data, size_t size, Pong_t &pong)
+{
+    const char *p = static_cast<const char *>(data);
+    if (size != kPongSize || !isPong(data, size))
+    {
+        throw std::invalid_argument("Not a pong");
+    }
+    uint16_t version = loadLE<uint16_t>(p + 4);
+    if (version != kPongVersion)
+    {
+        throw std::invalid_argument("Unsupported pong version " + std::to_string(version));
+    }
+    pong.sequence = loadLE<int64_t>(p + 8);
+    pong.clientSendUtime = loadLE<int64_t>(p + 16);
+    pong.rendererReceiveUtime = loadLE<int64_t>(p + 24);
+    pong.rendererSendUtime = loadLE<int64_t>(p + 32);
+}
+
+}
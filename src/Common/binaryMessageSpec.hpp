@@ -0,0 +1,176 @@
+#ifndef BINARYMESSAGESPEC_H
+#define BINARYMESSAGESPEC_H
+/**
+ * @file   binaryMessageSpec.hpp
+ * @brief  Defines binary alternatives to the JSON messages going to and from
+ * Unity: pose updates on their own topic, and frame metadata that is told
+ * apart from JSON metadata by its magic. Also defines the pings used to
+ * estimate the renderer's clock offset.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "jsonMessageSpec.hpp"
+
+namespace unity_outgoing
+{
+
+// Topic of binary pose updates.
+const char *const kBinaryPoseUpdateTopic = "PoseBinary";
+
+// Bumped whenever the layout below changes.
+const uint16_t kBinaryPoseUpdateVersion = 1;
+
+/*
+ * Layout, all fields little-endian and without padding:
+ *
+ *   offset  size  field
+ *   0       4     magic, the characters "FGPU"
+ *   4       2     uint16 version
+ *   6       2     uint16 number of cameras
+ *   8       8     int64 utime
+ *   16      56    per camera: float64 position[3], float64 rotation[4]
+ *
+ * Cameras are in the order of the last full StateMessage_t, which also
+ * supplies their IDs. Like the JSON "PoseUpdate", it is only valid between
+ * full states with the same static settings.
+ */
+const size_t kBinaryPoseUpdateHeaderSize = 16;
+const size_t kBinaryPoseUpdateCameraSize = 56;
+
+inline size_t binaryPoseUpdateSize(size_t numCameras)
+{
+  return kBinaryPoseUpdateHeaderSize + numCameras * kBinaryPoseUpdateCameraSize;
+}
+
+// Encodes the timestamp and camera poses of state into out, reusing its
+// storage. Returns false, leaving out untouched, if there are more cameras
+// than the format can hold.
+bool encodeBinaryPoseUpdate(const StateMessage_t &state, std::string &out);
+
+// Renderer side. Applies a binary pose update to the last full state the
+// renderer received. Throws std::invalid_argument if the message is
+// truncated, has an unknown version or does not match the cameras of state.
+void applyBinaryPoseUpdate(const void *data, size_t size, StateMessage_t &state);
+
+// Topic of clock pings.
+const char *const kPingTopic = "Ping";
+
+// Bumped whenever the layout below changes.
+const uint16_t kPingVersion = 1;
+
+/*
+ * Layout, all fields little-endian and without padding:
+ *
+ *   offset  size  field
+ *   0       4     magic, the characters "FGPI"
+ *   4       2     uint16 version
+ *   6       2     reserved, zero
+ *   8       8     int64 sequence number
+ *   16      8     int64 client send time
+ *
+ * The renderer answers each ping with a unity_incoming::Pong_t.
+ */
+const size_t kPingSize = 24;
+
+struct Ping_t
+{
+  int64_t sequence = 0;
+  // On the client's monotonic clock.
+  int64_t clientSendUtime = 0;
+};
+
+void encodePing(const Ping_t &ping, std::string &out);
+
+// Renderer side. Throws std::invalid_argument if the message is not a ping
+// of a known version.
+void decodePing(const void *data, size_t size, Ping_t &ping);
+
+}
+
+namespace unity_incoming
+{
+
+// Bumped whenever the layout below changes.
+const uint16_t kBinaryRenderMetadataVersion = 1;
+
+/*
+ * Layout, all fields little-endian and without padding:
+ *
+ *   offset  size  field
+ *   0       4     magic, the characters "FGRM"
+ *   4       2     uint16 version
+ *   6       2     uint16 number of cameras
+ *   8       8     int64 utime
+ *   16      4     int32 camWidth
+ *   20      4     int32 camHeight
+ *   24      8     float64 camDepthScale
+ *   32      1     uint8 isCompressed
+ *   33      7     reserved, zero
+ *   40      8     per camera: int32 channels, uint32 length of its ID
+ *   ...           camera IDs, concatenated in camera order
+ *
+ * The magic can never start a JSON document, so both kinds of metadata can
+ * share the first message part.
+ */
+const size_t kBinaryRenderMetadataHeaderSize = 40;
+const size_t kBinaryRenderMetadataCameraSize = 8;
+
+// True if the metadata starts with the binary magic.
+bool isBinaryRenderMetadata(const void *data, size_t size);
+
+// Renderer side. Encodes o into out, reusing its storage. Throws
+// std::invalid_argument if o has different numbers of IDs and channels.
+void encodeBinaryRenderMetadata(const RenderMetadata_t &o, std::string &out);
+
+// Decodes binary metadata into o, reusing its storage like
+// RenderMetadataParser does. Every read is bounds checked. Throws
+// std::invalid_argument if the metadata is truncated, has trailing bytes or
+// has an unknown version.
+void decodeBinaryRenderMetadata(const void *data, size_t size, RenderMetadata_t &o);
+
+// Bumped whenever the layout below changes.
+const uint16_t kPongVersion = 1;
+
+/*
+ * Layout, all fields little-endian and without padding:
+ *
+ *   offset  size  field
+ *   0       4     magic, the characters "FGPO"
+ *   4       2     uint16 version
+ *   6       2     reserved, zero
+ *   8       8     int64 sequence number of the ping
+ *   16      8     int64 client send time of the ping
+ *   24      8     int64 renderer receive time
+ *   32      8     int64 renderer send time
+ *
+ * Sent as a single part message on the frame socket. The magic tells it
+ * apart from frame metadata.
+ */
+const size_t kPongSize = 40;
+
+struct Pong_t
+{
+  int64_t sequence = 0;
+  // Echoed from the ping.
+  int64_t clientSendUtime = 0;
+  // On the renderer's clock.
+  int64_t rendererReceiveUtime = 0;
+  int64_t rendererSendUtime = 0;
+};
+
+// True if the message part starts with the pong magic.
+bool isPong(const void *data, size_t size);
+
+// Renderer side.
+void encodePong(const Pong_t &pong, std::string &out);
+
+// Throws std::invalid_argument if the message is not a pong of a known
+// version.
+void decodePong(const void *data, size_t size, Pong_t &pong);
+
+}
+
+#endif
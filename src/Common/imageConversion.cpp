@@ -0,0 +1,312 @@
+/**
+ * @file   imageConversion.cpp
+ * @brief  Scalar and SIMD implementations of the raw image conversion kernels.
+ * Kernels are picked at runtime based on the features of the running CPU.
+ */
+
+#include "imageConversion.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMAGE_CONVERSION_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define IMAGE_CONVERSION_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace image_conversion
+{
+
+namespace
+{
+
+// Converts a single row of `width` pixels.
+typedef void (*RowKernel)(const uint8_t *src, uint8_t *dst, size_t width);
+
+struct KernelSet
+{
+    // 3-channel RGB -> 3-channel BGR.
+    RowKernel rgbToBgr;
+    // 3-channel RGB -> 1-channel (first channel).
+    RowKernel firstOfThree;
+    const char *name;
+};
+
+///////////////////////
+// Scalar kernels
+///////////////////////
+
+void rgbToBgrRowScalar(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    for (size_t x = 0; x < width; x++)
+    {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        src += 3;
+        dst += 3;
+    }
+}
+
+void firstOfThreeRowScalar(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    for (size_t x = 0; x < width; x++)
+    {
+        dst[x] = src[x * 3];
+    }
+}
+
+// Handles any channel combination that does not have a dedicated kernel.
+void genericRowScalar(const uint8_t *src, int srcChannels, uint8_t *dst,
+                      int dstChannels, size_t width)
+{
+    for (size_t x = 0; x < width; x++)
+    {
+        for (int c = 0; c < dstChannels; c++)
+        {
+            // Only swap channels for RGB -> BGR.
+            int src_c = (dstChannels == 3) ? 2 - c : c;
+            dst[c] = src[src_c];
+        }
+        src += srcChannels;
+        dst += dstChannels;
+    }
+}
+
+///////////////////////
+// x86 kernels
+///////////////////////
+
+#ifdef IMAGE_CONVERSION_X86
+
+__attribute__((target("ssse3")))
+void rgbToBgrRowSSSE3(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    size_t x = 0;
+    // Each step converts 5 pixels but loads and stores 16 bytes. The garbage
+    // 16th byte is overwritten by the next step.
+    for (; x + 6 <= width; x += 5)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 3), _mm_shuffle_epi8(v, mask));
+    }
+    rgbToBgrRowScalar(src + x * 3, dst + x * 3, width - x);
+}
+
+__attribute__((target("ssse3")))
+void firstOfThreeRowSSSE3(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    const __m128i mask_a = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i mask_b = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i mask_c = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    size_t x = 0;
+    // 16 pixels per step.
+    for (; x + 16 <= width; x += 16)
+    {
+        const __m128i *in = reinterpret_cast<const __m128i *>(src + x * 3);
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(in), mask_a);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(in + 1), mask_b);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(in + 2), mask_c);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x),
+                         _mm_or_si128(_mm_or_si128(a, b), c));
+    }
+    firstOfThreeRowScalar(src + x * 3, dst + x, width - x);
+}
+
+// AVX2 shuffles cannot cross 128-bit lanes, so both kernels run two
+// independent copies of the SSSE3 shuffle, one per lane.
+__attribute__((target("avx2")))
+void rgbToBgrRowAVX2(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15,
+                                          2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    size_t x = 0;
+    // 10 pixels per step, touching 31 bytes.
+    for (; x + 11 <= width; x += 10)
+    {
+        const uint8_t *in = src + x * 3;
+        uint8_t *out = dst + x * 3;
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 15));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_shuffle_epi8(v, mask);
+        // Store the low lane first so that its garbage byte is overwritten.
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm256_castsi256_si128(v));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 15), _mm256_extracti128_si256(v, 1));
+    }
+    rgbToBgrRowScalar(src + x * 3, dst + x * 3, width - x);
+}
+
+__attribute__((target("avx2")))
+void firstOfThreeRowAVX2(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    const __m256i mask_a = _mm256_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                            0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i mask_b = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1,
+                                            -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m256i mask_c = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13,
+                                            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    size_t x = 0;
+    // 32 pixels per step. The low lane handles the first 16 pixels.
+    for (; x + 32 <= width; x += 32)
+    {
+        const __m128i *in = reinterpret_cast<const __m128i *>(src + x * 3);
+        __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(in)),
+                                            _mm_loadu_si128(in + 3), 1);
+        __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(in + 1)),
+                                            _mm_loadu_si128(in + 4), 1);
+        __m256i c = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(in + 2)),
+                                            _mm_loadu_si128(in + 5), 1);
+        __m256i v = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, mask_a),
+                                                    _mm256_shuffle_epi8(b, mask_b)),
+                                    _mm256_shuffle_epi8(c, mask_c));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x), v);
+    }
+    firstOfThreeRowSSSE3(src + x * 3, dst + x, width - x);
+}
+
+#endif
+
+///////////////////////
+// NEON kernels
+///////////////////////
+
+#ifdef IMAGE_CONVERSION_NEON
+
+void rgbToBgrRowNEON(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x3_t v = vld3q_u8(src + x * 3);
+        uint8x16_t r = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = r;
+        vst3q_u8(dst + x * 3, v);
+    }
+    rgbToBgrRowScalar(src + x * 3, dst + x * 3, width - x);
+}
+
+void firstOfThreeRowNEON(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x3_t v = vld3q_u8(src + x * 3);
+        vst1q_u8(dst + x, v.val[0]);
+    }
+    firstOfThreeRowScalar(src + x * 3, dst + x, width - x);
+}
+
+#endif
+
+///////////////////////
+// Dispatch
+///////////////////////
+
+// Kernel sets the running CPU supports, fastest first.
+std::vector<KernelSet> supportedKernelSets()
+{
+    std::vector<KernelSet> sets;
+#if defined(IMAGE_CONVERSION_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        sets.push_back(KernelSet{rgbToBgrRowAVX2, firstOfThreeRowAVX2, "avx2"});
+    }
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        sets.push_back(KernelSet{rgbToBgrRowSSSE3, firstOfThreeRowSSSE3, "ssse3"});
+    }
+#elif defined(IMAGE_CONVERSION_NEON)
+    sets.push_back(KernelSet{rgbToBgrRowNEON, firstOfThreeRowNEON, "neon"});
+#endif
+    sets.push_back(KernelSet{rgbToBgrRowScalar, firstOfThreeRowScalar, "scalar"});
+    return sets;
+}
+
+const KernelSet &kernels()
+{
+    // Thread safe one-time initialization.
+    static const KernelSet selected = supportedKernelSets().front();
+    return selected;
+}
+
+// flipAndSwizzle() with the kernels of k.
+void convert(const KernelSet &k, const uint8_t *src, int srcChannels,
+             uint8_t *dst, size_t dstStep, int dstChannels,
+             int width, int height)
+{
+    const size_t srcStep = static_cast<size_t>(width) * srcChannels;
+
+    for (int y = 0; y < height; y++)
+    {
+        // Images that come from Unity are Y-inverted, so read rows bottom up.
+        const uint8_t *srcRow = src + static_cast<size_t>(height - y - 1) * srcStep;
+        uint8_t *dstRow = dst + static_cast<size_t>(y) * dstStep;
+
+        if (srcChannels == 3 && dstChannels == 3)
+        {
+            k.rgbToBgr(srcRow, dstRow, width);
+        }
+        else if (srcChannels == 3 && dstChannels == 1)
+        {
+            k.firstOfThree(srcRow, dstRow, width);
+        }
+        else if (srcChannels == dstChannels)
+        {
+            memcpy(dstRow, srcRow, srcStep);
+        }
+        else
+        {
+            genericRowScalar(srcRow, srcChannels, dstRow, dstChannels, width);
+        }
+    }
+}
+
+}
+
+void flipAndSwizzle(const uint8_t *src, int srcChannels,
+                    uint8_t *dst, size_t dstStep, int dstChannels,
+                    int width, int height)
+{
+    convert(kernels(), src, srcChannels, dst, dstStep, dstChannels, width, height);
+}
+
+void flipAndSwizzleWith(const std::string &kernel,
+                        const uint8_t *src, int srcChannels,
+                        uint8_t *dst, size_t dstStep, int dstChannels,
+                        int width, int height)
+{
+    for (const KernelSet &k : supportedKernelSets())
+    {
+        if (kernel == k.name)
+        {
+            convert(k, src, srcChannels, dst, dstStep, dstChannels, width, height);
+            return;
+        }
+    }
+    throw std::invalid_argument("Image conversion kernel " + kernel +
+                                " is not supported on this CPU");
+}
+
+const char *kernelName()
+{
+    return kernels().name;
+}
+
+std::vector<std::string> supportedKernels()
+{
+    std::vector<std::string> names;
+    for (const KernelSet &k : supportedKernelSets())
+    {
+        names.push_back(k.name);
+    }
+    return names;
+}
+
+}
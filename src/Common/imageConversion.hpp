@@ -0,0 +1,54 @@
+#ifndef IMAGECONVERSION_H
+#define IMAGECONVERSION_H
+/**
+ * @file   imageConversion.hpp
+ * @brief  Pixel kernels for converting raw FlightGoggles images into the
+ * upright, BGR ordered layout expected by OpenCV.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace image_conversion
+{
+
+/**
+ * @brief Converts a raw image from Unity into an OpenCV compatible image in a
+ * single pass. Rows are flipped (Unity images are Y-inverted), 3-channel
+ * output is swizzled from RGB to BGR, and 1-channel output keeps only the
+ * first input channel.
+ *
+ * The fastest kernel supported by the running CPU is selected on first use.
+ *
+ * @param src          Tightly packed input image (width * srcChannels bytes per row).
+ * @param srcChannels  Channels per input pixel.
+ * @param dst          Output image.
+ * @param dstStep      Bytes per output row.
+ * @param dstChannels  Channels per output pixel. Must be 1 or srcChannels.
+ * @param width        Image width in pixels.
+ * @param height       Image height in pixels.
+ */
+void flipAndSwizzle(const uint8_t *src, int srcChannels,
+                    uint8_t *dst, size_t dstStep, int dstChannels,
+                    int width, int height);
+
+// Name of the kernel set selected for this CPU ("avx2", "ssse3", "neon" or "scalar").
+const char *kernelName();
+
+// Names of the kernel sets the running CPU supports, fastest first. The last
+// one is always "scalar".
+std::vector<std::string> supportedKernels();
+
+// flipAndSwizzle() with the named kernel set instead of the selected one, for
+// tests and benchmarks. Throws std::invalid_argument if the running CPU does
+// not support it.
+void flipAndSwizzleWith(const std::string &kernel,
+                        const uint8_t *src, int srcChannels,
+                        uint8_t *dst, size_t dstStep, int dstChannels,
+                        int width, int height);
+
+}
+
+#endif
@@ -11,6 +11,9 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <array>
+#include <memory>
+#include <stdexcept>
 #include <opencv2/opencv.hpp>
 #include "json.hpp"
 using json = nlohmann::json;
@@ -24,8 +27,10 @@ struct Camera_t
   // Position and rotation use Unity left-handed coordinates.
   // Z North, X East, Y up.
   // E.G. East, Up, North.
-  std::vector<double> position;
-  std::vector<double> rotation;
+  // Stored inline so that pose updates do not allocate.
+  std::array<double, 3> position {{0, 0, 0}};
+  // Quaternion as x, y, z, w.
+  std::array<double, 4> rotation {{0, 0, 0, 1}};
   // Metadata
   int channels;
   bool isDepth;
@@ -37,10 +42,10 @@ struct Object_t
 {
   std::string ID;
   std::string prefabID;
-  std::vector<double> position;
-  std::vector<double> rotation;
+  std::array<double, 3> position {{0, 0, 0}};
+  std::array<double, 4> rotation {{0, 0, 0, 1}};
   // Metadata
-  std::vector<double> size;
+  std::array<double, 3> size {{1, 1, 1}};
 };
 
 struct StateMessage_t
@@ -79,6 +84,68 @@ struct StateMessage_t
   std::vector<Object_t> objects;
 };
 
+// Compact per-frame update. Carries only what usually changes between frames,
+// i.e. the timestamp and the camera poses. Sent on the "PoseUpdate" topic
+// instead of a full StateMessage_t when nothing else has changed.
+struct PoseUpdateMessage_t
+{
+  const StateMessage_t *state;
+};
+
+// True if a and b only differ in their timestamp and camera poses, so that a
+// PoseUpdateMessage_t is enough to turn one into the other.
+inline bool hasSameStaticSettings(const StateMessage_t &a, const StateMessage_t &b)
+{
+  if (!(a.maxFramerate == b.maxFramerate &&
+        a.sceneIsInternal == b.sceneIsInternal &&
+        a.sceneFilename == b.sceneFilename &&
+        a.compressImage == b.compressImage &&
+        a.camWidth == b.camWidth &&
+        a.camHeight == b.camHeight &&
+        a.camFOV == b.camFOV &&
+        a.camDepthScale == b.camDepthScale &&
+        a.temporalJitterScale == b.temporalJitterScale &&
+        a.temporalStability == b.temporalStability &&
+        a.hdrResponse == b.hdrResponse &&
+        a.sharpness == b.sharpness &&
+        a.adaptiveEnhance == b.adaptiveEnhance &&
+        a.microShimmerReduction == b.microShimmerReduction &&
+        a.staticStabilityPower == b.staticStabilityPower &&
+        a.cameras.size() == b.cameras.size() &&
+        a.objects.size() == b.objects.size()))
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < a.cameras.size(); i++)
+  {
+    const Camera_t &cam_a = a.cameras[i];
+    const Camera_t &cam_b = b.cameras[i];
+    if (!(cam_a.ID == cam_b.ID &&
+          cam_a.channels == cam_b.channels &&
+          cam_a.isDepth == cam_b.isDepth &&
+          cam_a.outputIndex == cam_b.outputIndex))
+    {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < a.objects.size(); i++)
+  {
+    const Object_t &obj_a = a.objects[i];
+    const Object_t &obj_b = b.objects[i];
+    if (!(obj_a.ID == obj_b.ID &&
+          obj_a.prefabID == obj_b.prefabID &&
+          obj_a.position == obj_b.position &&
+          obj_a.rotation == obj_b.rotation &&
+          obj_a.size == obj_b.size))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
 // Json constructors
 
 // StateMessage_t
@@ -119,6 +186,20 @@ inline void to_json(json &j, const Camera_t &o)
            {"outputIndex", o.outputIndex}};
 }
 
+// PoseUpdateMessage_t
+inline void to_json(json &j, const PoseUpdateMessage_t &o)
+{
+  json cameras = json::array();
+  for (const Camera_t &cam : o.state->cameras)
+  {
+    cameras.push_back(json{{"ID", cam.ID},
+                           {"position", cam.position},
+                           {"rotation", cam.rotation}});
+  }
+  j = json{{"utime", o.state->utime},
+           {"cameras", cameras}};
+}
+
 // Object_t
 inline void to_json(json &j, const Object_t &o)
   {
@@ -130,6 +211,83 @@ inline void to_json(json &j, const Object_t &o)
       {"size", o.size}
     };
   }
+
+// Json Parsers (renderer side, e.g. for the mock renderer)
+
+template <size_t N>
+inline void from_json_array(const json &j, std::array<double, N> &o)
+{
+  if (!j.is_array() || j.size() != N)
+  {
+    throw std::invalid_argument("Expected an array of " + std::to_string(N) + " numbers");
+  }
+  for (size_t i = 0; i < N; i++)
+  {
+    o[i] = j[i].get<double>();
+  }
+}
+
+// Camera_t
+inline void from_json(const json &j, Camera_t &o)
+{
+  o.ID = j.at("ID").get<std::string>();
+  from_json_array(j.at("position"), o.position);
+  from_json_array(j.at("rotation"), o.rotation);
+  o.channels = j.at("channels").get<int>();
+  o.isDepth = j.at("isDepth").get<bool>();
+  o.outputIndex = j.at("outputIndex").get<int>();
+}
+
+// Object_t
+inline void from_json(const json &j, Object_t &o)
+{
+  o.ID = j.at("ID").get<std::string>();
+  o.prefabID = j.at("prefabID").get<std::string>();
+  from_json_array(j.at("position"), o.position);
+  from_json_array(j.at("rotation"), o.rotation);
+  from_json_array(j.at("size"), o.size);
+}
+
+// StateMessage_t
+inline void from_json(const json &j, StateMessage_t &o)
+{
+  o.maxFramerate = j.at("maxFramerate").get<int>();
+  o.sceneIsInternal = j.at("sceneIsInternal").get<bool>();
+  o.sceneFilename = j.at("sceneFilename").get<std::string>();
+  o.compressImage = j.at("compressImage").get<bool>();
+  o.temporalJitterScale = j.at("temporalJitterScale").get<float>();
+  o.temporalStability = j.at("temporalStability").get<int>();
+  o.hdrResponse = j.at("hdrResponse").get<float>();
+  o.sharpness = j.at("sharpness").get<float>();
+  o.adaptiveEnhance = j.at("adaptiveEnhance").get<float>();
+  o.microShimmerReduction = j.at("microShimmerReduction").get<float>();
+  o.staticStabilityPower = j.at("staticStabilityPower").get<float>();
+  o.utime = j.at("utime").get<int64_t>();
+  o.camWidth = j.at("camWidth").get<int>();
+  o.camHeight = j.at("camHeight").get<int>();
+  o.camFOV = j.at("camFOV").get<float>();
+  o.camDepthScale = j.at("camDepthScale").get<double>();
+  o.cameras = j.at("cameras").get<std::vector<Camera_t>>();
+  o.objects = j.at("objects").get<std::vector<Object_t>>();
+}
+
+// Applies a "PoseUpdate" to the last full state. Throws
+// std::invalid_argument if it does not match the cameras of state.
+inline void applyPoseUpdate(const json &j, StateMessage_t &state)
+{
+  const json &cameras = j.at("cameras");
+  if (!cameras.is_array() || cameras.size() != state.cameras.size())
+  {
+    throw std::invalid_argument("Pose update does not match the " +
+                                std::to_string(state.cameras.size()) + " cameras of the scene");
+  }
+  state.utime = j.at("utime").get<int64_t>();
+  for (size_t i = 0; i < cameras.size(); i++)
+  {
+    from_json_array(cameras[i].at("position"), state.cameras[i].position);
+    from_json_array(cameras[i].at("rotation"), state.cameras[i].rotation);
+  }
+}
 }
 
 // Struct for returning metadata from Unity.
@@ -163,11 +321,46 @@ inline void from_json(const json &j, RenderMetadata_t &o)
   o.channels = j.at("channels").get<std::vector<int>>();
 }
 
+// Json constructors (renderer side)
+
+// RenderMetadata_t
+inline void to_json(json &j, const RenderMetadata_t &o)
+{
+  j = json{{"utime", o.utime},
+           {"camWidth", o.camWidth},
+           {"camHeight", o.camHeight},
+           {"camDepthScale", o.camDepthScale},
+           {"isCompressed", o.isCompressed},
+           {"cameraIDs", o.cameraIDs},
+           {"channels", o.channels}};
+}
+
+// Client timestamps, in FlightGogglesClient::getMonotonicTimestamp() time,
+// of the stages a frame went through. Zero for stages it did not go through,
+// e.g. requestSent for a frame that matched no request.
+struct FrameTiming_t
+{
+  int64_t requestSent = 0;
+  int64_t received = 0;
+  int64_t parsed = 0;
+  int64_t decoded = 0;
+  int64_t dispatched = 0;
+};
+
 // Struct for outputting parsed received messages to handler functions
 struct RenderOutput_t
 {
   RenderMetadata_t renderMetadata;
   std::vector<cv::Mat> images;
+  // True if images are zero-copy views into the received message. Raw images
+  // are still Y-inverted and RGB ordered, see FlightGogglesClient::finalizeImage().
+  // Each one keeps the message alive for as long as it is kept, and may be
+  // written to, as nothing else reads the message once it is decoded.
+  bool imagesAreRaw = false;
+  // State of the request this frame answers. Null if the frame could not be
+  // matched to a request sent by this client.
+  std::shared_ptr<const unity_outgoing::StateMessage_t> requestState;
+  FrameTiming_t timing;
 };
 }
 
@@ -29,7 +29,107 @@ typedef Eigen::Quaternion<double> Quaternionx;
 typedef Eigen::Affine3d Transform3;
 typedef Eigen::Matrix4d Matrix4;
 typedef Eigen::Matrix3d Matrix3;
-Eigen::IOFormat CSV(PRECISION, DONTALIGNCOLS, ",", ",", "", "", "", "");
+static Eigen::IOFormat CSV(PRECISION, DONTALIGNCOLS, ",", ",", "", "", "", "");
+
+////////////////////////////////
+// AXIS PERMUTATIONS
+////////////////////////////////
+
+/**
+ * @brief A signed permutation of the x, y and z axes, fixed at compile time.
+ *
+ * Each parameter names the input axis (1 = x, 2 = y, 3 = z) that becomes
+ * the corresponding output axis, negated to flip its sign. E.g.
+ * AxisPermutation<2, 1, -3> maps (x, y, z) to (y, x, -z). Applying one is
+ * a swizzle with sign flips instead of a dense matrix product.
+ *
+ * For finite inputs, the results equal the products with matrix().
+ */
+template <int A0, int A1, int A2>
+struct AxisPermutation
+{
+    static_assert((A0 < 0 ? -A0 : A0) + (A1 < 0 ? -A1 : A1) + (A2 < 0 ? -A2 : A2) == 6 &&
+                      (A0 < 0 ? -A0 : A0) * (A1 < 0 ? -A1 : A1) * (A2 < 0 ? -A2 : A2) == 6,
+                  "AxisPermutation needs each of the axes 1, 2 and 3 exactly once");
+
+    // Parameter for output axis i.
+    static constexpr int code(int i) { return i == 0 ? A0 : (i == 1 ? A1 : A2); }
+    // Input axis (0 based) that becomes output axis i.
+    static constexpr int source(int i) { return (code(i) < 0 ? -code(i) : code(i)) - 1; }
+    // Sign applied to output axis i.
+    static constexpr double sign(int i) { return code(i) < 0 ? -1.0 : 1.0; }
+    // +1 for rotations, -1 for reflections.
+    static constexpr int determinant()
+    {
+        return (source(1) == (source(0) + 1) % 3 ? 1 : -1) *
+               ((A0 < 0) != (A1 < 0) ? -1 : 1) * (A2 < 0 ? -1 : 1);
+    }
+
+    // The equivalent homogeneous matrix P.
+    static Matrix4 matrix()
+    {
+        Matrix4 P = Matrix4::Zero();
+        for (int i = 0; i < 3; i++)
+        {
+            P(i, source(i)) = sign(i);
+        }
+        P(3, 3) = 1;
+        return P;
+    }
+
+    // P * v
+    static Vector3 apply(const Vector3 &v)
+    {
+        return Vector3(sign(0) * v[source(0)], sign(1) * v[source(1)], sign(2) * v[source(2)]);
+    }
+
+    // P * pose * P^T, i.e. the pose expressed in the permuted axes.
+    static Transform3 conjugate(const Transform3 &pose)
+    {
+        Transform3 out;
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                out.linear()(i, j) = sign(i) * sign(j) * pose.linear()(source(i), source(j));
+            }
+        }
+        out.translation() = apply(pose.translation());
+        out.makeAffine();
+        return out;
+    }
+
+    // Quaternion of P * R * P^T for the rotation R of q. The rotation axis is
+    // a pseudovector, so it flips along with reflections: (w, det(P) * P * v).
+    static Quaternionx conjugate(const Quaternionx &q)
+    {
+        Vector3 v = static_cast<double>(determinant()) * apply(q.vec());
+        return Quaternionx(q.w(), v[0], v[1], v[2]);
+    }
+};
+
+/**
+ * @brief The permutation that applies First and then Second, as
+ * ComposedAxisPermutation<First, Second>::type.
+ */
+template <typename First, typename Second>
+struct ComposedAxisPermutation
+{
+    typedef AxisPermutation<(Second::code(0) < 0 ? -1 : 1) * First::code(Second::source(0)),
+                            (Second::code(1) < 0 ? -1 : 1) * First::code(Second::source(1)),
+                            (Second::code(2) < 0 ? -1 : 1) * First::code(Second::source(2))>
+        type;
+};
+
+// x->y, y->x, z->-z
+typedef AxisPermutation<2, 1, -3> ENUToNED;
+// x->z, y->x, z->-y
+typedef AxisPermutation<2, -3, 1> NEDToUnity;
+// ROS global (ENU) coordinates straight to Unity coordinates.
+typedef ComposedAxisPermutation<ENUToNED, NEDToUnity>::type ENUToUnity;
+// Moves from a z aligned camera to a x aligned camera when applied from the
+// right.
+typedef AxisPermutation<2, 3, 1> CameraToUnityCamera;
 
 /**
  * @brief Converts right hand rule North East Down (NED) global poses to 
@@ -38,26 +138,11 @@ Eigen::IOFormat CSV(PRECISION, DONTALIGNCOLS, ",", ",", "", "", "", "");
  * @param NEDworld_T_object 
  * @return Transform3 
  */
-Transform3 convertNEDGlobalPoseToGlobalUnityCoordinates(
+inline Transform3 convertNEDGlobalPoseToGlobalUnityCoordinates(
     Transform3 NEDworld_T_object)
 {
     // Switch axis to unity axis.
-    Matrix4 unity_pose_T_NED_pose;
-    // x->z, y->x, z->-y
-    // clang-format off
-    unity_pose_T_NED_pose <<    0, 1, 0,  0,
-                                0, 0, -1, 0,
-                                1, 0, 0,  0,
-                                0, 0, 0,  1;
-    // clang-format on
-
-    Transform3 unity_pose;
-
-    unity_pose.matrix() = unity_pose_T_NED_pose * 
-                          NEDworld_T_object.matrix() *
-                          unity_pose_T_NED_pose.transpose();
-
-    return unity_pose;
+    return NEDToUnity::conjugate(NEDworld_T_object);
 }
 
 /**
@@ -72,26 +157,14 @@ Transform3 convertNEDGlobalPoseToGlobalUnityCoordinates(
  * @param unityWorld_T_NEDworld 
  * @return Transform3 
  */
-Transform3 convertNEDGlobalPoseToGlobalUnityCoordinates(
+inline Transform3 convertNEDGlobalPoseToGlobalUnityCoordinates(
     Transform3 NEDworld_T_object, Transform3 unityWorld_T_NEDworld)
 {
+    Transform3 unityWorld_T_object;
+    unityWorld_T_object.matrix() = unityWorld_T_NEDworld.matrix() * NEDworld_T_object.matrix();
+
     // Switch axis to unity axis.
-    Matrix4 unity_pose_T_NED_pose;
-    // x->z, y->x, z->-y
-    // clang-format off
-    unity_pose_T_NED_pose <<    0, 1, 0,  0,
-                                0, 0, -1, 0,
-                                1, 0, 0,  0,
-                                0, 0, 0,  1;
-    // clang-format on
-
-    Transform3 unity_pose;
-
-    unity_pose.matrix() = unity_pose_T_NED_pose * unityWorld_T_NEDworld.matrix() *
-                          NEDworld_T_object.matrix() *
-                          unity_pose_T_NED_pose.transpose();
-
-    return unity_pose;
+    return NEDToUnity::conjugate(unityWorld_T_object);
 }
 
 /**
@@ -103,20 +176,10 @@ Transform3 convertNEDGlobalPoseToGlobalUnityCoordinates(
  * @param ENUworld_T_object 
  * @return Transform3 
  */
-Transform3 convertROSToNEDCoordinates(Transform3 ENUworld_T_object)
+inline Transform3 convertROSToNEDCoordinates(Transform3 ENUworld_T_object)
 {
     // Switch ENU axis to NED axis.
-    Matrix4 ENU_pose_T_NED_pose;
-    // x->y, y->x, z->-z, w->w
-    // clang-format off
-    ENU_pose_T_NED_pose <<  0, 1, 0,  0,
-                            1, 0, 0,  0,
-                            0, 0, -1, 0,
-                            0, 0, 0,  1;
-    // clang-format on
-
-    Transform3 NED_pose;
-    NED_pose.matrix() = ENU_pose_T_NED_pose * ENUworld_T_object.matrix() * ENU_pose_T_NED_pose.transpose();
+    Transform3 NED_pose = ENUToNED::conjugate(ENUworld_T_object);
 
     // Rotate robot pose by -90deg about robot z axis since ROS
     // expects that "X" is forward in robot frame.
@@ -128,6 +191,31 @@ Transform3 convertROSToNEDCoordinates(Transform3 ENUworld_T_object)
     return NED_pose;
 }
 
+/**
+ * @brief Converts ROS global poses straight to Unity left handed coordinates.
+ * Same as convertNEDGlobalPoseToGlobalUnityCoordinates() applied to the
+ * result of convertROSToNEDCoordinates(), in a single swizzle.
+ *
+ * @param ENUworld_T_object
+ * @return Transform3
+ */
+inline Transform3 convertROSToUnityCoordinates(const Transform3 &ENUworld_T_object)
+{
+    return ENUToUnity::conjugate(ENUworld_T_object);
+}
+
+/**
+ * @brief Quaternion form of convertROSToUnityCoordinates(), for orientations
+ * that never need to go through a rotation matrix.
+ *
+ * @param ENUworld_R_object
+ * @return Quaternionx
+ */
+inline Quaternionx convertROSToUnityCoordinates(const Quaternionx &ENUworld_R_object)
+{
+    return ENUToUnity::conjugate(ENUworld_R_object);
+}
+
 // Converts a given LCM drone pose and relative camera pose into a global Unity
 // pose for the camera.
 /* Move world_T_cam from drone (right handed) coordinate system to Unity (left
@@ -137,43 +225,22 @@ transformations:
 Unity coordinates -> Drone coordinates -> perform rotation -> unity
 coordinates
 */
-Transform3 convertCameraAndDronePoseToUnityCoordinates(
+inline Transform3 convertCameraAndDronePoseToUnityCoordinates(
     Transform3 world_T_body, Transform3 body_T_cam,
     Transform3 unityWorld_T_NEDworld)
 {
 
     Transform3 world_T_cam = world_T_body * body_T_cam;
-    Matrix4 cam_T_unitycam;
-    // clang-format off
-    cam_T_unitycam <<   0, 1, 0, 0,
-                        0, 0, 1, 0,
-                        1, 0, 0, 0,
-                        0, 0, 0, 1;
-    // clang-format on
 
+    // Move from z aligned camera to x aligned camera
     Transform3 world_T_unitycam;
-    world_T_unitycam.matrix() =
-        world_T_cam *
-        cam_T_unitycam; // Move from z aligned camera to x aligned camera
-
-    // x->z, y->x, z->-y
-    Matrix4
-        unity_from_drone; /**< Coordinate change from drone coordinate system to
-                            unity coordinate system */
-    // clang-format off
-    unity_from_drone << 0, 1,  0, 0,
-                        0, 0, -1, 0,
-                        1, 0,  0, 0,
-                        0, 0,  0, 1;
-    // clang-format on
-
-    Transform3 unityWorld_T_unitycam_unity; /**< Transformation from camera to
-                                                world in unity coordinates */
-    unityWorld_T_unitycam_unity.matrix() =
-        unity_from_drone * unityWorld_T_NEDworld.matrix() *
-        world_T_unitycam.matrix() * unity_from_drone.transpose();
-
-    return unityWorld_T_unitycam_unity;
+    world_T_unitycam.matrix() = world_T_cam.matrix() * CameraToUnityCamera::matrix();
+
+    Transform3 unityWorld_T_unitycam;
+    unityWorld_T_unitycam.matrix() = unityWorld_T_NEDworld.matrix() * world_T_unitycam.matrix();
+
+    // Coordinate change from drone coordinate system to unity coordinate system
+    return NEDToUnity::conjugate(unityWorld_T_unitycam);
 }
 
 #endif
\ No newline at end of file
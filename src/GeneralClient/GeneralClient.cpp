@@ -1,8 +1,8 @@
 /**
  * @file   GeneralClient.cpp
  * @author Winter Guerra
- * @brief  Pulls images from Unity and saves them as PNGs
- *space.
+ * @brief  Pulls images from Unity and saves them as PNGs to the directory
+ * given as the first argument.
  **/
 
 #include "GeneralClient.hpp"
@@ -23,31 +23,13 @@ GeneralClient::GeneralClient(){
 // Example consumers and publishers
 ////////////////////////////////////
 
-void imageConsumer(GeneralClient *self){
-    while (true){
-      // Wait for render result (blocking).
-      unity_incoming::RenderOutput_t renderOutput = self->flightGoggles.handleImageResponse();
-
-      // Display result
-      if (SHOW_DEBUG_IMAGE_FEED){
-        cv::imshow("Debug RGB", renderOutput.images[0]);
-        cv::imshow("Debug D", renderOutput.images[1]);
-        cv::waitKey(1);
-      }
-    }
-}
-
-void posePublisher(GeneralClient *self){
-  // Sends render requests to FlightGoggles indefinitely
-  while (true){
-    // Update camera position
-    self->updateCameraTrajectory();
-    // Update timestamp of state message (needed to force FlightGoggles to rerender scene)
-    self->flightGoggles.state.utime = self->flightGoggles.getTimestamp();
-    // request render
-    self->flightGoggles.requestRender();
-    // Throttle requests to framerate.
-    usleep(1e6/self->flightGoggles.state.maxFramerate);
+// Called by the FlightGogglesClient I/O thread for every rendered frame.
+void imageConsumer(const unity_incoming::RenderOutput_t &renderOutput){
+    // Display result
+    if (SHOW_DEBUG_IMAGE_FEED){
+      cv::imshow("Debug RGB", renderOutput.images[0]);
+      cv::imshow("Debug D", renderOutput.images[1]);
+      cv::waitKey(1);
     }
 }
 
@@ -82,19 +64,34 @@ void GeneralClient::updateCameraTrajectory(){
   // Set rotation matrix using pitch, roll, yaw
   camera_pose.linear() = Eigen::AngleAxisd(theta-M_PI, Eigen::Vector3d(0,0,1)).toRotationMatrix();
 
-  // Populate status message with new pose
-  flightGoggles.setCameraPoseUsingROSCoordinates(camera_pose, 0);
-  flightGoggles.setCameraPoseUsingROSCoordinates(camera_pose, 1);
+  // Populate status message with new pose. Both cameras and the timestamp
+  // are published together so that the renderer never sees half an update.
+  flightGoggles.updateState([&](unity_outgoing::StateMessage_t &state) {
+    FlightGogglesClient::setCameraPoseUsingROSCoordinates(state, camera_pose, 0);
+    FlightGogglesClient::setCameraPoseUsingROSCoordinates(state, camera_pose, 1);
+    // Update timestamp of state message (needed to force FlightGoggles to rerender scene)
+    state.utime = flightGoggles.getTimestamp();
+  });
 }
 
 ///////////////////////
 // Example Client Node
 ///////////////////////
 
-int main() {
+int main(int argc, char **argv) {
   // Create client
   GeneralClient generalClient;
 
+  // Save frames to the directory given on the command line. Encoding and
+  // writing happen on the sink's workers, so the dispatch thread only queues
+  // them and capture runs at the full render rate.
+  if (argc > 1) {
+    FrameSink::Settings sinkSettings;
+    sinkSettings.directory = argv[1];
+    sinkSettings.numThreads = std::max(2u, std::thread::hardware_concurrency() / 2);
+    generalClient.frameSink.reset(new FrameSink(sinkSettings));
+  }
+
   // Instantiate RGBD cameras
   generalClient.addCameras();
 
@@ -111,15 +108,41 @@ int main() {
    */
   generalClient.flightGoggles.state.sceneFilename = "Hazelwood_Loft_Full_Night";
   
-  // Fork sample render request thread
-  // will request a simple circular trajectory
-  std::thread posePublisherThread(posePublisher, &generalClient);
-
-  // Fork a sample image consumer thread
-  std::thread imageConsumerThread(imageConsumer, &generalClient);
-
-  // Spin
-  while (true) {sleep(1);}
+  // Register a sample image consumer and start receiving images.
+  // Only show the newest frame if the display falls behind.
+  generalClient.flightGoggles.frameQueuePolicy = FrameDropPolicy::KeepLatest;
+  generalClient.flightGoggles.addRenderOutputCallback(imageConsumer);
+  if (generalClient.frameSink) {
+    FrameSink *frameSink = generalClient.frameSink.get();
+    generalClient.flightGoggles.addRenderOutputCallback(
+        [frameSink](const unity_incoming::RenderOutput_t &renderOutput) {
+          frameSink->submit(renderOutput);
+        });
+  }
+  generalClient.flightGoggles.start();
+
+  // Request a simple circular trajectory at maxFramerate. Deadlines are
+  // absolute, so the rate does not drift with the time spent per request.
+  generalClient.flightGoggles.startRenderScheduler([&generalClient](int64_t) {
+    generalClient.updateCameraTrajectory();
+    return true;
+  });
+
+  // Spin, reporting how well the scheduler keeps up.
+  while (true) {
+    sleep(1);
+    RenderScheduler::Stats stats = generalClient.flightGoggles.renderScheduler.getStats();
+    std::cout << "Request rate: " << stats.achievedRate
+              << " jitter_us: " << stats.meanJitterUs << " (max " << stats.maxJitterUs << ")"
+              << " missed: " << stats.missedDeadlines << std::endl;
+    if (generalClient.frameSink) {
+      FrameSink::Stats sinkStats = generalClient.frameSink->getStats();
+      std::cout << "Saved: " << sinkStats.framesWritten
+                << " queued: " << sinkStats.queueDepth
+                << " dropped: " << sinkStats.framesDropped
+                << " MB/s: " << sinkStats.megabytesPerSecond << std::endl;
+    }
+  }
 
   return 0;
 }
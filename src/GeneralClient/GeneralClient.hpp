@@ -7,15 +7,22 @@
  */
 
 #include <FlightGogglesClient.hpp>
+#include <FrameSink.hpp>
 // #include <jsonMessageSpec.hpp>
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 #include <thread>
 
 class GeneralClient {
  public:
+  // Saves every frame to disk if an output directory was given. Declared
+  // before flightGoggles so that it is destroyed after the client's threads,
+  // whose render output callbacks submit to it, have stopped.
+  std::unique_ptr<FrameSink> frameSink;
+
   // FlightGoggles interface object
   FlightGogglesClient flightGoggles;
 
@@ -0,0 +1,268 @@
+/**
+ * @file   MockRenderer.cpp
+ * @brief  Answers FlightGoggles render requests with synthetic frames so that
+ * clients can be benchmarked on machines without Unity or a GPU.
+ **/
+
+#include "MockRenderer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+// Requests that arrive while this many are queued are dropped, like a
+// renderer that cannot keep up.
+static const size_t kMaxPendingFrames = 64;
+
+
+///////////////////////
+// Renderer
+///////////////////////
+
+void MockRenderer::connect() {
+  std::cout << "Connecting to " << client_address << "..." << std::endl;
+  pose_socket.connect(client_address + ":" + upload_port);
+  pose_socket.subscribe("");
+  frame_socket.connect(client_address + ":" + download_port);
+  std::cout << "Done!" << std::endl;
+}
+
+int64_t MockRenderer::getTimestamp() {
+  return std::chrono::steady_clock::now().time_since_epoch() / std::chrono::microseconds(1);
+}
+
+void MockRenderer::run() {
+  zmqpp::poller poller;
+  poller.add(pose_socket);
+
+  int64_t lastStatsUtime = getTimestamp();
+  uint64_t lastFramesSent = 0;
+
+  while (true) {
+    // Sleep until the next frame is due or a request comes in.
+    long timeoutMs = 100;
+    if (!pending.empty()) {
+      timeoutMs = std::max<int64_t>(0, pending.front().dueUtime - getTimestamp()) / 1000;
+    }
+    if (poller.poll(timeoutMs) && poller.has_input(pose_socket)) {
+      zmqpp::message msg;
+      pose_socket.receive(msg);
+      handleMessage(msg, getTimestamp());
+    } else if (!pending.empty()) {
+      // poll() only has ms resolution, so sleep off the rest.
+      int64_t remaining = pending.front().dueUtime - getTimestamp();
+      if (remaining > 0) {
+        usleep(remaining);
+      }
+    }
+
+    int64_t now = getTimestamp();
+    while (!pending.empty() && pending.front().dueUtime <= now) {
+      sendFrame(pending.front().state);
+      pending.pop_front();
+    }
+
+    // Output debug at 1hz
+    if (now > lastStatsUtime + 1e6) {
+      std::cout << "Frame rate: " << (framesSent - lastFramesSent) * 1e6 / (now - lastStatsUtime)
+                << " pending: " << pending.size()
+                << " dropped: " << requestsDropped << std::endl;
+      lastStatsUtime = now;
+      lastFramesSent = framesSent;
+    }
+  }
+}
+
+void MockRenderer::handleMessage(const zmqpp::message &msg, int64_t receivedUtime) {
+  try {
+    std::string topic = msg.get<std::string>(0);
+    if (topic == "Pose") {
+      state = json::parse(msg.get<std::string>(1)).get<unity_outgoing::StateMessage_t>();
+      hasState = true;
+    } else if (topic == "PoseUpdate" || topic == unity_outgoing::kBinaryPoseUpdateTopic) {
+      // Pose updates only make sense on top of a full state.
+      if (!hasState) {
+        requestsDropped++;
+        return;
+      }
+      if (topic == "PoseUpdate") {
+        unity_outgoing::applyPoseUpdate(json::parse(msg.get<std::string>(1)), state);
+      } else {
+        unity_outgoing::applyBinaryPoseUpdate(msg.raw_data(1), msg.size(1), state);
+      }
+    } else if (topic == unity_outgoing::kPingTopic) {
+      unity_outgoing::Ping_t ping;
+      unity_outgoing::decodePing(msg.raw_data(1), msg.size(1), ping);
+      unity_incoming::Pong_t pong;
+      pong.sequence = ping.sequence;
+      pong.clientSendUtime = ping.clientSendUtime;
+      pong.rendererReceiveUtime = receivedUtime;
+      pong.rendererSendUtime = getTimestamp();
+      unity_incoming::encodePong(pong, pongBuffer);
+      zmqpp::message reply;
+      reply.add_raw(pongBuffer.data(), pongBuffer.size());
+      frame_socket.send(reply);
+      return;
+    } else {
+      return;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Dropping malformed request: " << e.what() << std::endl;
+    requestsDropped++;
+    return;
+  }
+
+  // Dropped requests never take up a frame slot, or the schedule would
+  // drift further ahead with every request the queue turns away.
+  if (pending.size() >= kMaxPendingFrames) {
+    requestsDropped++;
+    return;
+  }
+
+  // Frames come out no earlier than the injected latency, and no closer
+  // together than the frame rate allows.
+  int64_t dueUtime = receivedUtime + latencyUs;
+  if (maxRate > 0) {
+    dueUtime = std::max<int64_t>(dueUtime, lastDueUtime + 1e6 / maxRate);
+  }
+  lastDueUtime = dueUtime;
+  pending.push_back(PendingFrame{dueUtime, state});
+}
+
+void MockRenderer::sendFrame(const unity_outgoing::StateMessage_t &request) {
+  int width = widthOverride > 0 ? widthOverride : request.camWidth;
+  int height = heightOverride > 0 ? heightOverride : request.camHeight;
+  size_t numRequested = request.cameras.size();
+  size_t numCameras = cameraCountOverride > 0 ? cameraCountOverride : numRequested;
+
+  unity_incoming::RenderMetadata_t metadata;
+  metadata.utime = request.utime;
+  metadata.camWidth = width;
+  metadata.camHeight = height;
+  metadata.camDepthScale = request.camDepthScale;
+  metadata.isCompressed = false;
+  for (size_t i = 0; i < numCameras; i++) {
+    if (numRequested == 0) {
+      metadata.cameraIDs.push_back("Camera_" + std::to_string(i));
+      metadata.channels.push_back(3);
+      continue;
+    }
+    // Extra cameras repeat the requested ones under a new ID.
+    const unity_outgoing::Camera_t &cam = request.cameras[i % numRequested];
+    metadata.cameraIDs.push_back(i < numRequested ? cam.ID
+                                                  : cam.ID + "_" + std::to_string(i));
+    metadata.channels.push_back(std::max(1, cam.channels));
+  }
+
+  zmqpp::message msg;
+  if (binaryMetadata) {
+    unity_incoming::encodeBinaryRenderMetadata(metadata, metadataBuffer);
+    msg.add_raw(metadataBuffer.data(), metadataBuffer.size());
+  } else {
+    msg << json(metadata).dump();
+  }
+
+  imageCache.resize(numCameras);
+  size_t rowSize = static_cast<size_t>(width);
+  for (size_t i = 0; i < numCameras; i++) {
+    int channels = metadata.channels[i];
+    CachedImage &cached = imageCache[i];
+    if (cached.width != width || cached.height != height || cached.channels != channels ||
+        cached.cam_index != i) {
+      drawTestPattern(cached.pixels, width, height, channels, i);
+      cached.width = width;
+      cached.height = height;
+      cached.channels = channels;
+      cached.cam_index = i;
+    }
+    std::string &image = cached.pixels;
+    // Stamp the utime into the start of the top row, which Unity sends last,
+    // so that clients can check which request a frame answers.
+    size_t stampSize = std::min(sizeof(request.utime), rowSize * channels);
+    if (height > 0) {
+      memcpy(&image[(height - 1) * rowSize * channels], &request.utime, stampSize);
+    }
+    msg.add_raw(image.data(), image.size());
+  }
+
+  frame_socket.send(msg);
+  framesSent++;
+}
+
+void MockRenderer::drawTestPattern(std::string &image, int width, int height, int channels,
+                                   size_t cam_index) {
+  image.resize(static_cast<size_t>(width) * height * channels);
+  for (int y = 0; y < height; y++) {
+    // Unity reads images back bottom row first.
+    char *row = &image[static_cast<size_t>(height - 1 - y) * width * channels];
+    for (int x = 0; x < width; x++) {
+      for (int c = 0; c < channels; c++) {
+        // Red grows to the right, green and single channel images grow
+        // downwards, blue tells cameras apart.
+        int value;
+        if (channels == 1 || c == 1) {
+          value = y * 256 / height;
+        } else if (c == 0) {
+          value = x * 256 / width;
+        } else if (c == 2) {
+          value = static_cast<int>(cam_index * 64);
+        } else {
+          value = 255;
+        }
+        row[x * channels + c] = static_cast<char>(value & 0xFF);
+      }
+    }
+  }
+}
+
+
+///////////////////////
+// Mock Renderer Node
+///////////////////////
+
+static void printUsage(const char *name) {
+  std::cout << "Usage: " << name << " [options]\n"
+            << "  --address ADDR      client address (default tcp://localhost)\n"
+            << "  --width N           image width (default: requested)\n"
+            << "  --height N          image height (default: requested)\n"
+            << "  --cameras N         number of cameras (default: requested)\n"
+            << "  --rate HZ           maximum frame rate (default: unlimited)\n"
+            << "  --latency-ms MS     delay before each frame is sent (default 0)\n"
+            << "  --binary-metadata   send binary instead of JSON metadata\n";
+}
+
+int main(int argc, char **argv) {
+  MockRenderer renderer;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--address" && hasValue) {
+      renderer.client_address = argv[++i];
+    } else if (arg == "--width" && hasValue) {
+      renderer.widthOverride = atoi(argv[++i]);
+    } else if (arg == "--height" && hasValue) {
+      renderer.heightOverride = atoi(argv[++i]);
+    } else if (arg == "--cameras" && hasValue) {
+      renderer.cameraCountOverride = atoi(argv[++i]);
+    } else if (arg == "--rate" && hasValue) {
+      renderer.maxRate = atof(argv[++i]);
+    } else if (arg == "--latency-ms" && hasValue) {
+      renderer.latencyUs = static_cast<int64_t>(atof(argv[++i]) * 1000);
+    } else if (arg == "--binary-metadata") {
+      renderer.binaryMetadata = true;
+    } else {
+      printUsage(argv[0]);
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+
+  renderer.connect();
+  renderer.run();
+
+  return 0;
+}
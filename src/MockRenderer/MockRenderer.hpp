@@ -0,0 +1,94 @@
+#ifndef MOCKRENDERER_H
+#define MOCKRENDERER_H
+/**
+ * @file   MockRenderer.hpp
+ * @brief  Stand-in for the FlightGoggles Unity renderer that answers render
+ * requests with synthetic frames, for benchmarking clients without a GPU.
+ */
+
+#include <jsonMessageSpec.hpp>
+#include <binaryMessageSpec.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include <zmqpp/zmqpp.hpp>
+
+class MockRenderer {
+ public:
+  // ZMQ connection parameters. The client binds, the renderer connects.
+  std::string client_address = "tcp://localhost";
+  std::string upload_port = "10253";
+  std::string download_port = "10254";
+
+  // Overrides of the requested resolution and number of cameras. 0 keeps
+  // what the client asked for. Extra cameras repeat the requested ones.
+  int widthOverride = 0;
+  int heightOverride = 0;
+  int cameraCountOverride = 0;
+  // Frames per second the renderer can produce. 0 is unlimited.
+  double maxRate = 0;
+  // Delay between receiving a request and sending its frame.
+  int64_t latencyUs = 0;
+  // Send binary instead of JSON metadata.
+  bool binaryMetadata = false;
+
+  // Socket variables
+  zmqpp::context context;
+  zmqpp::socket pose_socket {context, zmqpp::socket_type::subscribe};
+  zmqpp::socket frame_socket {context, zmqpp::socket_type::publish};
+
+  // Last full state received, with pose updates applied.
+  unity_outgoing::StateMessage_t state;
+  bool hasState = false;
+
+  // Requests waiting for their frame to be sent.
+  struct PendingFrame {
+    int64_t dueUtime;
+    unity_outgoing::StateMessage_t state;
+  };
+  std::deque<PendingFrame> pending;
+  // When the last frame is due, for rate limiting.
+  int64_t lastDueUtime = 0;
+
+  // Test pattern per output camera, redrawn whenever its shape changes.
+  struct CachedImage {
+    int width = -1;
+    int height = -1;
+    int channels = -1;
+    size_t cam_index = 0;
+    std::string pixels;
+  };
+
+  // Reused buffers
+  std::vector<CachedImage> imageCache;
+  std::string metadataBuffer;
+  std::string pongBuffer;
+
+  // Statistics
+  uint64_t framesSent = 0;
+  uint64_t requestsDropped = 0;
+
+  // Connects to the client.
+  void connect();
+
+  // Serves requests until killed.
+  void run();
+
+  // Handles one message from the client.
+  void handleMessage(const zmqpp::message &msg, int64_t receivedUtime);
+
+  // Renders and sends the frame for a request.
+  void sendFrame(const unity_outgoing::StateMessage_t &request);
+
+  // Fills image with the synthetic test pattern for a camera, bottom row
+  // first and RGB ordered like Unity's readback.
+  static void drawTestPattern(std::string &image, int width, int height, int channels,
+                              size_t cam_index);
+
+  // Monotonic time in us.
+  static int64_t getTimestamp();
+};
+
+#endif
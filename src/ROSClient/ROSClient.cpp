@@ -49,7 +49,6 @@ void ROSClient::populateRenderSettings(){
 
 void ROSClient::poseSubscriber(const nav_msgs::Odometry::ConstPtr& msg){
     // ROS_INFO("Seq: [%d]", msg->header.seq);
-    // Sends render requests to FlightGoggles indefinitely
     geometry_msgs::Pose cam_pose_tf = msg->pose.pose;
 
     // Old hack to convert ROS TF to ENU poses.
@@ -57,18 +56,146 @@ void ROSClient::poseSubscriber(const nav_msgs::Odometry::ConstPtr& msg){
     // cam_pose_tf.position.x = -cam_pose_tf.position.y;
     // cam_pose_tf.position.y = x;
 
-    Transform3 cam_pose_eigen;
-    poseMsgToEigen(cam_pose_tf, cam_pose_eigen);
+    // Keep the pose at the time it was measured. Rendering happens at the
+    // render scheduler's pace, see updatePoseAt().
+    PoseBuffer::Pose pose;
+    ros::Time stamp = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
+    pose.utime = static_cast<int64_t>(stamp.toNSec() / 1000);
+    pose.position = Vector3(cam_pose_tf.position.x,
+                            cam_pose_tf.position.y,
+                            cam_pose_tf.position.z);
+    pose.rotation = Quaternionx(cam_pose_tf.orientation.w,
+                                cam_pose_tf.orientation.x,
+                                cam_pose_tf.orientation.y,
+                                cam_pose_tf.orientation.z);
+    poseBuffer.add(pose);
+}
 
-    // Populate status message with new pose
-    flightGoggles.setCameraPoseUsingROSCoordinates(cam_pose_eigen, 0);
-    flightGoggles.setCameraPoseUsingROSCoordinates(cam_pose_eigen, 1);
+bool ROSClient::updatePoseAt(int64_t deadlineUtime){
+    // Odometry is stamped in ROS time, so move the deadline over to it.
+    int64_t rosNowUtime = static_cast<int64_t>(ros::Time::now().toNSec() / 1000);
+    int64_t sinceDeadline = FlightGogglesClient::getMonotonicTimestamp() - deadlineUtime;
+    int64_t sampleUtime = rosNowUtime - sinceDeadline - poseDelayUs;
+
+    PoseBuffer::Pose pose;
+    if (!poseBuffer.sample(sampleUtime, pose) || pose.utime <= lastRequestUtime) {
+        // Rendering the same pose again would only waste the renderer's time.
+        return false;
+    }
+    lastRequestUtime = pose.utime;
+
+    // Populate status message with new pose and publish it in one go
+    flightGoggles.updateState([&](unity_outgoing::StateMessage_t &state) {
+        // Use the message's quaternion directly rather than going through a
+        // rotation matrix.
+        for (int cam_index = 0; cam_index < 2; cam_index++) {
+            FlightGogglesClient::setCameraPoseUsingROSCoordinates(state, pose.position,
+                                                                  pose.rotation, cam_index);
+        }
+
+        // The pose's own time, so that frames carry the time their pose is
+        // valid for. It also forces FlightGoggles to rerender the scene.
+        state.utime = pose.utime;
+    });
+    return true;
+}
 
-    // Update timestamp of state message (needed to force FlightGoggles to rerender scene)
-    flightGoggles.state.utime = flightGoggles.getTimestamp();
-    // request render
-    flightGoggles.requestRender();
-    
+void ROSClient::advertiseCameras(ros::NodeHandle &node){
+    for (const unity_outgoing::Camera_t &cam : flightGoggles.state.cameras) {
+        CameraPublishers &publishers = cameraPublishers[cam.ID];
+        publishers.image = node.advertise<sensor_msgs::Image>(cam.ID + "/image_raw", 1);
+        publishers.cameraInfo = node.advertise<sensor_msgs::CameraInfo>(cam.ID + "/camera_info", 1);
+    }
+}
+
+sensor_msgs::CameraInfoPtr ROSClient::makeCameraInfo(int width, int height, double fovDegrees){
+    sensor_msgs::CameraInfoPtr info = boost::make_shared<sensor_msgs::CameraInfo>();
+    info->width = width;
+    info->height = height;
+    info->distortion_model = "plumb_bob";
+    info->D.assign(5, 0.0);
+
+    // Unity's field of view is vertical, and pixels are square.
+    double f = 0.5 * height / tan(0.5 * fovDegrees * M_PI / 180.0);
+    double cx = 0.5 * width;
+    double cy = 0.5 * height;
+    info->K = {{f, 0, cx,
+                0, f, cy,
+                0, 0, 1}};
+    info->R = {{1, 0, 0,
+                0, 1, 0,
+                0, 0, 1}};
+    info->P = {{f, 0, cx, 0,
+                0, f, cy, 0,
+                0, 0, 1, 0}};
+    return info;
+}
+
+void ROSClient::imageConsumer(const unity_incoming::RenderOutput_t &renderOutput){
+    const unity_incoming::RenderMetadata_t &renderMetadata = renderOutput.renderMetadata;
+    // Intrinsics come from the state the frame was rendered with, if known.
+    std::shared_ptr<const unity_outgoing::StateMessage_t> state = renderOutput.requestState;
+    if (!state) {
+        state = flightGoggles.getStateSnapshot();
+    }
+    ros::Time stamp;
+    stamp.fromNSec(static_cast<uint64_t>(renderMetadata.utime) * 1000);
+
+    size_t numCameras = std::min(renderOutput.images.size(), renderMetadata.cameraIDs.size());
+    for (size_t i = 0; i < numCameras; i++) {
+        const std::string &cameraID = renderMetadata.cameraIDs[i];
+        auto publishers = cameraPublishers.find(cameraID);
+        if (publishers == cameraPublishers.end()) {
+            continue;
+        }
+        const cv::Mat &image = renderOutput.images[i];
+        bool wantImage = publishers->second.image.getNumSubscribers() > 0;
+        if (wantImage && !image.empty()) {
+            int channels = image.channels();
+            if (renderOutput.imagesAreRaw && i < renderMetadata.channels.size()) {
+                channels = renderMetadata.channels[i];
+            }
+            sensor_msgs::ImagePtr msg = boost::make_shared<sensor_msgs::Image>();
+            msg->header.stamp = stamp;
+            msg->header.frame_id = cameraID;
+            msg->width = image.cols;
+            msg->height = image.rows;
+            msg->is_bigendian = false;
+            msg->step = image.cols * channels;
+            if (channels == 1) {
+                msg->encoding = sensor_msgs::image_encodings::MONO8;
+            } else if (channels == 3) {
+                msg->encoding = sensor_msgs::image_encodings::BGR8;
+            } else if (channels == 4) {
+                msg->encoding = sensor_msgs::image_encodings::RGBA8;
+            } else {
+                msg->encoding = "8UC" + std::to_string(channels);
+            }
+            msg->data.resize(static_cast<size_t>(msg->step) * msg->height);
+            if (renderOutput.imagesAreRaw) {
+                // Flip and swizzle straight from the received message into
+                // the ROS message, instead of decoding into a cv::Mat first.
+                image_conversion::flipAndSwizzle(image.data, image.channels(),
+                                                 msg->data.data(), msg->step, channels,
+                                                 image.cols, image.rows);
+            } else {
+                for (int y = 0; y < image.rows; y++) {
+                    memcpy(&msg->data[y * msg->step], image.ptr(y), msg->step);
+                }
+            }
+            // Subscribers in this process (e.g. nodelets) get the pointer
+            // itself, without serialization, as long as nobody modifies it.
+            publishers->second.image.publish(msg);
+        }
+
+        if (publishers->second.cameraInfo.getNumSubscribers() > 0) {
+            sensor_msgs::CameraInfoPtr info =
+                makeCameraInfo(renderMetadata.camWidth, renderMetadata.camHeight, state->camFOV);
+            info->header.stamp = stamp;
+            info->header.frame_id = cameraID;
+            publishers->second.cameraInfo.publish(info);
+        }
+    }
 }
 
 ///////////////////////
@@ -86,11 +213,33 @@ int main(int argc, char **argv) {
     // Load params
     client.populateRenderSettings();
 
+    // Publish rendered images. Frames stay in the received message until
+    // they are converted into ROS messages, and only the newest frame is kept
+    // if publishing falls behind.
+    client.advertiseCameras(node);
+    client.flightGoggles.zeroCopyImages = true;
+    client.flightGoggles.frameQueuePolicy = FrameDropPolicy::KeepLatest;
+    client.flightGoggles.addRenderOutputCallback(
+        [&client](const unity_incoming::RenderOutput_t &renderOutput) {
+            client.imageConsumer(renderOutput);
+        });
+    client.flightGoggles.start();
+
+    // Every odometry message goes into the pose buffer, so queue enough of
+    // them for high rate odometry.
     callback poseCallback = boost::bind(&ROSClient::poseSubscriber, &client, _1);
-    ros::Subscriber sub = node.subscribe("odom", 1, poseCallback);
+    ros::Subscriber sub = node.subscribe("odom", 100, poseCallback);
+
+    // Render at maxFramerate, with poses interpolated to the frame deadlines.
+    client.flightGoggles.startRenderScheduler([&client](int64_t deadlineUtime) {
+        return client.updatePoseAt(deadlineUtime);
+    });
 
     // Spin
     ros::spin();
 
+    client.flightGoggles.stopRenderScheduler();
+    client.flightGoggles.stop();
+
     return 0;
 }
@@ -10,6 +10,7 @@
 // #include <jsonMessageSpec.hpp>
 
 #include <iostream>
+#include <map>
 #include <string>
 #include <vector>
 #include <thread>
@@ -18,6 +19,9 @@
 #include "std_msgs/String.h"
 #include "nav_msgs/Odometry.h"
 #include "geometry_msgs/Pose.h"
+#include "sensor_msgs/Image.h"
+#include "sensor_msgs/CameraInfo.h"
+#include "sensor_msgs/image_encodings.h"
 
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
@@ -27,14 +31,51 @@ public:
     // FlightGoggles interface object
 	FlightGogglesClient flightGoggles;
 
+	// Odometry poses, stamped with their header time.
+	PoseBuffer poseBuffer;
+
+	// Poses are sampled this far before the frame deadline, so that
+	// odometry arriving up to this late still brackets the sample time and
+	// gets interpolated rather than held.
+	int64_t poseDelayUs = 10000;
+
+	// utime of the last render request, which is the time of its pose.
+	int64_t lastRequestUtime = 0;
+
 	// constructor
 	ROSClient();
 
 	// Populate starting settings into state
 	void populateRenderSettings();
 
+	// Adds an odometry pose to poseBuffer.
 	void poseSubscriber(const nav_msgs::Odometry::ConstPtr& msg);
+
+	// Sets the camera poses to the odometry pose poseDelayUs before the
+	// frame deadline, a FlightGogglesClient::getMonotonicTimestamp() time,
+	// and stamps the request with the time of that pose. Returns false if
+	// there is no pose newer than the last request.
+	bool updatePoseAt(int64_t deadlineUtime);
+
+	// Advertises "<cameraID>/image_raw" and "<cameraID>/camera_info" for
+	// every camera in the state.
+	void advertiseCameras(ros::NodeHandle &node);
+
+	// Publishes the images of a rendered frame. Runs on the FlightGoggles
+	// dispatch thread.
+	void imageConsumer(const unity_incoming::RenderOutput_t &renderOutput);
+
+	// Pinhole intrinsics of an undistorted width x height image with the
+	// given vertical field of view, in degrees.
+	static sensor_msgs::CameraInfoPtr makeCameraInfo(int width, int height, double fovDegrees);
 private:
+	struct CameraPublishers {
+		ros::Publisher image;
+		ros::Publisher cameraInfo;
+	};
+	// Keyed by camera ID.
+	std::map<std::string, CameraPublishers> cameraPublishers;
+
     void poseMsgToEigen(const geometry_msgs::Pose &m, Eigen::Affine3d &e)
     {
      	e = Eigen::Translation3d(m.position.x,
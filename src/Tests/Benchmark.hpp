@@ -0,0 +1,41 @@
+#ifndef FLIGHTGOGGLESBENCHMARK_H
+#define FLIGHTGOGGLESBENCHMARK_H
+/**
+ * @file   Benchmark.hpp
+ * @brief  Timing helpers for the benchmark executables.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+// Keeps the compiler from optimizing away the computation of value.
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Calls fn(i) for i in [0, iterations) and returns the mean time per call in
+// ns. The best of a few repetitions is taken to filter out interruptions.
+template <typename Fn>
+double nanosecondsPerCall(size_t iterations, Fn fn, int repetitions = 5)
+{
+    double best = 0;
+    for (int r = 0; r < repetitions; r++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+        {
+            fn(i);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() -
+                                                             start)
+                        .count() /
+                    iterations;
+        best = r == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef FLIGHTGOGGLESCHECK_H
+#define FLIGHTGOGGLESCHECK_H
+/**
+ * @file   Check.hpp
+ * @brief  Minimal assertions for the test executables. Failed checks are
+ * printed and counted, and main() returns checkFailures() so that ctest
+ * reports them.
+ */
+
+#include <iostream>
+
+inline int &checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                    \
+    do                                                                                      \
+    {                                                                                       \
+        if (!(condition))                                                                   \
+        {                                                                                   \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed"    \
+                      << std::endl;                                                         \
+            checkFailures()++;                                                              \
+        }                                                                                   \
+    } while (0)
+
+// Checks that statement throws exception, or something derived from it.
+#define CHECK_THROWS(statement, exception)                                                  \
+    do                                                                                      \
+    {                                                                                       \
+        bool thrown = false;                                                                \
+        try                                                                                 \
+        {                                                                                   \
+            statement;                                                                      \
+        }                                                                                   \
+        catch (const exception &)                                                           \
+        {                                                                                   \
+            thrown = true;                                                                  \
+        }                                                                                   \
+        if (!thrown)                                                                        \
+        {                                                                                   \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #statement " did not throw "   \
+                      << #exception << std::endl;                                           \
+            checkFailures()++;                                                              \
+        }                                                                                   \
+    } while (0)
+
+#endif
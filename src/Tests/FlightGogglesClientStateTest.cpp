@@ -0,0 +1,212 @@
+/**
+ * @file   FlightGogglesClientStateTest.cpp
+ * @brief  Stress test of the state publication of FlightGogglesClient, with
+ * many writer threads against snapshot readers and the request sender.
+ */
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "Check.hpp"
+#include "FlightGogglesClient.hpp"
+
+namespace
+{
+
+// Cameras below kPoseSetters each belong to one thread that moves them with
+// setCameraPoseUsingROSCoordinates(). The cameras after them belong to the
+// updateState() writers, which set all of them from the same update.
+const size_t kPoseSetters = 2;
+const size_t kWriters = 4;
+const int kPosesPerSetter = 2000;
+const int kUpdatesPerWriter = 2000;
+
+// ROS pose number k of a pose setter: k metres along x, turned by k mrad.
+Transform3 rosPose(int k)
+{
+    Transform3 pose = Transform3::Identity();
+    pose.linear() = Eigen::AngleAxisd(k * 1e-3, Vector3::UnitZ()).toRotationMatrix();
+    pose.translation() = Vector3(k, 0, 0);
+    return pose;
+}
+
+// Each update by a writer counts utime up and sets the writers' cameras,
+// and their number, from the new utime alone.
+void applyWriterUpdate(unity_outgoing::StateMessage_t &state)
+{
+    state.utime++;
+    int64_t u = state.utime;
+    size_t numCameras = kPoseSetters + 1 + static_cast<size_t>(u % 4);
+    unity_outgoing::Camera_t camera = state.cameras.back();
+    state.cameras.resize(numCameras, camera);
+    for (size_t i = kPoseSetters; i < numCameras; i++)
+    {
+        state.cameras[i].position = {{static_cast<double>(u), -static_cast<double>(u), 0.5 * u}};
+        state.cameras[i].outputIndex = static_cast<int>(u);
+    }
+}
+
+class SnapshotChecker
+{
+  public:
+    explicit SnapshotChecker(const std::vector<unity_outgoing::StateMessage_t> &expectedPoses)
+        : expectedPoses(expectedPoses), lastPose(kPoseSetters, 0)
+    {
+    }
+
+    // Checks that snapshot comes from whole updates, and that neither utime
+    // nor any setter's pose goes back since the last snapshot.
+    bool check(const unity_outgoing::StateMessage_t &snapshot)
+    {
+        int64_t u = snapshot.utime;
+        bool ok = u >= lastUtime && snapshot.cameras.size() == kPoseSetters + 1 + u % 4;
+        lastUtime = u;
+        for (size_t i = kPoseSetters; ok && i < snapshot.cameras.size(); i++)
+        {
+            const unity_outgoing::Camera_t &camera = snapshot.cameras[i];
+            ok = camera.position[0] == u && camera.position[1] == -u &&
+                 camera.position[2] == 0.5 * u && camera.outputIndex == u;
+        }
+        for (size_t s = 0; ok && s < kPoseSetters; s++)
+        {
+            // Pose k is k metres from the origin, and must match it exactly.
+            const unity_outgoing::Camera_t &camera = snapshot.cameras[s];
+            double distance = std::fabs(camera.position[0]) + std::fabs(camera.position[1]) +
+                              std::fabs(camera.position[2]);
+            int k = static_cast<int>(std::lround(distance));
+            ok = k >= lastPose[s] && k <= kPosesPerSetter &&
+                 camera.position == expectedPoses[k].cameras[s].position &&
+                 camera.rotation == expectedPoses[k].cameras[s].rotation;
+            lastPose[s] = k;
+        }
+        return ok;
+    }
+
+  private:
+    const std::vector<unity_outgoing::StateMessage_t> &expectedPoses;
+    int64_t lastUtime = 0;
+    std::vector<int> lastPose;
+};
+
+void testConcurrentWriters()
+{
+    FlightGogglesClient client;
+    unity_outgoing::Camera_t camera;
+    camera.ID = "Camera";
+    camera.channels = 3;
+    camera.isDepth = false;
+    camera.outputIndex = 0;
+    client.state.cameras.assign(kPoseSetters + 1, camera);
+    client.state.utime = 0;
+    applyWriterUpdate(client.state);
+
+    // What the setters' cameras look like after each of their poses.
+    std::vector<unity_outgoing::StateMessage_t> expectedPoses(kPosesPerSetter + 1,
+                                                              client.state);
+    for (int k = 1; k <= kPosesPerSetter; k++)
+    {
+        for (size_t s = 0; s < kPoseSetters; s++)
+        {
+            FlightGogglesClient::setCameraPoseUsingROSCoordinates(expectedPoses[k], rosPose(k),
+                                                                  static_cast<int>(s));
+        }
+    }
+    client.publishState();
+
+    std::atomic<size_t> writersDone {0};
+    std::atomic<int> badSnapshots {0};
+    std::atomic<uint64_t> snapshotsChecked {0};
+    std::atomic<uint64_t> requestsSent {0};
+    std::vector<std::thread> threads;
+
+    for (size_t w = 0; w < kWriters; w++)
+    {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < kUpdatesPerWriter; i++)
+            {
+                client.updateState(applyWriterUpdate);
+                // Let readers and the sender in on machines with few cores.
+                if (i % 16 == 15)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            writersDone++;
+        });
+    }
+    for (size_t s = 0; s < kPoseSetters; s++)
+    {
+        threads.emplace_back([&, s]() {
+            for (int k = 1; k <= kPosesPerSetter; k++)
+            {
+                client.setCameraPoseUsingROSCoordinates(rosPose(k), static_cast<int>(s));
+                if (k % 16 == 15)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            writersDone++;
+        });
+    }
+    for (int r = 0; r < 2; r++)
+    {
+        threads.emplace_back([&]() {
+            SnapshotChecker checker(expectedPoses);
+            while (writersDone < kWriters + kPoseSetters)
+            {
+                badSnapshots += !checker.check(*client.getStateSnapshot());
+                snapshotsChecked++;
+            }
+        });
+    }
+    // ZMQ sockets are not thread safe, so a single thread sends requests. It
+    // also checks what it sends, as requests keep their state.
+    threads.emplace_back([&]() {
+        SnapshotChecker checker(expectedPoses);
+        while (writersDone < kWriters + kPoseSetters)
+        {
+            if (client.requestRender(false))
+            {
+                requestsSent++;
+                InFlightRequests::Request sent;
+                if (!client.inFlightRequests.complete(client.last_uploaded_utime, sent) ||
+                    !checker.check(*sent.state))
+                {
+                    badSnapshots++;
+                }
+            }
+        }
+    });
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    std::cout << snapshotsChecked << " snapshots checked, " << requestsSent
+              << " requests sent, " << badSnapshots << " inconsistent" << std::endl;
+    CHECK(badSnapshots == 0);
+    CHECK(snapshotsChecked > 0);
+    CHECK(requestsSent > 0);
+
+    // No update got lost: every writer update counted utime up, and each
+    // setter's last pose is in place.
+    std::shared_ptr<const unity_outgoing::StateMessage_t> last = client.getStateSnapshot();
+    CHECK(last->utime == 1 + static_cast<int64_t>(kWriters) * kUpdatesPerWriter);
+    SnapshotChecker checker(expectedPoses);
+    CHECK(checker.check(*last));
+    for (size_t s = 0; s < kPoseSetters; s++)
+    {
+        CHECK(last->cameras[s].position == expectedPoses[kPosesPerSetter].cameras[s].position);
+        CHECK(last->cameras[s].rotation == expectedPoses[kPosesPerSetter].cameras[s].rotation);
+    }
+}
+
+}
+
+int main()
+{
+    testConcurrentWriters();
+    return checkFailures() == 0 ? 0 : 1;
+}
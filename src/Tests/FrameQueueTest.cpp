@@ -0,0 +1,283 @@
+/**
+ * @file   FrameQueueTest.cpp
+ * @brief  Stress test of FrameQueue with several producers and consumers
+ * under every drop policy.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "Check.hpp"
+#include "FrameQueue.hpp"
+
+namespace
+{
+
+const char *policyName(FrameDropPolicy policy)
+{
+    switch (policy)
+    {
+    case FrameDropPolicy::KeepLatest:
+        return "KeepLatest";
+    case FrameDropPolicy::DropOldest:
+        return "DropOldest";
+    case FrameDropPolicy::Block:
+        return "Block";
+    }
+    return "";
+}
+
+// Items carry their producer in the upper and their number in the lower 32
+// bits, counting from 1 so that 0 never shows up as an item.
+uint64_t makeItem(size_t producer, size_t number)
+{
+    return (static_cast<uint64_t>(producer) << 32) | (number + 1);
+}
+
+void stress(FrameDropPolicy policy, size_t numProducers, size_t numConsumers,
+            size_t itemsPerProducer, size_t capacity)
+{
+    FrameQueue<uint64_t> queue(capacity, policy);
+    std::atomic<size_t> producersDone {0};
+    std::vector<std::vector<uint64_t>> received(numConsumers);
+
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < numConsumers; c++)
+    {
+        threads.emplace_back([&, c]() {
+            uint64_t item;
+            while (producersDone.load(std::memory_order_acquire) < numProducers)
+            {
+                if (queue.pop(item, 1000))
+                {
+                    received[c].push_back(item);
+                }
+            }
+            // Every push has returned, so whatever is left is in the queue.
+            while (queue.tryPop(item))
+            {
+                received[c].push_back(item);
+            }
+        });
+    }
+    for (size_t p = 0; p < numProducers; p++)
+    {
+        threads.emplace_back([&, p]() {
+            for (size_t i = 0; i < itemsPerProducer; i++)
+            {
+                CHECK(queue.push(makeItem(p, i)));
+                // Give consumers a chance on machines with few cores.
+                if (i % 16 == 15)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            producersDone.fetch_add(1, std::memory_order_release);
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    // Every item arrives at most once, and each consumer gets each
+    // producer's items in the order they were pushed.
+    std::vector<std::vector<uint8_t>> seen(numProducers,
+                                           std::vector<uint8_t>(itemsPerProducer, 0));
+    uint64_t duplicates = 0;
+    uint64_t reordered = 0;
+    uint64_t receivedTotal = 0;
+    for (const std::vector<uint64_t> &items : received)
+    {
+        std::vector<uint64_t> lastNumber(numProducers, 0);
+        for (uint64_t item : items)
+        {
+            size_t producer = static_cast<size_t>(item >> 32);
+            uint64_t number = item & 0xFFFFFFFF;
+            if (producer >= numProducers || number == 0 || number > itemsPerProducer)
+            {
+                duplicates++;
+                continue;
+            }
+            if (seen[producer][number - 1]++)
+            {
+                duplicates++;
+            }
+            if (number <= lastNumber[producer])
+            {
+                reordered++;
+            }
+            lastNumber[producer] = number;
+            receivedTotal++;
+        }
+    }
+
+    FrameQueue<uint64_t>::Stats stats = queue.getStats();
+    uint64_t pushed = numProducers * itemsPerProducer;
+    uint64_t discarded = stats.dropped + stats.overwritten;
+
+    bool ok = duplicates == 0 && reordered == 0 && stats.pushed == pushed &&
+              stats.popped == receivedTotal && receivedTotal + discarded == pushed &&
+              queue.size() == 0;
+    if (policy == FrameDropPolicy::Block)
+    {
+        ok = ok && discarded == 0;
+    }
+    else
+    {
+        ok = ok && stats.blockedPushes == 0;
+    }
+    if (policy == FrameDropPolicy::DropOldest)
+    {
+        ok = ok && stats.overwritten == 0;
+    }
+    if (policy == FrameDropPolicy::KeepLatest)
+    {
+        ok = ok && stats.dropped == 0;
+    }
+
+    std::cout << policyName(policy) << " " << numProducers << "x" << numConsumers
+              << ": pushed " << stats.pushed << ", received " << receivedTotal
+              << ", dropped " << stats.dropped << ", overwritten " << stats.overwritten
+              << ", blocked " << stats.blockedPushes << ", duplicates " << duplicates
+              << ", reordered " << reordered << (ok ? "" : "  FAILED") << std::endl;
+    CHECK(ok);
+}
+
+// A Block push waiting for room, and a pop waiting for an item, both have to
+// return once the queue is closed.
+void testCloseWakesWaiters()
+{
+    FrameQueue<uint64_t> full(1, FrameDropPolicy::Block);
+    for (size_t i = 0; i < full.capacity(); i++)
+    {
+        CHECK(full.push(i + 1));
+    }
+    std::thread producer([&]() { CHECK(!full.push(full.capacity() + 1)); });
+
+    FrameQueue<uint64_t> empty(1, FrameDropPolicy::Block);
+    std::thread consumer([&]() {
+        uint64_t item;
+        CHECK(!empty.pop(item, 60 * 1000000));
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    full.close();
+    empty.close();
+    producer.join();
+    consumer.join();
+    CHECK(full.getStats().blockedPushes == 1);
+}
+
+// Waiters that are past the spin phase sleep, so the push or pop they are
+// waiting for has to wake them up rather than a timeout.
+void testPushAndPopWakeSleepers()
+{
+    typedef std::chrono::steady_clock Clock;
+    FrameQueue<uint64_t> queue(1, FrameDropPolicy::Block);
+
+    Clock::time_point start = Clock::now();
+    std::thread consumer([&]() {
+        uint64_t item = 0;
+        CHECK(queue.pop(item, 60 * 1000000) && item == 1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(queue.push(1));
+    consumer.join();
+
+    for (size_t i = 0; i < queue.capacity(); i++)
+    {
+        CHECK(queue.push(i + 2));
+    }
+    std::thread producer([&]() { CHECK(queue.push(queue.capacity() + 2)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t item = 0;
+    CHECK(queue.tryPop(item) && item == 2);
+    producer.join();
+
+    CHECK(Clock::now() - start < std::chrono::seconds(10));
+    CHECK(queue.size() == queue.capacity());
+}
+
+// Producers that never yield keep the smallest queue full, so Block
+// producers and consumers both go past the spin phase and sleep, and pops
+// often complete while producers sleep. A pop that wakes producers while
+// holding the wait mutex deadlocked here within a round. Deadlocked threads
+// cannot be joined, so a hang fails the whole test.
+void testSleepingProducersAndConsumers()
+{
+    const size_t numThreads = 8;
+    const size_t itemsPerProducer = 5000;
+    std::future<bool> run = std::async(std::launch::async, [&]() {
+        bool ok = true;
+        for (int round = 0; round < 10; round++)
+        {
+            FrameQueue<uint64_t> queue(1, FrameDropPolicy::Block);
+            std::atomic<size_t> producersDone {0};
+            std::atomic<uint64_t> received {0};
+            std::vector<std::thread> threads;
+            for (size_t c = 0; c < numThreads; c++)
+            {
+                threads.emplace_back([&]() {
+                    uint64_t item;
+                    while (producersDone.load(std::memory_order_acquire) < numThreads)
+                    {
+                        received += queue.pop(item, 1000);
+                    }
+                    while (queue.tryPop(item))
+                    {
+                        received++;
+                    }
+                });
+            }
+            for (size_t p = 0; p < numThreads; p++)
+            {
+                threads.emplace_back([&, p]() {
+                    for (size_t i = 0; i < itemsPerProducer; i++)
+                    {
+                        queue.push(makeItem(p, i));
+                    }
+                    producersDone.fetch_add(1, std::memory_order_release);
+                });
+            }
+            for (std::thread &thread : threads)
+            {
+                thread.join();
+            }
+            ok = ok && received == numThreads * itemsPerProducer;
+        }
+        return ok;
+    });
+    if (run.wait_for(std::chrono::seconds(60)) != std::future_status::ready)
+    {
+        std::cerr << "Block producers and consumers deadlocked" << std::endl;
+        std::_Exit(1);
+    }
+    CHECK(run.get());
+}
+
+}
+
+int main()
+{
+    const FrameDropPolicy policies[] = {FrameDropPolicy::KeepLatest,
+                                        FrameDropPolicy::DropOldest, FrameDropPolicy::Block};
+    const size_t shapes[][2] = {{1, 1}, {4, 1}, {1, 4}, {4, 4}};
+    for (FrameDropPolicy policy : policies)
+    {
+        for (const size_t *shape : shapes)
+        {
+            stress(policy, shape[0], shape[1], 50000 / shape[0], 8);
+        }
+    }
+    testCloseWakesWaiters();
+    testPushAndPopWakeSleepers();
+    testSleepingProducersAndConsumers();
+
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+#ifndef FLIGHTGOGGLESGUARDEDBUFFER_H
+#define FLIGHTGOGGLESGUARDEDBUFFER_H
+/**
+ * @file   GuardedBuffer.hpp
+ * @brief  Test buffers that end right where an inaccessible page starts, so
+ * that code reading or writing past their end crashes instead of going
+ * unnoticed.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+class GuardedBuffer
+{
+  public:
+    // Copy of bytes.
+    explicit GuardedBuffer(const std::string &bytes) : GuardedBuffer(bytes.size(), 0)
+    {
+        memcpy(data, bytes.data(), size);
+    }
+
+    // size bytes set to fill.
+    GuardedBuffer(size_t size, uint8_t fill) : size(size)
+    {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t dataSize = (size + page - 1) / page * page;
+        mappingSize = dataSize + page;
+        void *mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Cannot map guarded buffer");
+        }
+        memory = static_cast<uint8_t *>(mapping);
+        mprotect(memory + dataSize, page, PROT_NONE);
+        data = memory + dataSize - size;
+        memset(data, fill, size);
+    }
+
+    ~GuardedBuffer() { munmap(memory, mappingSize); }
+
+    GuardedBuffer(const GuardedBuffer &) = delete;
+    GuardedBuffer &operator=(const GuardedBuffer &) = delete;
+
+    uint8_t *data;
+    size_t size;
+
+  private:
+    uint8_t *memory;
+    size_t mappingSize;
+};
+
+#endif
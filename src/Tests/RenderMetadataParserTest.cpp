@@ -0,0 +1,294 @@
+/**
+ * @file   RenderMetadataParserTest.cpp
+ * @brief  Checks that RenderMetadataParser gives the same results and throws
+ * the same exceptions as json::parse() followed by from_json().
+ */
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "FlightGogglesClient.hpp"
+#include "GuardedBuffer.hpp"
+#include "RenderMetadataParser.hpp"
+
+namespace
+{
+
+const std::string kValid = "{\"utime\":1508372831000000,\"camWidth\":1024,\"camHeight\":768,"
+                           "\"camDepthScale\":0.20000000298023224,\"isCompressed\":false,"
+                           "\"cameraIDs\":[\"Camera_RGB\",\"Camera_D\"],\"channels\":[3,1]}";
+
+// What parsing some metadata came to: the exception thrown, if any, and the
+// metadata otherwise.
+struct Outcome
+{
+    std::string error;
+    unity_incoming::RenderMetadata_t metadata;
+};
+
+template <typename Parse>
+Outcome outcomeOf(Parse parse)
+{
+    Outcome outcome;
+    try
+    {
+        parse(outcome.metadata);
+    }
+    // Most derived types first: they are all logic_errors.
+    catch (const std::invalid_argument &)
+    {
+        outcome.error = "invalid_argument";
+    }
+    catch (const std::out_of_range &)
+    {
+        outcome.error = "out_of_range";
+    }
+    catch (const std::domain_error &)
+    {
+        outcome.error = "domain_error";
+    }
+    catch (const std::exception &)
+    {
+        outcome.error = "other";
+    }
+    return outcome;
+}
+
+bool sameMetadata(const unity_incoming::RenderMetadata_t &a,
+                  const unity_incoming::RenderMetadata_t &b)
+{
+    return a.utime == b.utime && a.camWidth == b.camWidth && a.camHeight == b.camHeight &&
+           a.camDepthScale == b.camDepthScale && a.isCompressed == b.isCompressed &&
+           a.cameraIDs == b.cameraIDs && a.channels == b.channels;
+}
+
+// Parses text both ways and checks that the outcomes match. The parser reads
+// from a guarded buffer, so reading past the end of the input crashes.
+// Returns the parser's outcome.
+Outcome compare(const std::string &text)
+{
+    Outcome expected = outcomeOf([&](unity_incoming::RenderMetadata_t &o) {
+        o = json::parse(text).get<unity_incoming::RenderMetadata_t>();
+    });
+
+    GuardedBuffer buffer(text);
+    RenderMetadataParser parser;
+    Outcome actual = outcomeOf([&](unity_incoming::RenderMetadata_t &o) {
+        parser.parse(reinterpret_cast<const char *>(buffer.data), buffer.size, o);
+    });
+
+    bool same = expected.error == actual.error &&
+                (!expected.error.empty() || sameMetadata(expected.metadata, actual.metadata));
+    if (!same)
+    {
+        fprintf(stderr, "Parsing %s: json gave '%s', RenderMetadataParser gave '%s'\n",
+                text.c_str(), expected.error.c_str(), actual.error.c_str());
+    }
+    CHECK(same);
+    return actual;
+}
+
+// kValid with the value of key replaced by value, or with key removed if
+// value is empty.
+std::string withField(const std::string &key, const std::string &value)
+{
+    json j = json::parse(kValid);
+    if (value.empty())
+    {
+        j.erase(key);
+    }
+    else
+    {
+        j[key] = json::parse(value);
+    }
+    return j.dump();
+}
+
+void testValid()
+{
+    Outcome outcome = compare(kValid);
+    CHECK(outcome.error.empty());
+    CHECK(outcome.metadata.utime == 1508372831000000);
+    CHECK(outcome.metadata.cameraIDs.size() == 2 && outcome.metadata.cameraIDs[1] == "Camera_D");
+    CHECK(outcome.metadata.channels == std::vector<int>({3, 1}));
+
+    // Whitespace, reordered and unknown keys, escapes and no cameras.
+    compare(" {\n\t\"channels\" : [ 3 ] , \"unknown\": {\"a\": [null, true, 1e3]},"
+            "\"cameraIDs\": [\"Cam\\u00e9ra \\\"1\\\"\\n\"], \"isCompressed\": true,"
+            "\"camDepthScale\": 1, \"camHeight\": 2, \"camWidth\": 3, \"utime\": -4 } ");
+    compare("{\"utime\":0,\"camWidth\":0,\"camHeight\":0,\"camDepthScale\":0,"
+            "\"isCompressed\":false,\"cameraIDs\":[],\"channels\":[]}");
+    // Later duplicates win.
+    compare(kValid.substr(0, kValid.size() - 1) + ",\"utime\":5}");
+    // Fractions are truncated when read as integers.
+    compare(withField("camWidth", "640.75"));
+    compare(withField("utime", "-9223372036854775808"));
+    // Booleans are read as integers, but not as doubles, and numbers are
+    // not booleans.
+    compare(withField("camHeight", "true"));
+    compare(withField("channels", "[true,3]"));
+}
+
+void testMalformed()
+{
+    const char *const inputs[] = {
+        "",
+        "   ",
+        "{",
+        "{\"utime\"",
+        "{\"utime\":}",
+        "{\"utime\":1,}",
+        "[1,2",
+        "nul",
+        "{\"utime\":01}",
+        "{\"utime\":1.}",
+        "{\"utime\":-}",
+        "{\"utime\":1e}",
+        "{\"utime\":\"\\x\"}",
+        "{\"utime\":\"\\ud800\"}",
+        "{\"utime\":\"\x01\"}",
+        "{\"utime\":\"\xff\"}",
+        "{\"utime\":\"\xe2\x82\"}",
+        "{\"utime\":[1,2}",
+        "{'utime':1}",
+    };
+    for (const char *input : inputs)
+    {
+        CHECK(compare(input).error == "invalid_argument");
+    }
+    CHECK(compare(kValid + "x").error == "invalid_argument");
+    CHECK(compare(kValid.substr(0, kValid.size() - 1)).error == "invalid_argument");
+    // A wrong type does not hide a syntax error later on.
+    CHECK(compare("{\"utime\":\"1\",").error == "invalid_argument");
+}
+
+void testMissingKeys()
+{
+    for (const char *key : {"utime", "camWidth", "camHeight", "camDepthScale", "isCompressed",
+                            "cameraIDs", "channels"})
+    {
+        CHECK(compare(withField(key, "")).error == "out_of_range");
+    }
+    CHECK(compare("{}").error == "out_of_range");
+    // from_json reads the fields in order, so the first problem wins.
+    json j = json::parse(kValid);
+    j.erase("camWidth");
+    j["utime"] = "x";
+    CHECK(compare(j.dump()).error == "domain_error");
+    j = json::parse(kValid);
+    j.erase("utime");
+    j["camWidth"] = "x";
+    CHECK(compare(j.dump()).error == "out_of_range");
+}
+
+void testWrongTypes()
+{
+    CHECK(compare(withField("utime", "\"1\"")).error == "domain_error");
+    CHECK(compare(withField("utime", "null")).error == "domain_error");
+    CHECK(compare(withField("utime", "1e400")).error == "domain_error");
+    CHECK(compare(withField("camWidth", "[1]")).error == "domain_error");
+    CHECK(compare(withField("camHeight", "\"768\"")).error == "domain_error");
+    CHECK(compare(withField("camDepthScale", "{}")).error == "domain_error");
+    CHECK(compare(withField("camDepthScale", "false")).error == "domain_error");
+    CHECK(compare(withField("isCompressed", "0")).error == "domain_error");
+    CHECK(compare(withField("cameraIDs", "\"Camera\"")).error == "domain_error");
+    CHECK(compare(withField("cameraIDs", "[\"a\",1]")).error == "domain_error");
+    CHECK(compare(withField("channels", "3")).error == "domain_error");
+    CHECK(compare(withField("channels", "[3,\"1\"]")).error == "domain_error");
+    CHECK(compare(withField("channels", "[3,null]")).error == "domain_error");
+    CHECK(compare("[]").error == "domain_error");
+    CHECK(compare("42").error == "domain_error");
+    CHECK(compare("\"metadata\"").error == "domain_error");
+}
+
+// Keys that share a prefix with a field name, or that contain NULs, are not
+// that field. lookupField() used to read past the field name for keys longer
+// than it.
+void testKeysLikeFieldNames()
+{
+    const char *const keys[] = {
+        "utim", "utimes", "u", "", "camWidthcamWidthcamWidthcamWidth", "utime\\u0000",
+        "\\u0000utime", "channel", "channelsX",
+    };
+    for (const char *key : keys)
+    {
+        std::string renamed = kValid;
+        renamed.replace(renamed.find("\"utime\""), 7, "\"" + std::string(key) + "\"");
+        CHECK(compare(renamed).error == "out_of_range");
+
+        // As an extra key, it leaves the real fields alone.
+        std::string extra = kValid.substr(0, kValid.size() - 1) + ",\"" + key + "\":\"x\"}";
+        CHECK(compare(extra).error.empty());
+    }
+    // An escaped key still names its field.
+    std::string escaped = kValid;
+    escaped.replace(escaped.find("\"utime\""), 7, "\"ut\\u0069me\"");
+    CHECK(compare(escaped).error.empty());
+}
+
+// Neither parser checks that there is a channel count for every camera, so
+// that is left to the client, which has to reject such metadata before it
+// indexes channels by camera.
+void testChannelCountMismatch()
+{
+    for (const char *channels : {"[3]", "[3,1,1]", "[]"})
+    {
+        Outcome outcome = compare(withField("channels", channels));
+        CHECK(outcome.error.empty());
+        const unity_incoming::RenderMetadata_t &metadata = outcome.metadata;
+        size_t pixels = static_cast<size_t>(metadata.camWidth) * metadata.camHeight;
+        for (size_t i = 0; i < metadata.cameraIDs.size(); i++)
+        {
+            if (i >= metadata.channels.size())
+            {
+                CHECK_THROWS(FlightGogglesClient::getImageChannels(metadata, static_cast<int>(i),
+                                                                   pixels * 3),
+                             std::invalid_argument);
+            }
+        }
+    }
+}
+
+// Parsing into metadata left over from a previous frame gives the same result
+// as parsing into fresh metadata.
+void testReuse()
+{
+    RenderMetadataParser parser;
+    unity_incoming::RenderMetadata_t metadata;
+    const std::string frames[] = {
+        kValid,
+        withField("cameraIDs", "[\"Camera_RGB\",\"Camera_Depth\",\"Camera_3\"]"),
+        withField("cameraIDs", "[\"Camera_RGB\"]"),
+        kValid,
+    };
+    for (const std::string &frame : frames)
+    {
+        Outcome expected = compare(frame);
+        try
+        {
+            parser.parse(frame.data(), frame.size(), metadata);
+            CHECK(expected.error.empty() && sameMetadata(metadata, expected.metadata));
+        }
+        catch (const std::exception &)
+        {
+            CHECK(!expected.error.empty());
+        }
+    }
+}
+
+}
+
+int main()
+{
+    testValid();
+    testMalformed();
+    testMissingKeys();
+    testWrongTypes();
+    testKeysLikeFieldNames();
+    testChannelCountMismatch();
+    testReuse();
+    return checkFailures() == 0 ? 0 : 1;
+}
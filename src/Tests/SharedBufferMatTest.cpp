@@ -0,0 +1,83 @@
+/**
+ * @file   SharedBufferMatTest.cpp
+ * @brief  Checks that images made by makeSharedBufferMat() keep their owner
+ * alive exactly as long as some cv::Mat still references them.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "SharedBufferMat.hpp"
+
+namespace
+{
+
+// A received message, which notes when it is destroyed.
+struct Message
+{
+    explicit Message(bool &destroyed) : destroyed(destroyed), pixels(4 * 3 * 3, 7) {}
+    ~Message() { destroyed = true; }
+
+    bool &destroyed;
+    std::vector<uint8_t> pixels;
+};
+
+void testCopiesKeepOwner()
+{
+    bool destroyed = false;
+    cv::Mat kept;
+    {
+        std::shared_ptr<Message> message = std::make_shared<Message>(destroyed);
+        cv::Mat image = makeSharedBufferMat(3, 4, CV_8UC3, message->pixels.data(), message);
+        CHECK(image.data == message->pixels.data());
+        CHECK(image.step[0] == 12);
+        kept = image;
+        message.reset();
+        CHECK(!destroyed);
+    }
+    // Only the copy references the message now, and it is still readable
+    // and writable in place.
+    CHECK(!destroyed);
+    CHECK(kept.data[0] == 7);
+    kept.data[kept.step[0] * 2 + 11] = 1;
+    CHECK(kept.data[35] == 1);
+    kept.release();
+    CHECK(destroyed);
+}
+
+void testRowStep()
+{
+    bool destroyed = false;
+    std::shared_ptr<Message> message = std::make_shared<Message>(destroyed);
+    // Two rows of two pixels, out of rows that are four pixels long.
+    cv::Mat image = makeSharedBufferMat(2, 2, CV_8UC3, message->pixels.data(), message, 12);
+    CHECK(image.step[0] == 12);
+    CHECK(image.ptr(1) == message->pixels.data() + 12);
+}
+
+void testCreateDropsOwner()
+{
+    bool destroyed = false;
+    cv::Mat image;
+    {
+        std::shared_ptr<Message> message = std::make_shared<Message>(destroyed);
+        image = makeSharedBufferMat(3, 4, CV_8UC3, message->pixels.data(), message);
+    }
+    // A new shape gets pixels of its own, and lets go of the message.
+    image.create(5, 5, CV_8UC1);
+    CHECK(destroyed);
+    CHECK(image.rows == 5 && image.cols == 5);
+    image.data[24] = 3;
+}
+
+}
+
+int main()
+{
+    testCopiesKeepOwner();
+    testRowStep();
+    testCreateDropsOwner();
+    return checkFailures() == 0 ? 0 : 1;
+}
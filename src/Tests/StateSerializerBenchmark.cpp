@@ -0,0 +1,93 @@
+/**
+ * @file   StateSerializerBenchmark.cpp
+ * @brief  Times StateSerializer against json(message).dump().
+ */
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "Benchmark.hpp"
+#include "StateSerializer.hpp"
+
+namespace
+{
+
+unity_outgoing::StateMessage_t makeState(size_t numCameras, size_t numObjects)
+{
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> coordinate(-10, 10);
+    unity_outgoing::StateMessage_t state;
+    state.utime = 1539000000000000;
+    for (size_t i = 0; i < numCameras; i++)
+    {
+        unity_outgoing::Camera_t cam;
+        cam.ID = "Camera_" + std::to_string(i);
+        cam.position = {{coordinate(rng), coordinate(rng), coordinate(rng)}};
+        cam.rotation = {{coordinate(rng), coordinate(rng), coordinate(rng), coordinate(rng)}};
+        cam.channels = 3;
+        cam.isDepth = false;
+        cam.outputIndex = static_cast<int>(i);
+        state.cameras.push_back(cam);
+    }
+    for (size_t i = 0; i < numObjects; i++)
+    {
+        unity_outgoing::Object_t object;
+        object.ID = "Gate_" + std::to_string(i);
+        object.prefabID = "Gate";
+        object.position = {{coordinate(rng), coordinate(rng), coordinate(rng)}};
+        object.rotation = {{coordinate(rng), coordinate(rng), coordinate(rng), coordinate(rng)}};
+        object.size = {{1, 2.5, 1}};
+        state.objects.push_back(object);
+    }
+    return state;
+}
+
+}
+
+int main()
+{
+    printf("%-8s %-8s %-10s %8s %12s %12s %8s\n", "cameras", "objects", "message", "bytes",
+           "dump() us", "serialize us", "speedup");
+    for (size_t numObjects : {0, 100})
+    {
+        for (size_t numCameras : {2, 8, 32})
+        {
+            unity_outgoing::StateMessage_t state = makeState(numCameras, numObjects);
+            unity_outgoing::PoseUpdateMessage_t poseUpdate{&state};
+            StateSerializer serializer;
+            size_t iterations = 20000 / (numCameras + 2 * numObjects + 8);
+
+            double dumpUs = nanosecondsPerCall(iterations, [&](size_t i) {
+                                state.utime = i;
+                                json j = state;
+                                doNotOptimize(j.dump());
+                            }) /
+                            1000;
+            double serializeUs = nanosecondsPerCall(iterations, [&](size_t i) {
+                                     state.utime = i;
+                                     doNotOptimize(serializer.serialize(state));
+                                 }) /
+                                 1000;
+            printf("%-8zu %-8zu %-10s %8zu %12.2f %12.2f %7.1fx\n", numCameras, numObjects,
+                   "full", serializer.serialize(state).size(), dumpUs, serializeUs,
+                   dumpUs / serializeUs);
+
+            dumpUs = nanosecondsPerCall(iterations, [&](size_t i) {
+                         state.utime = i;
+                         json j = poseUpdate;
+                         doNotOptimize(j.dump());
+                     }) /
+                     1000;
+            serializeUs = nanosecondsPerCall(iterations, [&](size_t i) {
+                              state.utime = i;
+                              doNotOptimize(serializer.serialize(poseUpdate));
+                          }) /
+                          1000;
+            printf("%-8zu %-8zu %-10s %8zu %12.2f %12.2f %7.1fx\n", numCameras, numObjects,
+                   "PoseUpdate", serializer.serialize(poseUpdate).size(), dumpUs, serializeUs,
+                   dumpUs / serializeUs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file   StateSerializerTest.cpp
+ * @brief  Checks that StateSerializer output is byte for byte the same as
+ * json(message).dump().
+ */
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "Check.hpp"
+#include "StateSerializer.hpp"
+
+namespace
+{
+
+// Random scene with the given numbers of cameras and objects. IDs include
+// characters that json::dump() has to escape.
+unity_outgoing::StateMessage_t makeState(size_t numCameras, size_t numObjects, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<double> coordinate(-10, 10);
+    unity_outgoing::StateMessage_t state;
+    state.utime = 1539000000000000 + numCameras;
+    state.sceneFilename = "Butterfly_World";
+    state.camFOV = 72.5f;
+    state.camDepthScale = 0.05;
+    for (size_t i = 0; i < numCameras; i++)
+    {
+        unity_outgoing::Camera_t cam;
+        cam.ID = "Camera_" + std::to_string(i) + (i % 4 == 1 ? "\"\\\n\x01/\t" : "");
+        cam.position = {{coordinate(rng), coordinate(rng), coordinate(rng)}};
+        cam.rotation = {{coordinate(rng), coordinate(rng), coordinate(rng), coordinate(rng)}};
+        cam.channels = i % 2 ? 1 : 3;
+        cam.isDepth = i % 2 == 1;
+        cam.outputIndex = static_cast<int>(i);
+        state.cameras.push_back(cam);
+    }
+    for (size_t i = 0; i < numObjects; i++)
+    {
+        unity_outgoing::Object_t object;
+        object.ID = "Gate_" + std::to_string(i);
+        object.prefabID = i % 3 ? "Gate" : "Gateé";
+        object.position = {{coordinate(rng), coordinate(rng), i * 1e6}};
+        object.rotation = {{coordinate(rng), coordinate(rng), coordinate(rng), coordinate(rng)}};
+        object.size = {{1, 2.5, static_cast<double>(static_cast<float>(coordinate(rng)))}};
+        state.objects.push_back(object);
+    }
+    return state;
+}
+
+void testMessages()
+{
+    std::mt19937 rng(9);
+    // One serializer for all shapes, as its buffer is reused.
+    StateSerializer serializer;
+    for (size_t numCameras : {0, 2, 8, 32})
+    {
+        for (size_t numObjects : {0, 100})
+        {
+            unity_outgoing::StateMessage_t state = makeState(numCameras, numObjects, rng);
+            json full = state;
+            bool fullMatches = serializer.serialize(state) == full.dump();
+            json poseUpdate = unity_outgoing::PoseUpdateMessage_t{&state};
+            bool poseUpdateMatches =
+                serializer.serialize(unity_outgoing::PoseUpdateMessage_t{&state}) ==
+                poseUpdate.dump();
+            if (!fullMatches || !poseUpdateMatches)
+            {
+                std::cerr << numCameras << " cameras and " << numObjects
+                          << " objects differ from json::dump()" << std::endl;
+            }
+            CHECK(fullMatches);
+            CHECK(poseUpdateMatches);
+        }
+    }
+}
+
+bool formatsLikeJson(double x)
+{
+    char out[64];
+    size_t length = StateSerializer::formatDouble(x, out);
+    std::string expected = json(x).dump();
+    if (std::string(out, length) != expected)
+    {
+        std::cerr << "formatDouble(" << expected << ") gave " << std::string(out, length)
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void testDoubles()
+{
+    int mismatches = 0;
+    const double special[] = {0.0, -0.0, 1.0, 0.1, 0.5, 70.0, static_cast<double>(0.1f),
+                              1e15, 1e16, 1e22, 1e23, 999999999999999.0, 9999999999999995.0,
+                              1e-5, 1e-4, 0.0001234, 123456789012345678.0, 1e300, -1e-300,
+                              5e-324, 0.30000000000000004};
+    for (double x : special)
+    {
+        mismatches += !formatsLikeJson(x);
+    }
+    // Values around every power of ten, where the exponent switches.
+    for (int e = -30; e < 30; e++)
+    {
+        for (int m = 1; m < 100; m++)
+        {
+            double x = m * std::pow(10.0, e);
+            mismatches += !formatsLikeJson(x);
+            mismatches += !formatsLikeJson(x + 0.5 * std::pow(10.0, e - 14));
+        }
+    }
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> coordinate(-10, 10);
+    for (int i = 0; i < 100000; i++)
+    {
+        uint64_t bits = rng();
+        double any;
+        memcpy(&any, &bits, sizeof(any));
+        if (std::isfinite(any))
+        {
+            mismatches += !formatsLikeJson(any);
+        }
+        mismatches += !formatsLikeJson(coordinate(rng));
+        mismatches += !formatsLikeJson(static_cast<float>(coordinate(rng)));
+        int exponent = static_cast<int>(rng() % 200) - 100;
+        mismatches += !formatsLikeJson(std::ldexp(coordinate(rng), exponent));
+    }
+    CHECK(mismatches == 0);
+}
+
+}
+
+int main()
+{
+    testMessages();
+    testDoubles();
+    return checkFailures() == 0 ? 0 : 1;
+}
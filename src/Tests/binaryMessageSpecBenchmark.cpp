@@ -0,0 +1,75 @@
+/**
+ * @file   binaryMessageSpecBenchmark.cpp
+ * @brief  Compares the size and encode time of binary pose updates with the
+ * JSON messages they replace.
+ */
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "Benchmark.hpp"
+#include "StateSerializer.hpp"
+#include "binaryMessageSpec.hpp"
+
+namespace
+{
+
+unity_outgoing::StateMessage_t makeState(size_t numCameras)
+{
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> coordinate(-10, 10);
+    unity_outgoing::StateMessage_t state;
+    state.utime = 1539000000000000;
+    for (size_t i = 0; i < numCameras; i++)
+    {
+        unity_outgoing::Camera_t cam;
+        cam.ID = "Camera_" + std::to_string(i);
+        cam.position = {{coordinate(rng), coordinate(rng), coordinate(rng)}};
+        cam.rotation = {{coordinate(rng), coordinate(rng), coordinate(rng), coordinate(rng)}};
+        cam.channels = 3;
+        cam.isDepth = false;
+        cam.outputIndex = static_cast<int>(i);
+        state.cameras.push_back(cam);
+    }
+    return state;
+}
+
+}
+
+int main()
+{
+    printf("%-8s %-12s %8s %12s\n", "cameras", "message", "bytes", "encode ns");
+    for (size_t numCameras : {2, 8, 32})
+    {
+        unity_outgoing::StateMessage_t state = makeState(numCameras);
+        unity_outgoing::PoseUpdateMessage_t poseUpdate{&state};
+        StateSerializer serializer;
+        std::string binary;
+        size_t iterations = 200000 / (numCameras + 8);
+
+        // JSON goes through StateSerializer, which is what the client sends.
+        double ns = nanosecondsPerCall(iterations, [&](size_t i) {
+            state.utime = i;
+            doNotOptimize(serializer.serialize(state));
+        });
+        printf("%-8zu %-12s %8zu %12.0f\n", numCameras, "full JSON",
+               serializer.serialize(state).size(), ns);
+
+        ns = nanosecondsPerCall(iterations, [&](size_t i) {
+            state.utime = i;
+            doNotOptimize(serializer.serialize(poseUpdate));
+        });
+        printf("%-8zu %-12s %8zu %12.0f\n", numCameras, "PoseUpdate",
+               serializer.serialize(poseUpdate).size(), ns);
+
+        ns = nanosecondsPerCall(iterations, [&](size_t i) {
+            state.utime = i;
+            unity_outgoing::encodeBinaryPoseUpdate(state, binary);
+            doNotOptimize(binary);
+        });
+        unity_outgoing::encodeBinaryPoseUpdate(state, binary);
+        printf("%-8zu %-12s %8zu %12.0f\n", numCameras, "PoseBinary", binary.size(), ns);
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file   binaryMessageSpecFuzz.cpp
+ * @brief  Fuzz entry point for the binary message decoders.
+ *
+ * Every decoder gets the input as is. Each one has to either decode it or
+ * throw std::invalid_argument; anything else aborts. Whatever decodes has to
+ * encode back into a message that decodes to the same thing. Built as a
+ * libFuzzer target with COMPILE_FUZZERS, where AddressSanitizer catches
+ * reads out of bounds, and run on truncated and corrupted messages by
+ * binaryMessageSpecTest.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "binaryMessageSpec.hpp"
+
+namespace
+{
+
+// Runs decode(data, size) and returns whether it succeeded. Aborts on
+// anything but std::invalid_argument.
+template <typename Decode>
+bool decodes(Decode decode)
+{
+    try
+    {
+        decode();
+        return true;
+    }
+    catch (const std::invalid_argument &)
+    {
+        return false;
+    }
+    catch (...)
+    {
+        abort();
+    }
+}
+
+void fuzzRenderMetadata(const uint8_t *data, size_t size)
+{
+    unity_incoming::RenderMetadata_t metadata;
+    if (!decodes([&]() { unity_incoming::decodeBinaryRenderMetadata(data, size, metadata); }))
+    {
+        return;
+    }
+    if (metadata.channels.size() != metadata.cameraIDs.size())
+    {
+        abort();
+    }
+    // Reserved bytes and isCompressed are normalized by a round trip, so
+    // compare the second encoding with the first.
+    std::string encoded;
+    unity_incoming::encodeBinaryRenderMetadata(metadata, encoded);
+    unity_incoming::RenderMetadata_t decoded;
+    unity_incoming::decodeBinaryRenderMetadata(encoded.data(), encoded.size(), decoded);
+    std::string reencoded;
+    unity_incoming::encodeBinaryRenderMetadata(decoded, reencoded);
+    if (encoded != reencoded)
+    {
+        abort();
+    }
+}
+
+void fuzzPoseUpdate(const uint8_t *data, size_t size)
+{
+    // Give the scene as many cameras as the message fits, so that decoding
+    // gets past the camera count check.
+    unity_outgoing::StateMessage_t state;
+    if (size > unity_outgoing::kBinaryPoseUpdateHeaderSize)
+    {
+        state.cameras.resize((size - unity_outgoing::kBinaryPoseUpdateHeaderSize) /
+                             unity_outgoing::kBinaryPoseUpdateCameraSize);
+    }
+    if (!decodes([&]() { unity_outgoing::applyBinaryPoseUpdate(data, size, state); }))
+    {
+        return;
+    }
+    std::string encoded;
+    if (!unity_outgoing::encodeBinaryPoseUpdate(state, encoded) ||
+        encoded.size() != size || memcmp(encoded.data(), data, size) != 0)
+    {
+        abort();
+    }
+}
+
+void fuzzPing(const uint8_t *data, size_t size)
+{
+    unity_outgoing::Ping_t ping;
+    if (!decodes([&]() { unity_outgoing::decodePing(data, size, ping); }))
+    {
+        return;
+    }
+    std::string encoded;
+    unity_outgoing::encodePing(ping, encoded);
+    unity_outgoing::Ping_t decoded;
+    unity_outgoing::decodePing(encoded.data(), encoded.size(), decoded);
+    if (decoded.sequence != ping.sequence || decoded.clientSendUtime != ping.clientSendUtime)
+    {
+        abort();
+    }
+}
+
+void fuzzPong(const uint8_t *data, size_t size)
+{
+    unity_incoming::Pong_t pong;
+    if (!decodes([&]() { unity_incoming::decodePong(data, size, pong); }))
+    {
+        return;
+    }
+    std::string encoded;
+    unity_incoming::encodePong(pong, encoded);
+    unity_incoming::Pong_t decoded;
+    unity_incoming::decodePong(encoded.data(), encoded.size(), decoded);
+    if (decoded.sequence != pong.sequence || decoded.clientSendUtime != pong.clientSendUtime ||
+        decoded.rendererReceiveUtime != pong.rendererReceiveUtime ||
+        decoded.rendererSendUtime != pong.rendererSendUtime)
+    {
+        abort();
+    }
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    fuzzRenderMetadata(data, size);
+    fuzzPoseUpdate(data, size);
+    fuzzPing(data, size);
+    fuzzPong(data, size);
+    return 0;
+}
@@ -0,0 +1,379 @@
+/**
+ * @file   binaryMessageSpecTest.cpp
+ * @brief  Round trips every binary message through its encoder and decoder,
+ * and feeds the decoders truncated and corrupted messages.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "GuardedBuffer.hpp"
+#include "binaryMessageSpec.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+namespace
+{
+
+typedef std::function<void(const void *data, size_t size)> Decoder;
+
+bool throwsInvalidArgument(const Decoder &decode, const std::string &bytes)
+{
+    GuardedBuffer buffer(bytes);
+    try
+    {
+        decode(buffer.data, buffer.size);
+    }
+    catch (const std::invalid_argument &)
+    {
+        return true;
+    }
+    return false;
+}
+
+void fuzz(const std::string &bytes)
+{
+    GuardedBuffer buffer(bytes);
+    LLVMFuzzerTestOneInput(buffer.data, buffer.size);
+}
+
+unity_incoming::RenderMetadata_t makeRenderMetadata(size_t numCameras)
+{
+    unity_incoming::RenderMetadata_t metadata;
+    metadata.utime = 1508372831000000 + numCameras;
+    metadata.camWidth = 1024;
+    metadata.camHeight = 768;
+    metadata.camDepthScale = 0.20000000298023224;
+    metadata.isCompressed = numCameras % 2 == 1;
+    for (size_t i = 0; i < numCameras; i++)
+    {
+        // Include an empty ID, one with a NUL in it and a long one.
+        std::string id = "Camera_" + std::to_string(i);
+        if (i == 1)
+        {
+            id.clear();
+        }
+        else if (i == 2)
+        {
+            id += std::string(1, '\0') + "hidden";
+        }
+        else if (i == 3)
+        {
+            id.append(300, 'x');
+        }
+        metadata.cameraIDs.push_back(id);
+        metadata.channels.push_back(i % 3 == 0 ? 3 : (i % 3 == 1 ? 1 : 4));
+    }
+    return metadata;
+}
+
+unity_outgoing::StateMessage_t makeState(size_t numCameras)
+{
+    std::mt19937 rng(static_cast<unsigned>(numCameras));
+    std::uniform_real_distribution<double> coordinate(-1000, 1000);
+    unity_outgoing::StateMessage_t state;
+    state.utime = 1508372831000000 + numCameras;
+    state.cameras.resize(numCameras);
+    for (unity_outgoing::Camera_t &cam : state.cameras)
+    {
+        for (double &x : cam.position)
+        {
+            x = coordinate(rng);
+        }
+        for (double &x : cam.rotation)
+        {
+            x = coordinate(rng) / 1000;
+        }
+    }
+    return state;
+}
+
+void checkRenderMetadataEqual(const unity_incoming::RenderMetadata_t &a,
+                              const unity_incoming::RenderMetadata_t &b)
+{
+    CHECK(a.utime == b.utime);
+    CHECK(a.camWidth == b.camWidth);
+    CHECK(a.camHeight == b.camHeight);
+    CHECK(a.camDepthScale == b.camDepthScale);
+    CHECK(a.isCompressed == b.isCompressed);
+    CHECK(a.cameraIDs == b.cameraIDs);
+    CHECK(a.channels == b.channels);
+}
+
+void testRenderMetadataRoundTrip()
+{
+    // Decoding reuses what is already in the output, so decode into one
+    // that had more cameras before as well.
+    unity_incoming::RenderMetadata_t reused = makeRenderMetadata(70);
+    for (size_t numCameras : {0, 1, 2, 4, 64})
+    {
+        unity_incoming::RenderMetadata_t metadata = makeRenderMetadata(numCameras);
+        std::string encoded;
+        unity_incoming::encodeBinaryRenderMetadata(metadata, encoded);
+        CHECK(unity_incoming::isBinaryRenderMetadata(encoded.data(), encoded.size()));
+
+        GuardedBuffer buffer(encoded);
+        unity_incoming::RenderMetadata_t decoded;
+        unity_incoming::decodeBinaryRenderMetadata(buffer.data, buffer.size, decoded);
+        checkRenderMetadataEqual(metadata, decoded);
+        unity_incoming::decodeBinaryRenderMetadata(buffer.data, buffer.size, reused);
+        checkRenderMetadataEqual(metadata, reused);
+    }
+
+    unity_incoming::RenderMetadata_t mismatched = makeRenderMetadata(3);
+    mismatched.channels.pop_back();
+    std::string encoded;
+    CHECK_THROWS(unity_incoming::encodeBinaryRenderMetadata(mismatched, encoded),
+                 std::invalid_argument);
+}
+
+void testPoseUpdateRoundTrip()
+{
+    for (size_t numCameras : {0, 1, 5, 32})
+    {
+        unity_outgoing::StateMessage_t state = makeState(numCameras);
+        std::string encoded;
+        CHECK(unity_outgoing::encodeBinaryPoseUpdate(state, encoded));
+        CHECK(encoded.size() == unity_outgoing::binaryPoseUpdateSize(numCameras));
+
+        unity_outgoing::StateMessage_t decoded;
+        decoded.cameras.resize(numCameras);
+        GuardedBuffer buffer(encoded);
+        unity_outgoing::applyBinaryPoseUpdate(buffer.data, buffer.size, decoded);
+        CHECK(decoded.utime == state.utime);
+        for (size_t i = 0; i < numCameras; i++)
+        {
+            CHECK(decoded.cameras[i].position == state.cameras[i].position);
+            CHECK(decoded.cameras[i].rotation == state.cameras[i].rotation);
+        }
+
+        // The scene has to have as many cameras as the update.
+        decoded.cameras.resize(numCameras + 1);
+        CHECK_THROWS(unity_outgoing::applyBinaryPoseUpdate(buffer.data, buffer.size, decoded),
+                     std::invalid_argument);
+    }
+
+    unity_outgoing::StateMessage_t tooMany;
+    tooMany.cameras.resize(size_t(UINT16_MAX) + 1);
+    std::string encoded = "untouched";
+    CHECK(!unity_outgoing::encodeBinaryPoseUpdate(tooMany, encoded));
+    CHECK(encoded == "untouched");
+}
+
+void testPingPongRoundTrip()
+{
+    const int64_t values[] = {0, 1, -1, std::numeric_limits<int64_t>::min(),
+                              std::numeric_limits<int64_t>::max(), 1508372831000000};
+    for (int64_t value : values)
+    {
+        unity_outgoing::Ping_t ping;
+        ping.sequence = value;
+        ping.clientSendUtime = ~value;
+        std::string encoded;
+        unity_outgoing::encodePing(ping, encoded);
+        CHECK(encoded.size() == unity_outgoing::kPingSize);
+        unity_outgoing::Ping_t decodedPing;
+        GuardedBuffer pingBuffer(encoded);
+        unity_outgoing::decodePing(pingBuffer.data, pingBuffer.size, decodedPing);
+        CHECK(decodedPing.sequence == ping.sequence);
+        CHECK(decodedPing.clientSendUtime == ping.clientSendUtime);
+
+        unity_incoming::Pong_t pong;
+        pong.sequence = value;
+        pong.clientSendUtime = ~value;
+        pong.rendererReceiveUtime = value / 2;
+        pong.rendererSendUtime = value / 3;
+        unity_incoming::encodePong(pong, encoded);
+        CHECK(encoded.size() == unity_incoming::kPongSize);
+        CHECK(unity_incoming::isPong(encoded.data(), encoded.size()));
+        CHECK(!unity_incoming::isBinaryRenderMetadata(encoded.data(), encoded.size()));
+        unity_incoming::Pong_t decodedPong;
+        GuardedBuffer pongBuffer(encoded);
+        unity_incoming::decodePong(pongBuffer.data, pongBuffer.size, decodedPong);
+        CHECK(decodedPong.sequence == pong.sequence);
+        CHECK(decodedPong.clientSendUtime == pong.clientSendUtime);
+        CHECK(decodedPong.rendererReceiveUtime == pong.rendererReceiveUtime);
+        CHECK(decodedPong.rendererSendUtime == pong.rendererSendUtime);
+    }
+}
+
+struct Seed
+{
+    std::string name;
+    std::string bytes;
+    Decoder decode;
+};
+
+std::vector<Seed> makeSeeds()
+{
+    std::vector<Seed> seeds;
+
+    std::string metadata;
+    unity_incoming::encodeBinaryRenderMetadata(makeRenderMetadata(4), metadata);
+    seeds.push_back({"FGRM", metadata, [](const void *data, size_t size) {
+                         unity_incoming::RenderMetadata_t o;
+                         unity_incoming::decodeBinaryRenderMetadata(data, size, o);
+                     }});
+
+    std::string poseUpdate;
+    unity_outgoing::encodeBinaryPoseUpdate(makeState(3), poseUpdate);
+    seeds.push_back({"FGPU", poseUpdate, [](const void *data, size_t size) {
+                         unity_outgoing::StateMessage_t state;
+                         state.cameras.resize(3);
+                         unity_outgoing::applyBinaryPoseUpdate(data, size, state);
+                     }});
+
+    std::string ping;
+    unity_outgoing::Ping_t pingMessage;
+    pingMessage.sequence = 7;
+    pingMessage.clientSendUtime = 1508372831000000;
+    unity_outgoing::encodePing(pingMessage, ping);
+    seeds.push_back({"FGPI", ping, [](const void *data, size_t size) {
+                         unity_outgoing::Ping_t p;
+                         unity_outgoing::decodePing(data, size, p);
+                     }});
+
+    std::string pong;
+    unity_incoming::Pong_t pongMessage;
+    pongMessage.sequence = 7;
+    pongMessage.clientSendUtime = 1508372831000000;
+    pongMessage.rendererReceiveUtime = 42;
+    pongMessage.rendererSendUtime = 43;
+    unity_incoming::encodePong(pongMessage, pong);
+    seeds.push_back({"FGPO", pong, [](const void *data, size_t size) {
+                         unity_incoming::Pong_t p;
+                         unity_incoming::decodePong(data, size, p);
+                     }});
+
+    return seeds;
+}
+
+void testTruncated(const Seed &seed)
+{
+    for (size_t size = 0; size < seed.bytes.size(); size++)
+    {
+        if (!throwsInvalidArgument(seed.decode, seed.bytes.substr(0, size)))
+        {
+            std::cerr << seed.name << " truncated to " << size << " bytes was accepted"
+                      << std::endl;
+            checkFailures()++;
+        }
+    }
+    CHECK(throwsInvalidArgument(seed.decode, seed.bytes + '\0'));
+}
+
+// Corruptions of the header that no decoder may accept.
+void testCorruptedHeader(const Seed &seed)
+{
+    for (size_t i = 0; i < 4; i++)
+    {
+        std::string magic = seed.bytes;
+        magic[i] ^= 0x20;
+        CHECK(throwsInvalidArgument(seed.decode, magic));
+    }
+    for (uint16_t version : {0, 2, 0xFFFF})
+    {
+        std::string corrupted = seed.bytes;
+        corrupted[4] = static_cast<char>(version & 0xFF);
+        corrupted[5] = static_cast<char>(version >> 8);
+        CHECK(throwsInvalidArgument(seed.decode, corrupted));
+    }
+}
+
+void testCorruptedCounts(const std::vector<Seed> &seeds)
+{
+    // Camera counts one too high or too low.
+    for (const Seed &seed : seeds)
+    {
+        if (seed.name != "FGRM" && seed.name != "FGPU")
+        {
+            continue;
+        }
+        for (int delta : {-1, 1})
+        {
+            std::string corrupted = seed.bytes;
+            corrupted[6] = static_cast<char>(corrupted[6] + delta);
+            CHECK(throwsInvalidArgument(seed.decode, corrupted));
+        }
+    }
+
+    // Camera ID lengths pointing past the end of the message.
+    const Seed &metadata = seeds[0];
+    for (size_t cam = 0; cam < 4; cam++)
+    {
+        size_t lengthOffset = unity_incoming::kBinaryRenderMetadataHeaderSize +
+                              cam * unity_incoming::kBinaryRenderMetadataCameraSize + 4;
+        for (uint8_t top : {0x01, 0x80, 0xFF})
+        {
+            std::string corrupted = metadata.bytes;
+            corrupted[lengthOffset + 3] = static_cast<char>(top);
+            CHECK(throwsInvalidArgument(metadata.decode, corrupted));
+        }
+    }
+}
+
+// Runs the fuzz entry point on every truncation and single byte corruption
+// of the seeds, then on random corruptions of them.
+void testFuzzSweep(const std::vector<Seed> &seeds)
+{
+    std::mt19937 rng(1);
+    for (const Seed &seed : seeds)
+    {
+        for (size_t size = 0; size <= seed.bytes.size(); size++)
+        {
+            fuzz(seed.bytes.substr(0, size));
+        }
+        for (size_t i = 0; i < seed.bytes.size(); i++)
+        {
+            uint8_t original = static_cast<uint8_t>(seed.bytes[i]);
+            for (uint8_t value : {uint8_t(0), uint8_t(0xFF), uint8_t(original ^ 0x01),
+                                  uint8_t(original ^ 0x80)})
+            {
+                std::string corrupted = seed.bytes;
+                corrupted[i] = static_cast<char>(value);
+                fuzz(corrupted);
+            }
+        }
+        for (int iteration = 0; iteration < 2000; iteration++)
+        {
+            std::string corrupted = seed.bytes.substr(0, rng() % (seed.bytes.size() + 1));
+            size_t flips = 1 + rng() % 4;
+            for (size_t f = 0; f < flips && !corrupted.empty(); f++)
+            {
+                corrupted[rng() % corrupted.size()] = static_cast<char>(rng());
+            }
+            fuzz(corrupted);
+        }
+    }
+}
+
+}
+
+int main()
+{
+    testRenderMetadataRoundTrip();
+    testPoseUpdateRoundTrip();
+    testPingPongRoundTrip();
+
+    std::vector<Seed> seeds = makeSeeds();
+    for (const Seed &seed : seeds)
+    {
+        testTruncated(seed);
+        testCorruptedHeader(seed);
+    }
+    testCorruptedCounts(seeds);
+    testFuzzSweep(seeds);
+
+    if (checkFailures() == 0)
+    {
+        std::cout << "binaryMessageSpec: all checks passed" << std::endl;
+    }
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file   imageConversionBenchmark.cpp
+ * @brief  Times every image conversion kernel the CPU supports against the
+ * per-pixel loop and cvtColor() pass they replaced, at common camera sizes.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Benchmark.hpp"
+#include "imageConversion.hpp"
+
+namespace
+{
+
+// What handleImageResponse() did before the kernels: flip into a scratch
+// buffer one byte at a time, copy that into the Mat, then swap RGB to BGR.
+void originalLoop(const uint8_t *imageData, std::vector<uint8_t> &castedInputBuffer,
+                  cv::Mat &new_image, int channels, int camWidth, int camHeight)
+{
+    uint32_t bufferRowLength = camWidth * channels;
+    for (uint16_t y = 0; y < camHeight; y++)
+    {
+        uint16_t inv_y = camHeight - y - 1;
+        for (uint16_t x = 0; x < camWidth; x++)
+        {
+            for (uint8_t c = 0; c < channels; c++)
+            {
+                castedInputBuffer[y * bufferRowLength + x * channels + c] =
+                    imageData[inv_y * camWidth * channels + x * channels + c];
+            }
+        }
+    }
+    memcpy(new_image.data, castedInputBuffer.data(), camWidth * camHeight * channels);
+    if (channels == 3)
+    {
+        cv::cvtColor(new_image, new_image, CV_RGB2BGR);
+    }
+}
+
+}
+
+int main()
+{
+    const int sizes[][2] = {{640, 480}, {1024, 768}, {1280, 720}, {1920, 1080}};
+    std::vector<std::string> kernels = image_conversion::supportedKernels();
+
+    printf("%-10s %-7s %10s", "size", "output", "original");
+    for (const std::string &kernel : kernels)
+    {
+        printf(" %10s", kernel.c_str());
+    }
+    printf("   (us per image)\n");
+
+    for (const int *size : sizes)
+    {
+        int width = size[0];
+        int height = size[1];
+        std::vector<uint8_t> src(static_cast<size_t>(width) * height * 3);
+        for (size_t i = 0; i < src.size(); i++)
+        {
+            src[i] = static_cast<uint8_t>(i * 7);
+        }
+        std::vector<uint8_t> scratch(src.size());
+        size_t iterations = 20 * 1920 * 1080 / (width * height);
+
+        for (int channels : {3, 1})
+        {
+            cv::Mat output(height, width, CV_MAKETYPE(CV_8U, channels));
+            // The original loop only handled images with as many channels as
+            // the output, so it gets a 1-channel image for 1-channel output.
+            double originalUs =
+                nanosecondsPerCall(iterations,
+                                   [&](size_t) {
+                                       originalLoop(src.data(), scratch, output, channels, width,
+                                                    height);
+                                       doNotOptimize(output.data[0]);
+                                   },
+                                   3) /
+                1000;
+            printf("%4dx%-5d %-7s %10.1f", width, height, channels == 3 ? "BGR" : "gray",
+                   originalUs);
+
+            for (const std::string &kernel : kernels)
+            {
+                double us = nanosecondsPerCall(iterations,
+                                               [&](size_t) {
+                                                   image_conversion::flipAndSwizzleWith(
+                                                       kernel, src.data(), 3, output.data,
+                                                       output.step[0], channels, width, height);
+                                                   doNotOptimize(output.data[0]);
+                                               },
+                                               3) /
+                            1000;
+                printf(" %10.1f", us);
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
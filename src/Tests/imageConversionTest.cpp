@@ -0,0 +1,167 @@
+/**
+ * @file   imageConversionTest.cpp
+ * @brief  Checks that every image conversion kernel the CPU supports gives
+ * the same output as the scalar kernel and as the original per-pixel loop,
+ * at odd widths that exercise the tails of the SIMD loops.
+ */
+
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "GuardedBuffer.hpp"
+#include "imageConversion.hpp"
+
+namespace
+{
+
+// The per-pixel loop the kernels replaced: flip rows, swap RGB to BGR for
+// 3-channel output and keep the first channel for 1-channel output.
+void referenceConvert(const uint8_t *src, int srcChannels, uint8_t *dst, size_t dstStep,
+                      int dstChannels, int width, int height)
+{
+    for (int y = 0; y < height; y++)
+    {
+        int inv_y = height - y - 1;
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < dstChannels; c++)
+            {
+                int srcC = dstChannels == 3 ? 2 - c : c;
+                dst[y * dstStep + x * dstChannels + c] =
+                    src[(static_cast<size_t>(inv_y) * width + x) * srcChannels + srcC];
+            }
+        }
+    }
+}
+
+std::vector<int> testWidths()
+{
+    std::vector<int> widths;
+    for (int width = 1; width <= 100; width++)
+    {
+        widths.push_back(width);
+    }
+    for (int width : {127, 128, 129, 255, 511, 1023, 1024, 1025, 1031})
+    {
+        widths.push_back(width);
+    }
+    return widths;
+}
+
+// Converts with kernel into a buffer whose padding and end are guarded, and
+// returns the output. Padding bytes between rows must stay untouched.
+std::string convertWith(const std::string &kernel, const GuardedBuffer &src, int srcChannels,
+                        int dstChannels, size_t padding, int width, int height, bool &paddingOk)
+{
+    size_t rowSize = static_cast<size_t>(width) * dstChannels;
+    size_t dstStep = rowSize + padding;
+    GuardedBuffer dst((height - 1) * dstStep + rowSize, 0xAA);
+    if (kernel.empty())
+    {
+        image_conversion::flipAndSwizzle(src.data, srcChannels, dst.data, dstStep, dstChannels,
+                                         width, height);
+    }
+    else
+    {
+        image_conversion::flipAndSwizzleWith(kernel, src.data, srcChannels, dst.data, dstStep,
+                                             dstChannels, width, height);
+    }
+
+    paddingOk = true;
+    for (int y = 0; y + 1 < height; y++)
+    {
+        for (size_t i = 0; i < padding; i++)
+        {
+            paddingOk = paddingOk && dst.data[y * dstStep + rowSize + i] == 0xAA;
+        }
+    }
+    return std::string(reinterpret_cast<const char *>(dst.data), dst.size);
+}
+
+void testKernelsMatchReference()
+{
+    std::vector<std::string> kernels = image_conversion::supportedKernels();
+    CHECK(!kernels.empty() && kernels.back() == "scalar");
+    CHECK(kernels.front() == image_conversion::kernelName());
+    std::cout << "Kernels:";
+    for (const std::string &kernel : kernels)
+    {
+        std::cout << " " << kernel;
+    }
+    std::cout << std::endl;
+    // The empty name stands for the kernel flipAndSwizzle() selects.
+    kernels.push_back("");
+
+    const int channelPairs[][2] = {{3, 3}, {3, 1}, {1, 1}, {4, 4}, {4, 3}, {4, 1}};
+    std::mt19937 rng(2);
+    int mismatches = 0;
+    for (const int *channels : channelPairs)
+    {
+        int srcChannels = channels[0];
+        int dstChannels = channels[1];
+        for (int width : testWidths())
+        {
+            for (int height : {1, 3})
+            {
+                std::string pixels(static_cast<size_t>(width) * height * srcChannels, '\0');
+                for (char &c : pixels)
+                {
+                    c = static_cast<char>(rng());
+                }
+                GuardedBuffer src(pixels);
+
+                for (size_t padding : {size_t(0), size_t(7)})
+                {
+                    size_t dstStep = static_cast<size_t>(width) * dstChannels + padding;
+                    GuardedBuffer expected((height - 1) * dstStep + width * dstChannels, 0xAA);
+                    referenceConvert(src.data, srcChannels, expected.data, dstStep, dstChannels,
+                                     width, height);
+                    std::string reference(reinterpret_cast<const char *>(expected.data),
+                                          expected.size);
+
+                    std::string scalar;
+                    for (const std::string &kernel : kernels)
+                    {
+                        bool paddingOk;
+                        std::string output = convertWith(kernel, src, srcChannels, dstChannels,
+                                                         padding, width, height, paddingOk);
+                        if (kernel == "scalar")
+                        {
+                            scalar = output;
+                        }
+                        if (output != reference || !paddingOk ||
+                            (!scalar.empty() && output != scalar))
+                        {
+                            std::cerr << "Kernel " << (kernel.empty() ? "selected" : kernel)
+                                      << " differs for " << srcChannels << " -> " << dstChannels
+                                      << " channels, " << width << "x" << height
+                                      << ", padding " << padding << std::endl;
+                            mismatches++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+void testUnknownKernel()
+{
+    uint8_t pixel[3] = {1, 2, 3};
+    uint8_t out[3];
+    CHECK_THROWS(image_conversion::flipAndSwizzleWith("avx512", pixel, 3, out, 3, 3, 1, 1),
+                 std::invalid_argument);
+}
+
+}
+
+int main()
+{
+    testKernelsMatchReference();
+    testUnknownKernel();
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#ifndef FLIGHTGOGGLESTRANSFORMSBASELINE_H
+#define FLIGHTGOGGLESTRANSFORMSBASELINE_H
+/**
+ * @file   transformsBaseline.hpp
+ * @brief  The coordinate conversions of transforms.hpp as they were before
+ * AxisPermutation, written as dense matrix products. Reference for tests and
+ * benchmarks only.
+ */
+
+#include "transforms.hpp"
+
+namespace baseline
+{
+
+// x->z, y->x, z->-y
+inline Matrix4 unityFromNED()
+{
+    Matrix4 P;
+    // clang-format off
+    P << 0, 1,  0, 0,
+         0, 0, -1, 0,
+         1, 0,  0, 0,
+         0, 0,  0, 1;
+    // clang-format on
+    return P;
+}
+
+// x->y, y->x, z->-z
+inline Matrix4 NEDFromENU()
+{
+    Matrix4 P;
+    // clang-format off
+    P << 0, 1,  0, 0,
+         1, 0,  0, 0,
+         0, 0, -1, 0,
+         0, 0,  0, 1;
+    // clang-format on
+    return P;
+}
+
+inline Matrix4 unityCamFromCam()
+{
+    Matrix4 P;
+    // clang-format off
+    P << 0, 1, 0, 0,
+         0, 0, 1, 0,
+         1, 0, 0, 0,
+         0, 0, 0, 1;
+    // clang-format on
+    return P;
+}
+
+inline Transform3 convertNEDGlobalPoseToGlobalUnityCoordinates(Transform3 NEDworld_T_object)
+{
+    Transform3 unity_pose;
+    unity_pose.matrix() =
+        unityFromNED() * NEDworld_T_object.matrix() * unityFromNED().transpose();
+    return unity_pose;
+}
+
+inline Transform3 convertNEDGlobalPoseToGlobalUnityCoordinates(Transform3 NEDworld_T_object,
+                                                               Transform3 unityWorld_T_NEDworld)
+{
+    Transform3 unity_pose;
+    unity_pose.matrix() = unityFromNED() * unityWorld_T_NEDworld.matrix() *
+                          NEDworld_T_object.matrix() * unityFromNED().transpose();
+    return unity_pose;
+}
+
+inline Transform3 convertROSToNEDCoordinates(Transform3 ENUworld_T_object)
+{
+    Transform3 NED_pose;
+    NED_pose.matrix() = NEDFromENU() * ENUworld_T_object.matrix() * NEDFromENU().transpose();
+    return NED_pose;
+}
+
+inline Transform3 convertCameraAndDronePoseToUnityCoordinates(Transform3 world_T_body,
+                                                              Transform3 body_T_cam,
+                                                              Transform3 unityWorld_T_NEDworld)
+{
+    Transform3 world_T_cam = world_T_body * body_T_cam;
+    Transform3 world_T_unitycam;
+    world_T_unitycam.matrix() = world_T_cam * unityCamFromCam();
+
+    Transform3 unityWorld_T_unitycam;
+    unityWorld_T_unitycam.matrix() = unityFromNED() * unityWorld_T_NEDworld.matrix() *
+                                     world_T_unitycam.matrix() * unityFromNED().transpose();
+    return unityWorld_T_unitycam;
+}
+
+}
+
+#endif
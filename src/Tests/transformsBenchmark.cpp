@@ -0,0 +1,100 @@
+/**
+ * @file   transformsBenchmark.cpp
+ * @brief  Times the coordinate conversions of transforms.hpp against the
+ * dense matrix products they replaced.
+ */
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "Benchmark.hpp"
+#include "transforms.hpp"
+#include "transformsBaseline.hpp"
+
+namespace
+{
+
+typedef std::vector<Transform3, Eigen::aligned_allocator<Transform3>> Poses;
+typedef std::vector<Quaternionx, Eigen::aligned_allocator<Quaternionx>> Rotations;
+
+const size_t kIterations = 1000000;
+
+template <typename Baseline, typename Permuted>
+void compare(const char *name, Baseline baseline, Permuted permuted)
+{
+    double baselineNs = nanosecondsPerCall(kIterations, baseline);
+    double permutedNs = nanosecondsPerCall(kIterations, permuted);
+    printf("%-40s %8.1f ns %8.1f ns %6.1fx\n", name, baselineNs, permutedNs,
+           baselineNs / permutedNs);
+}
+
+}
+
+int main()
+{
+    // A ring of poses that fits in L1, so that memory does not dominate.
+    std::mt19937 rng(15);
+    std::uniform_real_distribution<double> coordinate(-100, 100);
+    Poses poses;
+    Rotations rotations;
+    for (int i = 0; i < 64; i++)
+    {
+        Quaternionx q(coordinate(rng), coordinate(rng), coordinate(rng), coordinate(rng));
+        q.normalize();
+        Transform3 pose = Transform3::Identity();
+        pose.linear() = q.toRotationMatrix();
+        pose.translation() = Vector3(coordinate(rng), coordinate(rng), coordinate(rng));
+        poses.push_back(pose);
+        rotations.push_back(q);
+    }
+    const Transform3 offset = poses[1];
+    const Transform3 body_T_cam = poses[2];
+    auto pose = [&](size_t i) -> const Transform3 & { return poses[i & 63]; };
+
+    printf("%-40s %11s %11s %7s\n", "conversion", "matrices", "permuted", "speedup");
+    compare("convertROSToNEDCoordinates",
+            [&](size_t i) { doNotOptimize(baseline::convertROSToNEDCoordinates(pose(i))); },
+            [&](size_t i) { doNotOptimize(convertROSToNEDCoordinates(pose(i))); });
+    compare("convertNEDGlobalPoseToGlobalUnity",
+            [&](size_t i) {
+                doNotOptimize(baseline::convertNEDGlobalPoseToGlobalUnityCoordinates(pose(i)));
+            },
+            [&](size_t i) {
+                doNotOptimize(convertNEDGlobalPoseToGlobalUnityCoordinates(pose(i)));
+            });
+    compare("convertNEDGlobalPoseToGlobalUnity+offset",
+            [&](size_t i) {
+                doNotOptimize(
+                    baseline::convertNEDGlobalPoseToGlobalUnityCoordinates(pose(i), offset));
+            },
+            [&](size_t i) {
+                doNotOptimize(convertNEDGlobalPoseToGlobalUnityCoordinates(pose(i), offset));
+            });
+    compare("convertCameraAndDronePoseToUnity",
+            [&](size_t i) {
+                doNotOptimize(baseline::convertCameraAndDronePoseToUnityCoordinates(
+                    pose(i), body_T_cam, offset));
+            },
+            [&](size_t i) {
+                doNotOptimize(
+                    convertCameraAndDronePoseToUnityCoordinates(pose(i), body_T_cam, offset));
+            });
+    compare("ROS pose to Unity",
+            [&](size_t i) {
+                doNotOptimize(baseline::convertNEDGlobalPoseToGlobalUnityCoordinates(
+                    baseline::convertROSToNEDCoordinates(pose(i))));
+            },
+            [&](size_t i) { doNotOptimize(convertROSToUnityCoordinates(pose(i))); });
+    // The baseline had to go through a rotation matrix and back.
+    compare("ROS orientation to Unity quaternion",
+            [&](size_t i) {
+                Transform3 rotation = Transform3::Identity();
+                rotation.linear() = rotations[i & 63].toRotationMatrix();
+                Transform3 unity = baseline::convertNEDGlobalPoseToGlobalUnityCoordinates(
+                    baseline::convertROSToNEDCoordinates(rotation));
+                doNotOptimize(Quaternionx(Matrix3(unity.linear())));
+            },
+            [&](size_t i) { doNotOptimize(convertROSToUnityCoordinates(rotations[i & 63])); });
+    return 0;
+}
@@ -0,0 +1,206 @@
+/**
+ * @file   transformsTest.cpp
+ * @brief  Checks every AxisPermutation and every coordinate conversion in
+ * transforms.hpp against the dense matrix products they replaced.
+ */
+
+#include <cmath>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "Check.hpp"
+#include "transforms.hpp"
+#include "transformsBaseline.hpp"
+
+namespace
+{
+
+typedef std::vector<Transform3, Eigen::aligned_allocator<Transform3>> Poses;
+
+// All 24 rotations by multiples of 90 degrees, with translations along the
+// axes, followed by random poses.
+Poses makePoses(size_t numRandom)
+{
+    Poses poses;
+    for (int x = 0; x < 4; x++)
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            for (int z = 0; z < 4; z++)
+            {
+                Transform3 pose = Transform3::Identity();
+                pose.linear() = (Eigen::AngleAxisd(x * M_PI / 2, Vector3::UnitX()) *
+                                 Eigen::AngleAxisd(y * M_PI / 2, Vector3::UnitY()) *
+                                 Eigen::AngleAxisd(z * M_PI / 2, Vector3::UnitZ()))
+                                    .toRotationMatrix();
+                pose.translation() = Vector3(x, -y, z * 1e6);
+                poses.push_back(pose);
+            }
+        }
+    }
+
+    std::mt19937 rng(15);
+    std::uniform_real_distribution<double> coordinate(-100, 100);
+    for (size_t i = 0; i < numRandom; i++)
+    {
+        Quaternionx q(coordinate(rng), coordinate(rng), coordinate(rng), coordinate(rng));
+        q.normalize();
+        Transform3 pose = Transform3::Identity();
+        pose.linear() = q.toRotationMatrix();
+        pose.translation() = Vector3(coordinate(rng), coordinate(rng), coordinate(rng));
+        poses.push_back(pose);
+    }
+    return poses;
+}
+
+// Quaternions q and -q are the same rotation.
+bool sameRotation(const Quaternionx &a, const Quaternionx &b)
+{
+    return std::min((a.coeffs() - b.coeffs()).norm(), (a.coeffs() + b.coeffs()).norm()) < 1e-12;
+}
+
+template <typename P>
+void checkPermutation(const Poses &poses)
+{
+    Matrix4 M = P::matrix();
+    CHECK(std::abs(M.topLeftCorner<3, 3>().determinant() - P::determinant()) < 1e-12);
+
+    int mismatches = 0;
+    for (const Transform3 &pose : poses)
+    {
+        Transform3 expected;
+        expected.matrix() = M * pose.matrix() * M.transpose();
+        if (!(P::conjugate(pose).matrix() == expected.matrix()))
+        {
+            mismatches++;
+        }
+        if (!(P::apply(pose.translation()) == M.topLeftCorner<3, 3>() * pose.translation()))
+        {
+            mismatches++;
+        }
+        Quaternionx q(pose.linear());
+        if (!sameRotation(P::conjugate(q), Quaternionx(Matrix3(expected.linear()))))
+        {
+            mismatches++;
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+template <typename P>
+void checkComposition()
+{
+    // Composition with the permutations transforms.hpp uses.
+    typedef typename ComposedAxisPermutation<P, NEDToUnity>::type First;
+    typedef typename ComposedAxisPermutation<ENUToNED, P>::type Second;
+    typedef typename ComposedAxisPermutation<P, CameraToUnityCamera>::type Third;
+    CHECK(First::matrix() == NEDToUnity::matrix() * P::matrix());
+    CHECK(Second::matrix() == P::matrix() * ENUToNED::matrix());
+    CHECK(Third::matrix() == CameraToUnityCamera::matrix() * P::matrix());
+}
+
+template <int A0, int A1, int A2>
+void checkSignsOf(const Poses &poses)
+{
+    checkPermutation<AxisPermutation<A0, A1, A2>>(poses);
+    checkPermutation<AxisPermutation<-A0, A1, A2>>(poses);
+    checkPermutation<AxisPermutation<A0, -A1, A2>>(poses);
+    checkPermutation<AxisPermutation<A0, A1, -A2>>(poses);
+    checkPermutation<AxisPermutation<-A0, -A1, A2>>(poses);
+    checkPermutation<AxisPermutation<-A0, A1, -A2>>(poses);
+    checkPermutation<AxisPermutation<A0, -A1, -A2>>(poses);
+    checkPermutation<AxisPermutation<-A0, -A1, -A2>>(poses);
+
+    checkComposition<AxisPermutation<A0, A1, A2>>();
+    checkComposition<AxisPermutation<-A0, A1, A2>>();
+    checkComposition<AxisPermutation<A0, -A1, A2>>();
+    checkComposition<AxisPermutation<A0, A1, -A2>>();
+    checkComposition<AxisPermutation<-A0, -A1, A2>>();
+    checkComposition<AxisPermutation<-A0, A1, -A2>>();
+    checkComposition<AxisPermutation<A0, -A1, -A2>>();
+    checkComposition<AxisPermutation<-A0, -A1, -A2>>();
+}
+
+// All 48 signed permutations.
+void testPermutations(const Poses &poses)
+{
+    checkSignsOf<1, 2, 3>(poses);
+    checkSignsOf<1, 3, 2>(poses);
+    checkSignsOf<2, 1, 3>(poses);
+    checkSignsOf<2, 3, 1>(poses);
+    checkSignsOf<3, 1, 2>(poses);
+    checkSignsOf<3, 2, 1>(poses);
+
+    static_assert(std::is_same<ENUToUnity, AxisPermutation<1, 3, 2>>::value,
+                  "ENU to Unity is x->x, y->z, z->y");
+    CHECK(ENUToNED::matrix() == baseline::NEDFromENU());
+    CHECK(NEDToUnity::matrix() == baseline::unityFromNED());
+    CHECK(CameraToUnityCamera::matrix() == baseline::unityCamFromCam());
+}
+
+// The conversion functions have to return exactly what the matrix products
+// did, for every pose.
+void testConversions(const Poses &poses)
+{
+    const Transform3 &unityWorld_T_NEDworld = poses[70];
+    const Transform3 &body_T_cam = poses[71];
+    int mismatches = 0;
+    for (const Transform3 &pose : poses)
+    {
+        Transform3 ned = baseline::convertROSToNEDCoordinates(pose);
+        if (!(convertROSToNEDCoordinates(pose).matrix() == ned.matrix()))
+        {
+            mismatches++;
+        }
+
+        Transform3 unity = baseline::convertNEDGlobalPoseToGlobalUnityCoordinates(pose);
+        if (!(convertNEDGlobalPoseToGlobalUnityCoordinates(pose).matrix() == unity.matrix()))
+        {
+            mismatches++;
+        }
+
+        Transform3 offset =
+            baseline::convertNEDGlobalPoseToGlobalUnityCoordinates(pose, unityWorld_T_NEDworld);
+        if (!(convertNEDGlobalPoseToGlobalUnityCoordinates(pose, unityWorld_T_NEDworld).matrix() ==
+              offset.matrix()))
+        {
+            mismatches++;
+        }
+
+        Transform3 camera = baseline::convertCameraAndDronePoseToUnityCoordinates(
+            pose, body_T_cam, unityWorld_T_NEDworld);
+        if (!(convertCameraAndDronePoseToUnityCoordinates(pose, body_T_cam, unityWorld_T_NEDworld)
+                  .matrix() == camera.matrix()))
+        {
+            mismatches++;
+        }
+
+        Transform3 rosToUnity = baseline::convertNEDGlobalPoseToGlobalUnityCoordinates(ned);
+        if (!(convertROSToUnityCoordinates(pose).matrix() == rosToUnity.matrix()))
+        {
+            mismatches++;
+        }
+        Quaternionx rotation(pose.linear());
+        if (!sameRotation(convertROSToUnityCoordinates(rotation),
+                          Quaternionx(Matrix3(rosToUnity.linear()))))
+        {
+            mismatches++;
+        }
+    }
+    if (mismatches != 0)
+    {
+        std::cerr << mismatches << " conversions differ from the matrix products" << std::endl;
+    }
+    CHECK(mismatches == 0);
+}
+
+}
+
+int main()
+{
+    Poses poses = makePoses(20000);
+    testPermutations(poses);
+    testConversions(poses);
+    return checkFailures() == 0 ? 0 : 1;
+}